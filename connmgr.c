@@ -1,250 +1,1504 @@
 #define _GNU_SOURCE
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <endian.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include "connmgr.h"
 #include "sbuffer.h"
+#include "lib/mempool.h"
+#include "lib/uring.h"
+
+#ifndef CONNECTION_POOL_SLAB
+#define CONNECTION_POOL_SLAB 64
+#endif
+
+/*
+ * Maximum amount of ready descriptors handled per epoll_wait() call
+ */
+#ifndef CONNMGR_MAX_EVENTS
+#define CONNMGR_MAX_EVENTS 256
+#endif
+
+/*
+ * Resolution of the connection timeouts
+ */
+#ifndef CONNMGR_TIMER_TICK_MS
+#define CONNMGR_TIMER_TICK_MS 100
+#endif
+
+/*
+ * io_uring backend: size of the submission queue, and the provided buffers every multishot recv picks from
+ */
+#ifndef CONNMGR_URING_ENTRIES
+#define CONNMGR_URING_ENTRIES 256
+#endif
+
+#ifndef CONNMGR_URING_BUFFERS
+#define CONNMGR_URING_BUFFERS 256
+#endif
+
+#ifndef CONNMGR_URING_BUFFER_SIZE
+#define CONNMGR_URING_BUFFER_SIZE 4096
+#endif
+
+/*
+ * Wake-up to publish time, from the return of epoll_wait() or io_uring_enter() to the publish of the readings read in
+ * that wake-up. The time a reading waited in the kernel before the wake-up is not part of it.
+ * Microseconds the histogram resolves, a reading that took longer is counted in the last bucket
+ */
+#ifndef CONNMGR_PUBLISH_US
+#define CONNMGR_PUBLISH_US 4096
+#endif
+
+/*
+ * UDP listener: datagrams per recvmmsg() call, the largest datagram taken whole (one Ethernet frame) and the
+ * amount of sources every reactor keeps counters for, the sources beyond it share one set of counters
+ */
+#ifndef CONNMGR_UDP_BATCH
+#define CONNMGR_UDP_BATCH 64
+#endif
+
+#ifndef CONNMGR_UDP_DATAGRAM
+#define CONNMGR_UDP_DATAGRAM 1472
+#endif
+
+/**
+ * Senders of datagrams counted one by one per reactor, the table is filled first come first served and
+ * never emptied: every sender that comes later is counted in one shared entry, printed as the other sources.
+ * The readings of every sensor id are still counted apart, see connmgr_sensor_t
+ */
+#ifndef CONNMGR_UDP_SOURCES
+#define CONNMGR_UDP_SOURCES 64
+#endif
+
+/**
+ * Counters of one address that sends datagrams
+ */
+typedef struct {
+    in_addr_t addr;
+    int used;
+    unsigned long datagrams;
+    unsigned long readings;
+    unsigned long malformed;        /**< empty datagrams or datagrams that end in a partial record, dropped whole */
+    unsigned long dropped;          /**< datagrams larger than CONNMGR_UDP_DATAGRAM, the kernel truncated them */
+} connmgr_udp_source_t;
+
+/**
+ * Admission counters of one sensor id in one reactor, its bucket is shared by every reactor, see sensor_buckets
+ */
+typedef struct {
+    unsigned long readings;
+    unsigned long over_limit;       /**< times one of its connections was paused for going over a limit */
+    unsigned long dropped;          /**< readings in datagrams that came over its limit */
+} connmgr_sensor_t;
+
+/**
+ * A reactor owns a listening socket, an event loop and every connection it accepts, together with their
+ * timers and records. Nothing of it is touched by another thread, except its queue
+ */
+struct connmgr_reactor {
+    pthread_t thread;
+    int port;
+    int backend;                                    /**< CONNMGR_BACKEND_* the loop actually runs on */
+    tcp_connection_t *server;
+    int server_sd;
+    const char *unix_path;                          /**< NULL: no Unix socket listener, only the first reactor has one */
+    int unix_type;
+    tcp_connection_t *unix_server;                  /**< the Unix socket listener, NULL if there is none */
+    int unix_sd;
+    int epoll_fd;
+    uring_t ring;                                   /**< io_uring backend only */
+    uring_buffers_t buffers;
+    int closing;                                    /**< io_uring: removed connections still waiting for their last completion */
+    int udp_port;                                   /**< 0: no UDP listener */
+    int udp_sd;
+    struct mmsghdr udp_messages[CONNMGR_UDP_BATCH]; /**< set up once, every recvmmsg() fills the same buffers */
+    struct iovec udp_iov[CONNMGR_UDP_BATCH];
+    struct sockaddr_in udp_addr[CONNMGR_UDP_BATCH];
+    unsigned char udp_buffer[CONNMGR_UDP_BATCH][CONNMGR_UDP_DATAGRAM];
+    connmgr_udp_source_t udp_sources[CONNMGR_UDP_SOURCES];
+    connmgr_udp_source_t udp_other;                 /**< every source that found the table full */
+    int timeout_ms;                                 /**< how long the loop may block, see update_timeout_value() */
+    tcp_connection_t *connection_list;              /**< every open sensor connection, linked through the connection itself */
+    int connection_count;
+    timer_wheel_t *timeout_wheel;                   /**< one timer per connection, re-armed by every reading */
+    mempool_t *connection_pool;                     /**< connection records, owned by the reactor thread */
+    sbuffer_t *queue;                               /**< single-producer queue drained by the forwarder, NULL: publish to sbuffer */
+    int queue_reader;
+    sensor_data_t staging[SBUFFER_BATCH_SIZE];      /**< readings of the current wake-up, published in one batch */
+    int staged;
+    unsigned long readings;                         /**< readings parsed so far */
+    unsigned long syscalls;                         /**< epoll_wait(), accept(), recv() and recvmmsg() calls, plus io_uring_enter() */
+    uint64_t wake_us;                               /**< when epoll_wait() or io_uring_enter() returned last */
+    unsigned long publish_us[CONNMGR_PUBLISH_US];   /**< readings per microsecond from wake-up to publish */
+    connmgr_sensor_t *sensors;                      /**< indexed by sensor id, NULL when nothing is limited */
+    uint64_t now_ms;                                /**< time of the readings that are being parsed */
+    uint64_t sensor_wait_ms;                        /**< longest a sensor of the parsed readings has to wait for its budget */
+    sensor_id_t sensor_wait_id;                     /**< the sensor that has to wait sensor_wait_ms */
+    unsigned long connection_pauses;                /**< times a connection was paused for going over the connection limit */
+    int datagram;                                   /**< 1 while readings of a datagram are parsed, those can't be paused */
+};
 
 //********Global variables********
-tcp_connection_t *server=NULL;
-int server_sd;
-fd_set sd_set_origin, sd_set_motified;  /* origin: The socket descriptors to be watched to see if they are ready for reading
-                                         * motified: The socket descriptors that are ready for reading*/
-struct timeval timeout; 
-int sd_amount; 
-int max_sd; 
-dplist_t* connection_list=NULL;
-bool last_removed_flag;
-FILE *file;
-extern char* log_message;
+connmgr_reactor_t *reactors=NULL;
+int reactor_count=0;
+atomic_int active_connections;          // connections over all reactors
+atomic_long idle_since_ts;              // when the last connection was removed, the server stops TIMEOUT seconds later
+atomic_int connmgr_stopping;            // set by the reactor that sees the server timeout, the others follow
+atomic_int reactors_done;
+int doorbell_fd=-1;                     // eventfd the reactors ring after filling their queue
+atomic_int forwarder_parked;            // 1 while the forwarder may sleep on doorbell_fd, only then a reactor rings
+int connmgr_limited=0;                  // 1 if any connection or sensor has a limit
+connmgr_limit_t connection_limit;
+connmgr_limit_t *sensor_limits=NULL;    // indexed by sensor id, read-only once the reactors run, NULL: no sensor has a limit
+_Atomic uint64_t *sensor_buckets=NULL;  // indexed by sensor id, shared by the reactors, see connmgr_sensor_take()
+tcp_sock_opts_t socket_opts;            // applied to the listening sockets and every accepted connection
 
 extern sbuffer_t *sbuffer;
 extern int connection_end;
-extern pthread_cond_t cond1;
-extern pthread_cond_t cond_db;
 extern void fifo_log(char* log);
 extern pthread_rwlock_t *flag_lock;
 
+static void *connmgr_reactor_main(void *arg);
+static void connmgr_reactor_run(connmgr_reactor_t *reactor);
+static int connmgr_reactor_stop(void);
+static void connmgr_reactor_free(connmgr_reactor_t *reactor);
+static void connmgr_epoll_loop(connmgr_reactor_t *reactor);
+static int connmgr_uring_setup(connmgr_reactor_t *reactor);
+static void connmgr_uring_loop(connmgr_reactor_t *reactor);
+static void connmgr_uring_complete(connmgr_reactor_t *reactor);
+static void connmgr_uring_accept(connmgr_reactor_t *reactor, tcp_connection_t *listener);
+static void connmgr_uring_recv(tcp_connection_t *connection);
+static void connmgr_uring_received(tcp_connection_t *connection, int result, unsigned int flags);
+static void connmgr_uring_poll_udp(connmgr_reactor_t *reactor);
+static void connmgr_udp_open(connmgr_reactor_t *reactor);
+static void connmgr_udp_receive(connmgr_reactor_t *reactor);
+static connmgr_udp_source_t *connmgr_udp_source(connmgr_reactor_t *reactor, in_addr_t addr);
+static void connmgr_udp_print(connmgr_reactor_t *reactor);
+static void connmgr_forward(void);
+static void connmgr_accept(connmgr_reactor_t *reactor, tcp_connection_t *listener);
+static tcp_connection_t *connmgr_add(connmgr_reactor_t *reactor, tcp_connection_t *listener, tcpsock_t *socket);
+static void connmgr_remove(tcp_connection_t *connection);
+static void connmgr_closed(tcp_connection_t *connection);
+static void connmgr_malformed(tcp_connection_t *connection);
+static ssize_t connmgr_parse(tcp_connection_t *connection, const unsigned char *data, size_t length);
+static int connmgr_detect(const unsigned char *data, size_t length);
+static ssize_t connmgr_decode(connmgr_reactor_t *reactor, int protocol, const unsigned char *data, size_t length, sensor_data_t *last);
+static ssize_t connmgr_decode_frame(connmgr_reactor_t *reactor, const unsigned char *frame, size_t length, sensor_data_t *last);
+static int connmgr_check_frames(const unsigned char *data, size_t length);
+static int connmgr_varint(const unsigned char **p, const unsigned char *end, uint64_t *value);
+static void connmgr_stage(connmgr_reactor_t *reactor, const sensor_data_t *data);
+static void connmgr_limits_load(connmgr_config_t *config);
+static int connmgr_admit(connmgr_reactor_t *reactor, const sensor_data_t *data);
+static uint64_t connmgr_sensor_take(_Atomic uint64_t *bucket, const connmgr_limit_t *limit, uint64_t now_ms, int strict);
+static void connmgr_bucket_refill(connmgr_bucket_t *bucket, const connmgr_limit_t *limit, uint64_t now_ms);
+static uint64_t connmgr_bucket_take(connmgr_bucket_t *bucket, const connmgr_limit_t *limit, uint64_t now_ms, double amount);
+static void connmgr_throttle(tcp_connection_t *connection, uint64_t resume_ms, int sensor_id);
+static void connmgr_resume(tcp_connection_t *connection);
+static int connmgr_parse_chunk(tcp_connection_t *connection, const unsigned char *data, size_t length);
+static void connmgr_flush(connmgr_reactor_t *reactor);
+static uint64_t connmgr_now_ms(void);
+static uint64_t connmgr_now_us(void);
+static unsigned long connmgr_publish_quantile(connmgr_reactor_t *reactor, double q);
+
 // *********Functions*******
-void * element_copy_c(void * element)
-{
-    tcp_connection_t *tcp_node = NULL;
-    tcp_node = malloc(sizeof(tcp_connection_t));
-    *tcp_node = *(tcp_connection_t *)element;
-    return (void *) tcp_node;
+
+void connmgr_listen(connmgr_config_t *config) {
+    /*This project uses an epoll event loop to monitor the socket descriptors: epoll_wait() only returns the
+     * descriptors that are ready, each carrying a pointer to its connection, so the cost of a wake-up depends
+     * on the amount of active sensors and not on the amount of connected ones.
+     * The io_uring backend goes one step further: multishot accept and recv keep running in the kernel and
+     * the reactor only collects their completions.
+     * With more than one reactor, every reactor listens on its own SO_REUSEPORT socket and the kernel spreads
+     * the sensors over them, the calling thread forwards their readings to the shared buffer.
+     * Sensors that rather fire and forget send their readings in UDP datagrams, every reactor takes them
+     * in batches with recvmmsg() next to its TCP connections */
+
+    printf("Server(port:%d) is started\n",config->port);
+    if (config->unix_path != NULL) printf("Unix socket listener(path:%s) is started\n",config->unix_path);
+    if (config->udp_port > 0) printf("UDP listener(port:%d) is started\n",config->udp_port);
+
+    connmgr_limits_load(config);
+    socket_opts = config->socket_opts;
+
+    reactor_count = config->reactors > 1 ? config->reactors : 1;
+    reactors = calloc(reactor_count, sizeof(connmgr_reactor_t));
+    if (reactors == NULL) exit(EXIT_FAILURE);
+    atomic_init(&active_connections, 0);
+    atomic_init(&idle_since_ts, time(NULL));     // wait TIMEOUT seconds for the first connection
+    atomic_init(&connmgr_stopping, 0);
+    atomic_init(&reactors_done, 0);
+    atomic_init(&forwarder_parked, 0);
+    for (int i = 0; i < reactor_count; i++)
+    {
+        reactors[i].port = config->port;
+        reactors[i].backend = config->backend;
+        reactors[i].udp_port = config->udp_port;
+        reactors[i].udp_sd = -1;
+        reactors[i].epoll_fd = -1;
+        reactors[i].ring.fd = -1;
+        reactors[i].unix_path = NULL;
+        reactors[i].unix_sd = -1;
+    }
+    // a Unix socket path can't be shared like SO_REUSEPORT shares a port, so only the first reactor listens on it
+    reactors[0].unix_path = config->unix_path;
+    reactors[0].unix_type = config->unix_type;
+
+    if (reactor_count == 1)
+    {
+        reactors[0].queue = NULL;
+        connmgr_reactor_run(&reactors[0]);
+    }
+    else
+    {
+        doorbell_fd = eventfd(0, 0);
+        if (doorbell_fd == -1)
+        {
+            perror("eventfd()");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < reactor_count; i++)
+        {
+            // register the forwarder before the reactor starts so it sees every reading
+            if (sbuffer_init(&reactors[i].queue) != SBUFFER_SUCCESS) exit(EXIT_FAILURE);
+            reactors[i].queue_reader = sbuffer_register_reader(reactors[i].queue);
+            if (pthread_create(&reactors[i].thread, NULL, connmgr_reactor_main, &reactors[i]) != 0) exit(EXIT_FAILURE);
+        }
+        connmgr_forward();
+        for (int i = 0; i < reactor_count; i++) pthread_join(reactors[i].thread, NULL);
+    }
+
 }
 
-void element_free_c(void ** element)
+static void *connmgr_reactor_main(void *arg)
 {
-    tcp_connection_t *tcp_node = (tcp_connection_t*) *element;
-    tcp_close(&(tcp_node->socket_information));
-    free(*element);
-    *element = NULL;
+    connmgr_reactor_run(arg);
+    // the forwarder only stops once every reactor rang for the last time
+    atomic_fetch_add(&reactors_done, 1);
+    uint64_t ring = 1;
+    if (write(doorbell_fd, &ring, sizeof(ring)) == -1) perror("write()");
+    return NULL;
 }
 
-int element_compare_c(void * x, void * y)
+/**
+ * Runs one reactor until the server timeout or until the gateway stops
+ */
+static void connmgr_reactor_run(connmgr_reactor_t *reactor)
 {
-    return ((((tcp_connection_t*)x)->socket_information->sd < ((tcp_connection_t*)y)->socket_information->sd) ? -1 : (((tcp_connection_t*)x)->socket_information->sd == ((tcp_connection_t*)y)->socket_information->sd) ? 0 : 1);
-}
+    // the pool belongs to the thread that allocates from it, so it is created here
+    reactor->connection_pool = mempool_create(sizeof(tcp_connection_t), CONNECTION_POOL_SLAB);
+    if (reactor->connection_pool == NULL) exit(EXIT_FAILURE);
 
+    //*********Creates a server socket and opens it in 'passive listening mode'
+    reactor->server = mempool_alloc(reactor->connection_pool);
+    if (reactor->server == NULL) exit(EXIT_FAILURE);
+    // the server socket is drained until accept() would block, so it must never block itself
+    tcp_sock_opts_t server_opts = socket_opts;
+    server_opts.reuseport = (reactor_count > 1);
+    server_opts.nonblock = 1;
+    if (tcp_passive_open_opts(&(reactor->server->socket_information), reactor->port, &server_opts) != TCP_NO_ERROR) exit(EXIT_FAILURE);
+    //Return the socket descriptor of sever
+    if (tcp_get_sd(reactor->server->socket_information,&reactor->server_sd) != TCP_NO_ERROR) exit(EXIT_FAILURE);
 
-void connmgr_listen(int port) {
-    /*This project choode to use select() to monitor multiple socket descriptors (incoming data), 
-     * waiting until one or more of the socket descriptors become "ready" for data inserting */
+    reactor->unix_server = NULL;
+    if (reactor->unix_path != NULL)
+    {
+        reactor->unix_server = mempool_alloc(reactor->connection_pool);
+        if (reactor->unix_server == NULL) exit(EXIT_FAILURE);
+        if (tcp_passive_open_unix(&(reactor->unix_server->socket_information), reactor->unix_path, reactor->unix_type,
+                                  &server_opts) != TCP_NO_ERROR)
+        {
+            perror("Unix socket listener");
+            exit(EXIT_FAILURE);
+        }
+        if (tcp_get_sd(reactor->unix_server->socket_information,&reactor->unix_sd) != TCP_NO_ERROR) exit(EXIT_FAILURE);
+    }
 
-    printf("Server(port:%d) is started\n",port);
+    if (reactor->udp_port > 0) connmgr_udp_open(reactor);
 
-    file = fopen("sensor_data_recv","w");
-    
-    //*********Creates a server socket and opens it in 'passive listening mode'
-    server = malloc(sizeof(tcp_connection_t));
-    if (tcp_passive_open(&(server->socket_information), port) != TCP_NO_ERROR) exit(EXIT_FAILURE); 
-    //Return the socket descriptor of sever
-    if (tcp_get_sd(server->socket_information,&server_sd) != TCP_NO_ERROR) exit(EXIT_FAILURE);
-
-    
-    //*********Initialize connection_list and add sever in it*********
-    connection_list = dpl_create(element_copy_c, element_free_c, element_compare_c);
-    if(connection_list == NULL) printf("fail to create connection list\n");
-    connection_list = dpl_insert_at_index(connection_list, server,0,false); 
-    
-    
-    //*********Initialize select() parameters*********
-    // Watch stdin (server socket ddescriptor) to see when it has input.
-    FD_ZERO(&sd_set_origin);  //removes all socket descriptors from set
-    FD_SET(server_sd,&sd_set_origin); // adds the server socket descriptor to set.
-    max_sd = server_sd;  //  the highest-numbered socket descriptor in the set, currently is the server one
-    timeout.tv_sec = TIMEOUT;  /*the interval that select() should block 
-                                * waiting for a file descriptor to become ready (second)
-                                * wait for the first connction to come for double TIMEOUT value (make it different from the last one is removed)*/
-    timeout.tv_usec = 0;  
-    last_removed_flag=1;
+    if (sensor_limits != NULL)
+    {
+        // every id gets a slot, only the pages of the ids that show up are ever touched
+        reactor->sensors = calloc(UINT16_MAX + 1, sizeof(connmgr_sensor_t));
+        if (reactor->sensors == NULL) exit(EXIT_FAILURE);
+    }
+
+    reactor->timeout_wheel = timer_wheel_create(connmgr_now_ms(), CONNMGR_TIMER_TICK_MS);
+    if (reactor->timeout_wheel == NULL) exit(EXIT_FAILURE);
+
+    reactor->connection_list = NULL;
+    reactor->connection_count = 0;
+    reactor->closing = 0;
+    reactor->staged = 0;
+    reactor->readings = 0;
+    reactor->syscalls = 0;
+    reactor->wake_us = connmgr_now_us();
+    memset(reactor->publish_us, 0, sizeof(reactor->publish_us));
+    update_timeout_value(reactor);
 
+    if (reactor->backend == CONNMGR_BACKEND_URING && connmgr_uring_setup(reactor) != 0)
+    {
+        printf("io_uring is not available, falling back to epoll\n");
+        reactor->backend = CONNMGR_BACKEND_EPOLL;
+    }
+    if (reactor->backend == CONNMGR_BACKEND_URING) connmgr_uring_loop(reactor);
+    else connmgr_epoll_loop(reactor);
+    connmgr_reactor_free(reactor);
+}
+
+/**
+ * Returns 1 when the loop of 'reactor' has to stop: the gateway stops, or no reactor had a connection for TIMEOUT seconds
+ */
+static int connmgr_reactor_stop(void)
+{
     // protect flag -- read
     pthread_rwlock_rdlock(flag_lock);
     int connection_end_flag=connection_end;
     pthread_rwlock_unlock(flag_lock);
-    while(connection_end_flag==0) {
-
-        sd_set_motified = sd_set_origin;   // the origin set is to save the connections that need to be watched
-        sd_amount = select(max_sd+1, &sd_set_motified, NULL, NULL, &timeout); /*return the number of socket descriptors contained 
-                                                                * in the motified descriptor set, meanwhile the motified set 
-                                                                * has been changed!!   */                                         
-        //printf("timeout on: %ld\n", time(NULL));
-        //print_all();
-        remove_timeout_connections(); // remove the sensor(s) that lost connection(timeout)
-        
-        // protect flag -- read
-        pthread_rwlock_rdlock(flag_lock);
-        connection_end_flag=connection_end;
-        pthread_rwlock_unlock(flag_lock);
-
-        if(sd_amount <0 )
-        {
-            perror("select()");
+    if (connection_end_flag != 0 || atomic_load(&connmgr_stopping)) return 1;
+
+    if(atomic_load(&active_connections) == 0 && time(NULL) - atomic_load(&idle_since_ts) >= TIMEOUT)
+    {
+        // the first reactor that sees the timeout announces it, the others stop without a word
+        if (atomic_exchange(&connmgr_stopping, 1) == 0)
+        {
+            printf("Server timeout\n");
+            printf("Server is shutting down\n");
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static void connmgr_epoll_loop(connmgr_reactor_t *reactor)
+{
+    //*********Initialize the epoll instance and watch the server socket*********
+    reactor->epoll_fd = epoll_create1(0);
+    if (reactor->epoll_fd == -1)
+    {
+        perror("epoll_create1()");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = reactor->server };
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->server_sd, &event) == -1) exit(EXIT_FAILURE);
+    if (reactor->unix_server != NULL)
+    {
+        struct epoll_event unix_event = { .events = EPOLLIN, .data.ptr = reactor->unix_server };
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->unix_sd, &unix_event) == -1) exit(EXIT_FAILURE);
+    }
+    if (reactor->udp_sd != -1)
+    {
+        struct epoll_event udp_event = { .events = EPOLLIN, .data.ptr = &reactor->udp_sd };
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->udp_sd, &udp_event) == -1) exit(EXIT_FAILURE);
+    }
+
+    struct epoll_event events[CONNMGR_MAX_EVENTS];
+
+    while(!connmgr_reactor_stop()) {
+
+        int ready = epoll_wait(reactor->epoll_fd, events, CONNMGR_MAX_EVENTS, reactor->timeout_ms);
+        reactor->syscalls++;
+        reactor->wake_us = connmgr_now_us();
+        if(ready < 0)
+        {
+            if(errno == EINTR) continue;
+            perror("epoll_wait()");
             exit(EXIT_FAILURE);
         }
 
-        if(sd_amount >0 )  // connections come
+        // only the ready descriptors are visited, every event points straight at its connection
+        for(int i=0; i<ready; i++)
         {
-            // the server sd is in the set -> new connection has been made
-            if(FD_ISSET(server_sd,&sd_set_motified)) 
+            tcp_connection_t *connection = events[i].data.ptr;
+            if(connection == reactor->server || connection == reactor->unix_server)
             {
-                // get the new connection
-                tcp_connection_t *new_connection = malloc(sizeof(tcp_connection_t));
-                new_connection->last_update_ts = time(NULL);
-                if (tcp_wait_for_connection(server->socket_information, &new_connection->socket_information) != TCP_NO_ERROR) exit(EXIT_FAILURE);
-                int new_sd;
-                if (tcp_get_sd(new_connection->socket_information,&new_sd) != TCP_NO_ERROR) exit(EXIT_FAILURE);
-                dpl_insert_at_index(connection_list, new_connection, dpl_size(connection_list), false); // insert the new connection into the list
-                FD_SET(new_sd,&sd_set_origin); // add new sd to the origin sd set 
-                max_sd = max(max_sd,new_sd);  // update max sd value
-                read_data(new_connection,1);  // print new connection's first data
-
+                connmgr_accept(reactor, connection);
             }
-
-            // loop all conncetions(except for server) to read new data from previously added sensors
-            for(int i=1; i<dpl_size(connection_list); i++) {
-                
-                tcp_connection_t *dummy = dpl_get_element_at_index(connection_list, i);
-                int dummy_sd;
-                if (tcp_get_sd(dummy->socket_information,&dummy_sd) != TCP_NO_ERROR) exit(EXIT_FAILURE); 
-                if (FD_ISSET(dummy_sd,&sd_set_motified)) // new data of the connection has come
-                {
-                    dummy->last_update_ts = time(NULL);
-                    read_data(dummy,0);
-                }
+            else if((void *) connection == &reactor->udp_sd)
+            {
+                connmgr_udp_receive(reactor);
+            }
+            else
+            {
+                read_data(connection);
             }
-            last_removed_flag = 0; 
         }
-        update_timeout_value(); 
+        connmgr_flush(reactor);     // everything read in this wake-up is published at once
+
+        remove_timeout_connections(reactor); // remove the sensor(s) that lost connection(timeout)
+        update_timeout_value(reactor);
+    }
+}
+
+/**
+ * Sets up the ring and the provided buffers of 'reactor', returns 0 on success or a negative errno
+ * The loop depends on multishot accept and recv, a kernel without them is reported like one without io_uring
+ */
+static int connmgr_uring_setup(connmgr_reactor_t *reactor)
+{
+    int result = uring_probe_multishot();
+    if (result != 0)
+    {
+        reactor->ring.fd = -1;
+        return result;
+    }
+    result = uring_init(&reactor->ring, CONNMGR_URING_ENTRIES, 16 * CONNMGR_URING_ENTRIES);
+    if (result != 0)
+    {
+        reactor->ring.fd = -1;
+        return result;
+    }
+    result = uring_buffers_create(&reactor->ring, &reactor->buffers, 0, CONNMGR_URING_BUFFERS, CONNMGR_URING_BUFFER_SIZE);
+    if (result != 0)
+    {
+        uring_free(&reactor->ring);
+        return result;
+    }
+    return 0;
+}
+
+static void connmgr_uring_loop(connmgr_reactor_t *reactor)
+{
+    connmgr_uring_accept(reactor, reactor->server);
+    if (reactor->unix_server != NULL) connmgr_uring_accept(reactor, reactor->unix_server);
+    if (reactor->udp_sd != -1) connmgr_uring_poll_udp(reactor);
+
+    while(!connmgr_reactor_stop()) {
+
+        // one system call submits the re-armed requests and waits for the next completions
+        int result = uring_submit_and_wait(&reactor->ring, reactor->timeout_ms);
+        reactor->wake_us = connmgr_now_us();
+        // -EBUSY: the completions overflowed the queue, handling them below makes room and the next pass submits again
+        if (result < 0 && result != -EBUSY)
+        {
+            errno = -result;
+            perror("io_uring_enter()");
+            exit(EXIT_FAILURE);
+        }
+        connmgr_uring_complete(reactor);
+        connmgr_flush(reactor);     // everything read in this wake-up is published at once
 
+        remove_timeout_connections(reactor); // remove the sensor(s) that lost connection(timeout)
+        update_timeout_value(reactor);
+    }
+}
 
-        if( last_removed_flag==1 )
+/**
+ * Handles every completion that is ready, a completion carries the connection it belongs to
+ */
+static void connmgr_uring_complete(connmgr_reactor_t *reactor)
+{
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(&reactor->ring)) != NULL)
+    {
+        tcp_connection_t *connection = (tcp_connection_t *) (uintptr_t) cqe->user_data;
+        int result = cqe->res;
+        unsigned int flags = cqe->flags;
+        uring_cqe_seen(&reactor->ring);
+        if (connection == NULL) continue;   // a cancel request
+        if ((void *) connection == &reactor->udp_sd)
         {
-            printf("Server timeout\n");
-            if (tcp_close(&server->socket_information) != TCP_NO_ERROR) exit(EXIT_FAILURE);
-            printf("Server is shutting down\n");
-            connmgr_free();
+            if (result > 0) connmgr_udp_receive(reactor);
+            // the kernel ended the multishot poll, start a new one unless the listener is closed
+            if (!(flags & IORING_CQE_F_MORE) && reactor->udp_sd != -1) connmgr_uring_poll_udp(reactor);
+            continue;
+        }
+        if (connection != reactor->server && connection != reactor->unix_server)
+        {
+            connmgr_uring_received(connection, result, flags);
+            continue;
+        }
+        if (result >= 0)
+        {
+            tcpsock_t *socket;
+            tcp_connection_t *new_connection = NULL;
+            if (tcp_attach_connection(&socket, result) != TCP_NO_ERROR) close(result);
+            else if (tcp_set_opts(socket, &socket_opts) != TCP_NO_ERROR) tcp_close(&socket);
+            else new_connection = connmgr_add(reactor, connection, socket);
+            if (new_connection != NULL) connmgr_uring_recv(new_connection);
+        }
+        else if (result == -EINVAL && connection->socket_information != NULL)
+        {
+            // multishot accept passed the probe, so the listener itself is unusable: re-arming would fail again at once
+            errno = -result;
+            perror("accept()");
+            exit(EXIT_FAILURE);
+        }
+        else if (result != -EAGAIN && result != -EINTR && result != -ECANCELED && result != -EINVAL)
+        {
+            // the peer may have given up before we got to it, or we ran out of descriptors: keep serving the others
+            errno = -result;
+            perror("accept()");
+        }
+        // the kernel ended the multishot accept, start a new one unless the listener is closing
+        if (!(flags & IORING_CQE_F_MORE) && connection->socket_information != NULL) connmgr_uring_accept(reactor, connection);
+    }
+}
+
+/**
+ * Starts a multishot accept on 'listener', the server socket or the Unix socket listener of 'reactor'
+ * It posts a completion for every new connection
+ */
+static void connmgr_uring_accept(connmgr_reactor_t *reactor, tcp_connection_t *listener)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->ring);
+    if (sqe == NULL) exit(EXIT_FAILURE);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = (listener == reactor->unix_server) ? reactor->unix_sd : reactor->server_sd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = (uintptr_t) listener;
+}
+
+/**
+ * Starts a multishot recv on 'connection', every completion carries one of the provided buffers
+ * With limits the recv takes a single buffer and is re-armed as long as the connection is not paused
+ */
+static void connmgr_uring_recv(tcp_connection_t *connection)
+{
+    connmgr_reactor_t *reactor = connection->reactor;
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->ring);
+    if (sqe == NULL) exit(EXIT_FAILURE);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection->socket_information->sd;
+    // a multishot recv reads ahead into every free buffer, with limits a connection must not get further than one
+    sqe->ioprio = connmgr_limited ? 0 : IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = reactor->buffers.group;
+    // a SOCK_SEQPACKET completion then carries the full length of the message, so a cut one is noticed
+    if (connection->seqpacket) sqe->msg_flags = MSG_TRUNC;
+    sqe->user_data = (uintptr_t) connection;
+    connection->inflight = 1;
+}
+
+/**
+ * Handles a recv completion of 'connection': the readings are parsed straight out of the provided buffer
+ */
+static void connmgr_uring_received(tcp_connection_t *connection, int result, unsigned int flags)
+{
+    connmgr_reactor_t *reactor = connection->reactor;
+    if (!(flags & IORING_CQE_F_MORE)) connection->inflight = 0;
+    int malformed = 0;
+    if (result > 0 && (flags & IORING_CQE_F_BUFFER))
+    {
+        unsigned int id = flags >> IORING_CQE_BUFFER_SHIFT;
+        // a SOCK_SEQPACKET message must fit one buffer and hold only whole records or frames
+        if (connection->socket_information != NULL && connection->seqpacket && result > CONNMGR_URING_BUFFER_SIZE) malformed = 1;
+        else if (connection->socket_information != NULL) malformed = connmgr_parse_chunk(connection, uring_buffer(&reactor->buffers, id), result) != 0
+            || (connection->seqpacket && connection->recv_length != 0);
+        uring_buffer_recycle(&reactor->buffers, id);
+    }
+    if (malformed)
+    {
+        connmgr_malformed(connection);      // may free the record
+        return;
+    }
+    if (connection->socket_information == NULL)
+    {
+        // removed earlier, the record is only given back with the last completion of its recv
+        if (!connection->inflight)
+        {
+            reactor->closing--;
+            mempool_free(reactor->connection_pool, connection);
+        }
+        return;
+    }
+    if (result > 0 || result == -ENOBUFS || result == -ECANCELED)
+    {
+        // the kernel ends a multishot recv when it runs out of buffers, they were recycled above,
+        // or when a paused connection cancelled it
+        if (!connection->inflight && !connection->paused) connmgr_uring_recv(connection);
+        return;
+    }
+    connmgr_closed(connection);
+}
+
+/**
+ * Starts a multishot poll on the UDP socket, every completion means datagrams are waiting for recvmmsg()
+ */
+static void connmgr_uring_poll_udp(connmgr_reactor_t *reactor)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->ring);
+    if (sqe == NULL) exit(EXIT_FAILURE);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = reactor->udp_sd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = (uintptr_t) &reactor->udp_sd;
+}
+
+/**
+ * Opens the UDP socket of 'reactor' and points every message header at its own datagram buffer
+ */
+static void connmgr_udp_open(connmgr_reactor_t *reactor)
+{
+    reactor->udp_sd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (reactor->udp_sd == -1)
+    {
+        perror("socket()");
+        exit(EXIT_FAILURE);
+    }
+    // like the TCP sockets, the kernel spreads the senders over the reactors
+    int on = 1;
+    if (reactor_count > 1 && setsockopt(reactor->udp_sd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) exit(EXIT_FAILURE);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(reactor->udp_port);
+    if (bind(reactor->udp_sd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+    {
+        perror("bind()");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < CONNMGR_UDP_BATCH; i++)
+    {
+        reactor->udp_iov[i].iov_base = reactor->udp_buffer[i];
+        reactor->udp_iov[i].iov_len = CONNMGR_UDP_DATAGRAM;
+        memset(&reactor->udp_messages[i], 0, sizeof(struct mmsghdr));
+        reactor->udp_messages[i].msg_hdr.msg_iov = &reactor->udp_iov[i];
+        reactor->udp_messages[i].msg_hdr.msg_iovlen = 1;
+        reactor->udp_messages[i].msg_hdr.msg_name = &reactor->udp_addr[i];
+    }
+}
+
+/**
+ * Takes every waiting datagram off the UDP socket, CONNMGR_UDP_BATCH per recvmmsg() call
+ * The readings of one call are published together, a datagram is taken whole or not at all
+ */
+static void connmgr_udp_receive(connmgr_reactor_t *reactor)
+{
+    int received, accepted = 0;
+    do {
+        for (int i = 0; i < CONNMGR_UDP_BATCH; i++) reactor->udp_messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        reactor->syscalls++;
+        received = recvmmsg(reactor->udp_sd, reactor->udp_messages, CONNMGR_UDP_BATCH, MSG_DONTWAIT, NULL);
+        if (received < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("recvmmsg()");
             break;
         }
-        
-        // when the last connection has been removed -> wait for another TIMEOUT before exit  
-        if(sd_amount==0 && dpl_size(connection_list) == 1)  
+        for (int i = 0; i < received; i++)
+        {
+            struct mmsghdr *message = &reactor->udp_messages[i];
+            connmgr_udp_source_t *source = connmgr_udp_source(reactor, reactor->udp_addr[i].sin_addr.s_addr);
+            size_t length = message->msg_len;
+            source->datagrams++;
+            if (message->msg_hdr.msg_flags & MSG_TRUNC)
+            {
+                source->dropped++;
+                continue;
+            }
+            // every datagram tells its own protocol and holds whole v1 records or whole v2 frames
+            int protocol = connmgr_detect(reactor->udp_buffer[i], length);
+            // a datagram is taken whole or not at all: every v2 frame is checked before the first reading is staged
+            if (length == 0 || (protocol == CONNMGR_PROTOCOL_V1 && length % CONNMGR_RECORD_SIZE != 0)
+                || (protocol == CONNMGR_PROTOCOL_V2 && connmgr_check_frames(reactor->udp_buffer[i], length) != 0))
+            {
+                source->malformed++;
+                continue;
+            }
+            sensor_data_t data;
+            unsigned long readings = reactor->readings;
+            reactor->now_ms = connmgr_now_ms();
+            reactor->datagram = 1;
+            connmgr_decode(reactor, protocol, reactor->udp_buffer[i], length, &data);
+            reactor->datagram = 0;
+            source->readings += reactor->readings - readings;
+            accepted = 1;
+        }
+        connmgr_flush(reactor);
+    } while (received == CONNMGR_UDP_BATCH);
+    // datagrams that were taken keep the server alive like connections do, a stream of refused ones does not
+    if (accepted) atomic_store(&idle_since_ts, time(NULL));
+}
+
+/**
+ * Returns the counters of the source 'addr', the shared overflow counters when the table is full
+ */
+static connmgr_udp_source_t *connmgr_udp_source(connmgr_reactor_t *reactor, in_addr_t addr)
+{
+    unsigned int index = (ntohl(addr) * 2654435761u) % CONNMGR_UDP_SOURCES;
+    for (int probe = 0; probe < CONNMGR_UDP_SOURCES; probe++)
+    {
+        connmgr_udp_source_t *source = &reactor->udp_sources[(index + probe) % CONNMGR_UDP_SOURCES];
+        if (source->used && source->addr == addr) return source;
+        if (!source->used)
+        {
+            source->used = 1;
+            source->addr = addr;
+            return source;
+        }
+    }
+    return &reactor->udp_other;
+}
+
+/**
+ * Prints the counters of every source that sent datagrams to 'reactor'
+ */
+static void connmgr_udp_print(connmgr_reactor_t *reactor)
+{
+    for (int i = 0; i < CONNMGR_UDP_SOURCES; i++)
+    {
+        connmgr_udp_source_t *source = &reactor->udp_sources[i];
+        if (!source->used) continue;
+        struct in_addr addr = { .s_addr = source->addr };
+        printf("UDP source %s: %lu datagrams, %lu readings, %lu malformed, %lu dropped\n",
+               inet_ntoa(addr), source->datagrams, source->readings, source->malformed, source->dropped);
+    }
+    if (reactor->udp_other.datagrams > 0)
+        printf("UDP other sources (beyond the first %d): %lu datagrams, %lu readings, %lu malformed, %lu dropped\n",
+               CONNMGR_UDP_SOURCES, reactor->udp_other.datagrams, reactor->udp_other.readings, reactor->udp_other.malformed, reactor->udp_other.dropped);
+}
+
+/**
+ * Moves the readings of every reactor queue to the shared buffer until all reactors stopped
+ * The calling thread is the only producer of the shared buffer, so the reactors never contend for it
+ */
+static void connmgr_forward(void)
+{
+    sensor_data_t batch[SBUFFER_BATCH_SIZE];
+    int done = 0;
+    while (!done)
+    {
+        // read before draining, so the readings of the last ring are not left behind
+        done = (atomic_load(&reactors_done) == reactor_count);
+        if (!done)
+        {
+            // announce the nap, then look at the queues once more: a reactor that published before it saw the flag
+            // did not ring. Pairs with the fence in sbuffer_publish() and the exchange in connmgr_flush()
+            atomic_store(&forwarder_parked, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+            int pending = 0;
+            for (int i = 0; i < reactor_count && !pending; i++) pending = sbuffer_unread(reactors[i].queue, reactors[i].queue_reader) > 0;
+            uint64_t rings;
+            if (!pending && read(doorbell_fd, &rings, sizeof(rings)) == -1 && errno != EINTR)
+            {
+                perror("read()");
+                exit(EXIT_FAILURE);
+            }
+            atomic_store(&forwarder_parked, 0);
+        }
+        // one batch per reactor and pass, so a flooding reactor can't starve the others
+        int moved;
+        do {
+            moved = 0;
+            for (int i = 0; i < reactor_count; i++)
+            {
+                int amount = sbuffer_read_batch(reactors[i].queue, reactors[i].queue_reader, batch, SBUFFER_BATCH_SIZE);
+                if (amount <= 0) continue;
+                if (sbuffer_insert_batch(sbuffer, batch, amount) == SBUFFER_FAILURE) exit(EXIT_FAILURE);   // drops are counted by sbuffer
+                moved += amount;
+            }
+        } while (moved > 0);
+    }
+}
+
+/**
+ * Accepts every pending connection on 'listener', the server socket or the Unix socket listener of 'reactor',
+ * until accept() would block
+ */
+static void connmgr_accept(connmgr_reactor_t *reactor, tcp_connection_t *listener)
+{
+    // a sensor that sent half a record must never stall the reactor
+    tcp_sock_opts_t connection_opts = socket_opts;
+    connection_opts.nonblock = 1;
+    while(1)
+    {
+        tcpsock_t *socket;
+        reactor->syscalls++;
+        if (tcp_wait_for_connection_opts(listener->socket_information, &socket, &connection_opts) != TCP_NO_ERROR)
         {
-            asprintf(&log_message,"The last connection has been removed, wait for another TIMEOUT\n");
-            fifo_log(log_message);
-            last_removed_flag = 1;
-            timeout.tv_sec = TIMEOUT;
+            int error = errno;
+            if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) return;
+            // the peer may have given up before we got to it, or we ran out of descriptors: keep serving the others
+            perror("accept()");
+            return;
         }
+        tcp_connection_t *new_connection = connmgr_add(reactor, listener, socket);
+        if (new_connection == NULL) continue;
 
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = new_connection };
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, socket->sd, &event) == -1)
+        {
+            perror("epoll_ctl()");
+            connmgr_remove(new_connection);
+        }
+    }
+}
+
+/**
+ * Creates the record of a connection freshly accepted on 'listener', arms its timer and links it into the list
+ * \return the new connection, or NULL if no record could be allocated (the socket is closed then)
+ */
+static tcp_connection_t *connmgr_add(connmgr_reactor_t *reactor, tcp_connection_t *listener, tcpsock_t *socket)
+{
+    tcp_connection_t *new_connection = mempool_alloc(reactor->connection_pool);
+    if (new_connection == NULL)
+    {
+        tcp_close(&socket);
+        return NULL;
+    }
+    new_connection->socket_information = socket;
+    new_connection->reactor = reactor;
+    new_connection->announced = 0;
+    new_connection->inflight = 0;
+    new_connection->protocol = 0;
+    new_connection->seqpacket = (listener == reactor->unix_server && reactor->unix_type == SOCK_SEQPACKET);
+    memset(&new_connection->sensor_data, 0, sizeof(sensor_data_t));     // logged as sensor 0 until its first reading
+    new_connection->recv_length = 0;
+    new_connection->last_update_ts = time(NULL);
+    timer_wheel_timer_init(&new_connection->timer, new_connection);
+    timer_wheel_timer_init(&new_connection->throttle, new_connection);
+    new_connection->paused = 0;
+    new_connection->bucket.tokens = connection_limit.burst;
+    new_connection->bucket.updated_ms = connmgr_now_ms();
+    timer_wheel_arm(reactor->timeout_wheel, &new_connection->timer, connmgr_now_ms() + TIMEOUT * 1000);
+    // insert the new connection at the front of the list
+    new_connection->prev = NULL;
+    new_connection->next = reactor->connection_list;
+    if (reactor->connection_list != NULL) reactor->connection_list->prev = new_connection;
+    reactor->connection_list = new_connection;
+    reactor->connection_count++;
+    atomic_fetch_add(&active_connections, 1);
+    return new_connection;
+}
 
-        //print_all();
+/**
+ * Unlinks 'connection', stops watching and closes its socket and gives the record back to the pool
+ * With io_uring, a recv that is still armed is cancelled and the record waits for its last completion
+ */
+static void connmgr_remove(tcp_connection_t *connection)
+{
+    connmgr_reactor_t *reactor = connection->reactor;
+    // tcp_close() keeps the descriptor open when shutdown() fails, so never leave it behind in the epoll set
+    if (reactor->epoll_fd != -1) epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, connection->socket_information->sd, NULL);
+    timer_wheel_cancel(reactor->timeout_wheel, &connection->timer);
+    timer_wheel_cancel(reactor->timeout_wheel, &connection->throttle);
+    if (connection->prev != NULL) connection->prev->next = connection->next;
+    else reactor->connection_list = connection->next;
+    if (connection->next != NULL) connection->next->prev = connection->prev;
+    reactor->connection_count--;
+    tcp_close(&(connection->socket_information));
+    if (connection->inflight)
+    {
+        struct io_uring_sqe *sqe = uring_get_sqe(&reactor->ring);
+        if (sqe != NULL)
+        {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = (uintptr_t) connection;
+            sqe->user_data = 0;
+        }
+        reactor->closing++;
     }
+    else mempool_free(reactor->connection_pool, connection);
+    if (atomic_fetch_sub(&active_connections, 1) == 1)
+    {
+        char *message;
+        asprintf(&message,"The last connection has been removed, wait for another TIMEOUT\n");
+        fifo_log(message);
+        atomic_store(&idle_since_ts, time(NULL));
+    }
+}
 
-    fclose(file);
+/**
+ * Logs that the sensor on 'connection' hung up and removes it
+ */
+static void connmgr_closed(tcp_connection_t *connection)
+{
+    char *message;      // reactors log concurrently, so no shared log_message here
+    asprintf(&message,"The sensor node with %d has closed the connection.\n", connection->sensor_data.id);
+    fifo_log(message);
+    connmgr_remove(connection);
+}
 
+/**
+ * Logs that the sensor on 'connection' broke the protocol and removes it, the stream can't be resynchronised
+ */
+static void connmgr_malformed(tcp_connection_t *connection)
+{
+    char *message;
+    asprintf(&message,"The sensor node with %d sent a malformed frame, closing the connection.\n", connection->sensor_data.id);
+    fifo_log(message);
+    connmgr_remove(connection);
 }
 
-void read_data(tcp_connection_t * connection, int m) 
+/**
+ * Publishes the staged readings of 'reactor': straight into the shared buffer, or into its queue for the forwarder
+ */
+static void connmgr_flush(connmgr_reactor_t *reactor)
 {
-    int bytes, result;
-    // read sensor ID
-    bytes = sizeof(connection->sensor_data.id);
-    result = tcp_receive(connection->socket_information, (void *) &(connection->sensor_data.id), &bytes);
-    if(m) 
+    if (reactor->staged == 0) return;
+    uint64_t waited = connmgr_now_us() - reactor->wake_us;
+    reactor->publish_us[(waited < CONNMGR_PUBLISH_US) ? waited : CONNMGR_PUBLISH_US - 1] += reactor->staged;
+    if (reactor->queue == NULL)
     {
-        asprintf(&log_message,"A sebsor node with %d has opened a new connection.\n",connection->sensor_data.id);
-        fifo_log(log_message);
+        if (sbuffer_insert_batch(sbuffer, reactor->staging, reactor->staged) == SBUFFER_FAILURE) exit(EXIT_FAILURE);
     }
-    // read temperature
-    bytes = sizeof(connection->sensor_data.value);
-    result = tcp_receive(connection->socket_information, (void *) &(connection->sensor_data.value), &bytes);
-    // read timestamp
-    bytes = sizeof(connection->sensor_data.ts);
-    result = tcp_receive(connection->socket_information, (void *) &(connection->sensor_data.ts), &bytes);
-    if ((result == TCP_NO_ERROR) && bytes) {
-        printf("sensor id = %" PRIu16 " - temperature = %g - timestamp = %ld (connection size: %d)\n", 
-            connection->sensor_data.id, connection->sensor_data.value, (long int) connection->sensor_data.ts, dpl_size(connection_list)-1);
-        fprintf(file, "%d %f %ld\n", connection->sensor_data.id, connection->sensor_data.value, (long int) connection->sensor_data.ts);
-        if (sbuffer_insert(sbuffer,&(connection->sensor_data)) != SBUFFER_SUCCESS) exit(EXIT_FAILURE);
+    else
+    {
+        if (sbuffer_insert_batch(reactor->queue, reactor->staging, reactor->staged) != SBUFFER_SUCCESS) exit(EXIT_FAILURE);
+        // a busy forwarder finds the readings on its next pass, only a parked one costs a write(), and only once
+        if (atomic_load_explicit(&forwarder_parked, memory_order_relaxed) && atomic_exchange(&forwarder_parked, 0))
+        {
+            uint64_t ring = 1;
+            if (write(doorbell_fd, &ring, sizeof(ring)) == -1) perror("write()");
         }
-        if(datamgr_unread_amount(sbuffer)>0) pthread_cond_signal(&cond1);
-        if(sensor_db_unread_amount(sbuffer)>0) pthread_cond_signal(&cond_db);
+    }
+    reactor->staged = 0;
+}
 
+void read_data(tcp_connection_t * connection)
+{
+    // one recv() takes whatever the socket holds, behind the partial record left by the previous one
+    // a SOCK_SEQPACKET message holds whole records or frames, it is taken on its own so nothing is left behind
+    int bytes = CONNMGR_RECV_BUFFER - connection->recv_length;
+    connection->reactor->syscalls++;
+    int result = connection->seqpacket
+        ? tcp_receive_message(connection->socket_information, connection->recv_buffer, &bytes)
+        : tcp_receive_some(connection->socket_information, connection->recv_buffer + connection->recv_length, &bytes);
+    if (result == TCP_NO_ERROR && bytes == 0) return;    // woken up for nothing
+    if (result == TCP_MESSAGE_TRUNCATED)
+    {
+        connmgr_malformed(connection);
+        return;
+    }
+    if (result != TCP_NO_ERROR)
+    {
+        // the sensor hung up, a closed socket stays readable so drop it right away
+        connmgr_closed(connection);
+        return;
+    }
+    connection->recv_length += bytes;
 
+    // parse every complete record or frame, a partial one stays in the buffer for the next event
+    ssize_t used = connmgr_parse(connection, connection->recv_buffer, connection->recv_length);
+    if (used < 0 || (connection->seqpacket && (size_t) used != connection->recv_length))
+    {
+        connmgr_malformed(connection);
+        return;
+    }
+    memmove(connection->recv_buffer, connection->recv_buffer + used, connection->recv_length - used);
+    connection->recv_length -= used;
 }
 
-void remove_timeout_connections (void)
+/**
+ * Stages every complete record or frame in 'data' and re-arms the timer of 'connection' if there was one
+ * The first bytes of a connection tell its protocol: a v2 frame header, or else a v1 record
+ * \return the amount of bytes used, a partial record or frame at the end is left alone, -1 if a frame is malformed
+ */
+static ssize_t connmgr_parse(tcp_connection_t *connection, const unsigned char *data, size_t length)
 {
-    // loop all connections to check if timeout
-    for(int i=1; i < dpl_size(connection_list); i++)
+    connmgr_reactor_t *reactor = connection->reactor;
+    if (connection->protocol == 0)
     {
-        tcp_connection_t *dummy = dpl_get_element_at_index(connection_list, i);
-        //printf("Sensor(id:%d) last income time = %ld\n", dummy->sensor_data.id, dummy->last_update_ts);
-        if( time(NULL)- dummy->sensor_data.ts >= TIMEOUT)
+        if (length < CONNMGR_V2_DETECT) return 0;
+        connection->protocol = connmgr_detect(data, length);
+    }
+    unsigned long readings = reactor->readings;
+    reactor->now_ms = connmgr_now_ms();
+    reactor->sensor_wait_ms = 0;
+    ssize_t used = connmgr_decode(reactor, connection->protocol, data, length, &connection->sensor_data);
+    if (used <= 0) return used;
+    if (!connection->announced && reactor->readings != readings)
+    {
+        char *message;
+        asprintf(&message,"A sebsor node with %d has opened a new connection.\n",connection->sensor_data.id);
+        fifo_log(message);
+        connection->announced = 1;
+    }
+    // the sensor is alive, push its deadline back
+    connection->last_update_ts = time(NULL);
+    timer_wheel_arm(reactor->timeout_wheel, &connection->timer, reactor->now_ms + TIMEOUT * 1000);
+    if (connmgr_limited)
+    {
+        uint64_t wait = connmgr_bucket_take(&connection->bucket, &connection_limit, reactor->now_ms, reactor->readings - readings);
+        // the pause is charged to whatever sets its length: the sensor that waits longest, or else the connection
+        int sensor_id = -1;
+        if (reactor->sensor_wait_ms > 0 && reactor->sensor_wait_ms >= wait)
+        {
+            wait = reactor->sensor_wait_ms;
+            sensor_id = reactor->sensor_wait_id;
+        }
+        if (wait > 0) connmgr_throttle(connection, reactor->now_ms + wait, sensor_id);
+    }
+    return used;
+}
+
+/**
+ * Returns the protocol of a stream or datagram that starts with 'data', at least CONNMGR_V2_DETECT bytes long
+ */
+static int connmgr_detect(const unsigned char *data, size_t length)
+{
+    if (length >= CONNMGR_V2_DETECT && data[0] == CONNMGR_V2_MAGIC0 && data[1] == CONNMGR_V2_MAGIC1 && data[2] == CONNMGR_V2_VERSION)
+        return CONNMGR_PROTOCOL_V2;
+    return CONNMGR_PROTOCOL_V1;
+}
+
+/**
+ * Stages every complete v1 record or v2 frame in 'data', '*last' is left holding the last reading
+ * \return the amount of bytes used, -1 if a frame is malformed
+ */
+static ssize_t connmgr_decode(connmgr_reactor_t *reactor, int protocol, const unsigned char *data, size_t length, sensor_data_t *last)
+{
+    size_t used = 0;
+    if (protocol == CONNMGR_PROTOCOL_V1)
+    {
+        for (; length - used >= CONNMGR_RECORD_SIZE; used += CONNMGR_RECORD_SIZE)
         {
-            asprintf(&log_message,"The sensor node with %d has closed the connection.\n", dummy->sensor_data.id);
-            fifo_log(log_message);
-            int dummy_sd;
-            if (tcp_get_sd(dummy->socket_information,&dummy_sd) != TCP_NO_ERROR) exit(EXIT_FAILURE); 
-            FD_CLR(dummy_sd , &sd_set_origin);
-            tcp_close(&(dummy->socket_information));
-            dpl_remove_at_index(connection_list, i, true);
+            const unsigned char *record = data + used;
+            memcpy(&last->id, record, sizeof(sensor_id_t));
+            memcpy(&last->value, record + sizeof(sensor_id_t), sizeof(sensor_value_t));
+            memcpy(&last->ts, record + sizeof(sensor_id_t) + sizeof(sensor_value_t), sizeof(sensor_ts_t));
+            connmgr_stage(reactor, last);
         }
+        return used;
+    }
+    while (1)
+    {
+        ssize_t frame = connmgr_decode_frame(reactor, data + used, length - used, last);
+        if (frame < 0) return -1;
+        if (frame == 0) return used;
+        used += frame;
+    }
+}
+
+/**
+ * Returns 0 if 'data' holds nothing but whole, well-formed v2 frames, -1 otherwise. Nothing is staged
+ */
+static int connmgr_check_frames(const unsigned char *data, size_t length)
+{
+    size_t used = 0;
+    while (used < length)
+    {
+        ssize_t frame = connmgr_decode_frame(NULL, data + used, length - used, NULL);
+        if (frame <= 0) return -1;
+        used += frame;
     }
+    return 0;
 }
 
-void update_timeout_value (void)
+/**
+ * Stages the readings of the v2 frame at the start of 'frame', once the whole frame checked out
+ * With a NULL 'reactor' the frame is only checked
+ * \return the size of the frame, 0 if it is not complete yet, -1 if it is malformed
+ */
+static ssize_t connmgr_decode_frame(connmgr_reactor_t *reactor, const unsigned char *frame, size_t length, sensor_data_t *last)
 {
-    // find the connection with smallest timeout value
-    // select() will not block could happen because of one connection timeout or server timeout
-    long earliest_timeout = time(NULL);
-    for(int i=1; i < dpl_size(connection_list); i++)  
+    if (length < CONNMGR_V2_HEADER) return 0;
+    if (frame[0] != CONNMGR_V2_MAGIC0 || frame[1] != CONNMGR_V2_MAGIC1 || frame[2] != CONNMGR_V2_VERSION) return -1;
+    unsigned int count = frame[3] | (frame[4] << 8);
+    size_t payload = frame[5] | (frame[6] << 8);
+    if (CONNMGR_V2_HEADER + payload > CONNMGR_RECV_BUFFER) return -1;    // would never fit the receive buffer
+    if (length < CONNMGR_V2_HEADER + payload) return 0;
+
+    // the first pass only checks, so a malformed frame publishes nothing
+    for (int pass = 0; pass < ((reactor != NULL) ? 2 : 1); pass++)
     {
-        tcp_connection_t* dummy = dpl_get_element_at_index(connection_list, i); 
-        if(dummy->last_update_ts <= earliest_timeout )
-        {   
-            earliest_timeout = dummy->last_update_ts;
+        const unsigned char *p = frame + CONNMGR_V2_HEADER;
+        const unsigned char *end = p + payload;
+        int64_t ts = 0;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            uint64_t id, delta, bits;
+            if (connmgr_varint(&p, end, &id) != 0 || id > UINT16_MAX) return -1;
+            if (end - p < (ptrdiff_t) sizeof(uint64_t)) return -1;
+            memcpy(&bits, p, sizeof(uint64_t));
+            p += sizeof(uint64_t);
+            if (connmgr_varint(&p, end, &delta) != 0) return -1;
+            ts += (int64_t) (delta >> 1) ^ -(int64_t) (delta & 1);     // zigzag, a sensor may send out of order
+            if (pass == 0) continue;
+            bits = le64toh(bits);
+            last->id = (sensor_id_t) id;
+            memcpy(&last->value, &bits, sizeof(sensor_value_t));
+            last->ts = (sensor_ts_t) ts;
+            connmgr_stage(reactor, last);
         }
+        if (p != end) return -1;
+    }
+    return CONNMGR_V2_HEADER + payload;
+}
+
+/**
+ * Reads the LEB128 varint at '*p' into '*value' and moves '*p' behind it
+ * \return 0 on success, -1 if the varint runs past 'end' or over 64 bits
+ */
+static int connmgr_varint(const unsigned char **p, const unsigned char *end, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7)
+    {
+        unsigned char byte = *(*p)++;
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return 0;
     }
-    timeout.tv_sec = TIMEOUT - (time(NULL) - earliest_timeout);
+    return -1;
+}
 
-    
+/**
+ * Stages 'data' for the next flush of 'reactor'
+ * Nothing is printed or written here, the capture thread records every reading from the shared buffer
+ */
+static void connmgr_stage(connmgr_reactor_t *reactor, const sensor_data_t *data)
+{
+    if (reactor->sensors != NULL && !connmgr_admit(reactor, data)) return;
+    reactor->staging[reactor->staged++] = *data;
+    reactor->readings++;
+    if (reactor->staged == SBUFFER_BATCH_SIZE) connmgr_flush(reactor);
 }
 
-void connmgr_free()
+/**
+ * Sets up the limits of the connections and the sensors from 'config', including the per-sensor overrides
+ */
+static void connmgr_limits_load(connmgr_config_t *config)
+{
+    connection_limit = config->connection_limit;
+    // a burst below one reading would never let anything through
+    if (connection_limit.burst < 1) connection_limit.burst = max(connection_limit.rate, 1);
+    connmgr_limit_t sensor_limit = config->sensor_limit;
+    if (sensor_limit.burst < 1) sensor_limit.burst = max(sensor_limit.rate, 1);
+    FILE *limits = (config->limits_file != NULL) ? fopen(config->limits_file, "r") : NULL;
+    connmgr_limited = (connection_limit.rate > 0 || sensor_limit.rate > 0 || limits != NULL);
+    // the tables of the sensors are only needed when a sensor can have a limit
+    if (sensor_limit.rate <= 0 && limits == NULL) return;
+
+    sensor_limits = malloc((UINT16_MAX + 1) * sizeof(connmgr_limit_t));
+    sensor_buckets = calloc(UINT16_MAX + 1, sizeof(_Atomic uint64_t));
+    if (sensor_limits == NULL || sensor_buckets == NULL) exit(EXIT_FAILURE);
+    for (int id = 0; id <= UINT16_MAX; id++) sensor_limits[id] = sensor_limit;
+    if (limits == NULL) return;
+    unsigned int id;
+    double rate, burst;
+    int overrides = 0;
+    while (fscanf(limits, "%u %lf %lf", &id, &rate, &burst) == 3)
+    {
+        if (id > UINT16_MAX) continue;
+        sensor_limits[id].rate = rate;
+        sensor_limits[id].burst = (burst < 1) ? max(rate, 1) : burst;
+        overrides++;
+    }
+    fclose(limits);
+    printf("%d sensor limits loaded from %s\n", overrides, config->limits_file);
+}
+
+/**
+ * Charges the bucket of the sensor of 'data' for one reading
+ * A reading from a connection is always admitted, the connection is paused afterwards if the sensor ran into debt.
+ * A reading from a datagram is only admitted if the sensor has a token left
+ * \return 1 if the reading is admitted, 0 if it is dropped
+ */
+static int connmgr_admit(connmgr_reactor_t *reactor, const sensor_data_t *data)
 {
-    dpl_free(&connection_list, true);
-    free(connection_list);
+    connmgr_sensor_t *sensor = &reactor->sensors[data->id];
+    const connmgr_limit_t *limit = &sensor_limits[data->id];
+    if (limit->rate <= 0)
+    {
+        sensor->readings++;
+        return 1;
+    }
+    uint64_t wait = connmgr_sensor_take(&sensor_buckets[data->id], limit, reactor->now_ms, reactor->datagram);
+    if (wait == UINT64_MAX)
+    {
+        sensor->dropped++;
+        return 0;
+    }
+    sensor->readings++;
+    if (wait > reactor->sensor_wait_ms)
+    {
+        reactor->sensor_wait_ms = wait;
+        reactor->sensor_wait_id = data->id;
+    }
+    return 1;
 }
 
-void print_all(void)
+/**
+ * Takes one token out of the bucket of a sensor, which every reactor charges at the same time
+ * The bucket is one atomic: the moment in microseconds at which it is full again. Every reading moves that moment
+ * 1/rate later, the bucket is empty when it lies 'burst' readings ahead of now and in debt beyond that.
+ * So the reactors share the limit without a lock
+ * \param strict 1 takes the token only if the bucket holds one (a datagram), 0 runs into debt (a connection)
+ * \return 0 if the bucket is within budget, otherwise the milliseconds until its debt is paid off,
+ * UINT64_MAX if 'strict' and the bucket is empty
+ */
+static uint64_t connmgr_sensor_take(_Atomic uint64_t *bucket, const connmgr_limit_t *limit, uint64_t now_ms, int strict)
 {
-    for(int i=0; i < dpl_size(connection_list); i++)
+    uint64_t now = now_ms * 1000;
+    double interval = 1000000.0 / limit->rate;
+    uint64_t burst = (uint64_t) (limit->burst * interval);
+    uint64_t full = atomic_load_explicit(bucket, memory_order_relaxed);
+    uint64_t next;
+    do {
+        // a bucket that was full already holds no more than 'burst': an idle sensor starts from now
+        next = ((full > now) ? full : now) + (uint64_t) interval;
+        if (strict && next - now > burst) return UINT64_MAX;
+    } while (!atomic_compare_exchange_weak_explicit(bucket, &full, next, memory_order_relaxed, memory_order_relaxed));
+    if (next - now <= burst) return 0;
+    return (next - now - burst) / 1000 + 1;
+}
+
+/**
+ * Adds the tokens 'bucket' earned since its last update, up to the burst of 'limit'
+ */
+static void connmgr_bucket_refill(connmgr_bucket_t *bucket, const connmgr_limit_t *limit, uint64_t now_ms)
+{
+    if (now_ms <= bucket->updated_ms) return;
+    bucket->tokens += (now_ms - bucket->updated_ms) * limit->rate / 1000.0;
+    if (bucket->tokens > limit->burst) bucket->tokens = limit->burst;
+    bucket->updated_ms = now_ms;
+}
+
+/**
+ * Takes 'amount' tokens out of 'bucket', running into debt if there are not enough
+ * \return 0 if the bucket is within budget, otherwise the milliseconds until its debt is paid off
+ */
+static uint64_t connmgr_bucket_take(connmgr_bucket_t *bucket, const connmgr_limit_t *limit, uint64_t now_ms, double amount)
+{
+    if (limit->rate <= 0) return 0;
+    connmgr_bucket_refill(bucket, limit, now_ms);
+    bucket->tokens -= amount;
+    if (bucket->tokens >= 0) return 0;
+    return (uint64_t) (-bucket->tokens * 1000 / limit->rate) + 1;
+}
+
+/**
+ * Stops reading 'connection' until 'resume_ms', the unread data stays in the kernel and TCP pushes back on the sensor
+ * A paused connection does not time out, its timeout starts again when it is resumed
+ * The pause counts against sensor 'sensor_id', or against the connection limit when it is -1
+ */
+static void connmgr_throttle(tcp_connection_t *connection, uint64_t resume_ms, int sensor_id)
+{
+    connmgr_reactor_t *reactor = connection->reactor;
+    timer_wheel_cancel(reactor->timeout_wheel, &connection->timer);
+    timer_wheel_arm(reactor->timeout_wheel, &connection->throttle, resume_ms);
+    if (connection->paused) return;
+    connection->paused = 1;
+    if (sensor_id >= 0 && reactor->sensors != NULL) reactor->sensors[sensor_id].over_limit++;
+    else if (sensor_id < 0) reactor->connection_pauses++;
+    if (reactor->epoll_fd != -1)
     {
-        tcp_connection_t *dummy = dpl_get_element_at_index(connection_list, i);
+        // removed rather than muted, epoll reports a hang-up even to a descriptor that asks for no events
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, connection->socket_information->sd, NULL) == -1) perror("epoll_ctl()");
+    }
+    else if (connection->inflight)
+    {
+        // the recv ends with -ECANCELED, connmgr_uring_received() leaves it alone while the connection is paused
+        struct io_uring_sqe *sqe = uring_get_sqe(&reactor->ring);
+        if (sqe == NULL) return;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = (uintptr_t) connection;
+        sqe->user_data = 0;
+    }
+}
+
+/**
+ * Starts reading a paused 'connection' again
+ */
+static void connmgr_resume(tcp_connection_t *connection)
+{
+    connmgr_reactor_t *reactor = connection->reactor;
+    connection->paused = 0;
+    timer_wheel_arm(reactor->timeout_wheel, &connection->timer, connmgr_now_ms() + TIMEOUT * 1000);
+    if (reactor->epoll_fd != -1)
+    {
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = connection };
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, connection->socket_information->sd, &event) == -1) perror("epoll_ctl()");
+    }
+    else if (!connection->inflight) connmgr_uring_recv(connection);
+}
+
+/**
+ * Parses a chunk of the stream of 'connection' that was received outside of its receive buffer
+ * Only a record or frame that is split over two chunks goes through the receive buffer
+ * \return 0 on success, -1 if a frame is malformed
+ */
+static int connmgr_parse_chunk(tcp_connection_t *connection, const unsigned char *data, size_t length)
+{
+    // top up the partial record or frame until it is complete, the rest is parsed in place
+    while (connection->recv_length > 0 && length > 0)
+    {
+        size_t copy = CONNMGR_RECV_BUFFER - connection->recv_length;
+        if (copy > length) copy = length;
+        memcpy(connection->recv_buffer + connection->recv_length, data, copy);
+        connection->recv_length += copy;
+        data += copy;
+        length -= copy;
+        ssize_t used = connmgr_parse(connection, connection->recv_buffer, connection->recv_length);
+        if (used < 0) return -1;
+        memmove(connection->recv_buffer, connection->recv_buffer + used, connection->recv_length - used);
+        connection->recv_length -= used;
+    }
+    if (length == 0) return 0;
+    ssize_t used = connmgr_parse(connection, data, length);
+    if (used < 0) return -1;
+    // a frame is never larger than the receive buffer, so the rest always fits
+    memcpy(connection->recv_buffer, data + used, length - used);
+    connection->recv_length = length - used;
+    return 0;
+}
+
+void remove_timeout_connections (connmgr_reactor_t *reactor)
+{
+    // only the connections whose timer expired are visited
+    timer_wheel_timer_t *timer;
+    while ((timer = timer_wheel_pop_expired(reactor->timeout_wheel, connmgr_now_ms())) != NULL)
+    {
+        tcp_connection_t *dummy = timer->data;
+        //printf("Sensor(id:%d) last income time = %ld\n", dummy->sensor_data.id, dummy->last_update_ts);
+        if (timer == &dummy->throttle) connmgr_resume(dummy);    // back within budget
+        else connmgr_closed(dummy);
+    }
+}
+
+void update_timeout_value (connmgr_reactor_t *reactor)
+{
+    // the loop has to wake up in time for the next wheel tick that expires a connection, or for the server timeout
+    if (reactor->connection_count > 0)
+    {
+        int64_t next = timer_wheel_next_timeout(reactor->timeout_wheel, connmgr_now_ms());
+        reactor->timeout_ms = (next < 0 || next > TIMEOUT * 1000) ? TIMEOUT * 1000 : (int) next;
+        return;
+    }
+    // an idle reactor still wakes up once a second, the server timeout depends on the connections of the others.
+    // While they hold connections the server can't time out, however long ago the last one was removed
+    long remaining = TIMEOUT - (time(NULL) - atomic_load(&idle_since_ts));
+    if (remaining > 1 && reactor_count > 1) remaining = 1;
+    if (remaining <= 0 && atomic_load(&active_connections) > 0) remaining = 1;
+    reactor->timeout_ms = remaining > 0 ? (int) remaining * 1000 : 0;
+}
+
+/**
+ * Closes every connection and the listening sockets of 'reactor' and frees its resources
+ */
+static void connmgr_reactor_free(connmgr_reactor_t *reactor)
+{
+    connmgr_flush(reactor);
+    while (reactor->connection_list != NULL) connmgr_remove(reactor->connection_list);
+    if (tcp_close(&reactor->server->socket_information) != TCP_NO_ERROR) exit(EXIT_FAILURE);
+    // closing the Unix socket listener also removes its path
+    if (reactor->unix_server != NULL && tcp_close(&reactor->unix_server->socket_information) != TCP_NO_ERROR) exit(EXIT_FAILURE);
+    if (reactor->ring.fd != -1)
+    {
+        // collect the last completions of the removed connections while they come quickly
+        for (int tries = 0; reactor->closing > 0 && tries < 10; tries++)
+        {
+            int result = uring_submit_and_wait(&reactor->ring, 100);
+            if (result < 0 && result != -EBUSY) break;
+            connmgr_uring_complete(reactor);
+        }
+        connmgr_flush(reactor);
+        reactor->syscalls += reactor->ring.enters;
+        // a recv that is still pending may write into the provided buffers until the ring is gone: close it first
+        uring_free(&reactor->ring);
+        uring_buffers_free(&reactor->ring, &reactor->buffers);
+    }
+    if (reactor->udp_sd != -1)
+    {
+        close(reactor->udp_sd);
+        reactor->udp_sd = -1;
+    }
+    timer_wheel_destroy(&reactor->timeout_wheel);
+    if (reactor->epoll_fd != -1)
+    {
+        close(reactor->epoll_fd);
+        reactor->epoll_fd = -1;
+    }
+    printf("Reactor (%s): %lu readings, %lu system calls (%.3f per reading)\n",
+           reactor->backend == CONNMGR_BACKEND_URING ? "io_uring" : "epoll", reactor->readings, reactor->syscalls,
+           reactor->readings > 0 ? (double) reactor->syscalls / reactor->readings : 0.0);
+    if (reactor->readings > 0)
+        printf("Reactor (%s): wake-up to publish p50 %lu us, p99 %lu us, max %s%lu us\n",
+               reactor->backend == CONNMGR_BACKEND_URING ? "io_uring" : "epoll", connmgr_publish_quantile(reactor, 0.5),
+               connmgr_publish_quantile(reactor, 0.99), reactor->publish_us[CONNMGR_PUBLISH_US - 1] > 0 ? ">= " : "",
+               connmgr_publish_quantile(reactor, 1));
+    connmgr_udp_print(reactor);
+    if (reactor->connection_pauses > 0) printf("Connections paused over their limit %lu times\n", reactor->connection_pauses);
+    if (reactor->sensors != NULL)
+    {
+        for (int id = 0; id <= UINT16_MAX; id++)
         {
-            printf("id: %"PRIu16", last update: %ld, value:%g, sd:%d, timeout: %ld, sd_amount: %d , on: %ld\n",dummy->sensor_data.id,dummy->last_update_ts,dummy->sensor_data.value, dummy->socket_information->sd, timeout.tv_sec, sd_amount, time(NULL));
+            connmgr_sensor_t *sensor = &reactor->sensors[id];
+            if (sensor->over_limit == 0 && sensor->dropped == 0) continue;
+            printf("Sensor %d: %lu readings, over its limit %lu times, %lu datagram readings dropped\n",
+                   id, sensor->readings, sensor->over_limit, sensor->dropped);
         }
+        free(reactor->sensors);
+        reactor->sensors = NULL;
+    }
+    mempool_stats_t stats;
+    mempool_get_stats(reactor->connection_pool, &stats);
+    printf("Connection pool: %zu live, %zu high water, %zu slabs\n", stats.live, stats.high_water, stats.slabs);
+    mempool_destroy(&reactor->connection_pool);
+}
+
+void connmgr_free()
+{
+    // the reactors cleaned up after themselves, only their queues are left
+    if (reactors == NULL) return;
+    for (int i = 0; i < reactor_count; i++)
+    {
+        if (reactors[i].queue == NULL) continue;
+        sbuffer_unregister_reader(reactors[i].queue, reactors[i].queue_reader);
+        sbuffer_free(&reactors[i].queue);
+    }
+    free(reactors);
+    reactors = NULL;
+    free(sensor_limits);
+    sensor_limits = NULL;
+    free(sensor_buckets);
+    sensor_buckets = NULL;
+    reactor_count = 0;
+    if (doorbell_fd != -1)
+    {
+        close(doorbell_fd);
+        doorbell_fd = -1;
+    }
+}
+
+void print_all(connmgr_reactor_t *reactor)
+{
+    for(tcp_connection_t *dummy = reactor->connection_list; dummy != NULL; dummy = dummy->next)
+    {
+        printf("id: %"PRIu16", last update: %ld, value:%g, sd:%d, timeout: %d, connections: %d , on: %ld\n",dummy->sensor_data.id,dummy->last_update_ts,dummy->sensor_data.value, dummy->socket_information->sd, reactor->timeout_ms, reactor->connection_count, time(NULL));
+    }
+}
+
+/**
+ * Monotonic time in microseconds, the clock of the wake-up to publish time
+ */
+static uint64_t connmgr_now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Returns the 'q' quantile of the wake-up to publish time of 'reactor' in microseconds, 1 gives the largest
+ */
+static unsigned long connmgr_publish_quantile(connmgr_reactor_t *reactor, double q)
+{
+    unsigned long total = 0, seen = 0;
+    for (int us = 0; us < CONNMGR_PUBLISH_US; us++) total += reactor->publish_us[us];
+    unsigned long rank = (unsigned long) (q * total);
+    if (rank == 0) rank = 1;
+    for (int us = 0; us < CONNMGR_PUBLISH_US; us++)
+    {
+        seen += reactor->publish_us[us];
+        if (seen >= rank) return us;
     }
-}
\ No newline at end of file
+    return CONNMGR_PUBLISH_US - 1;
+}
+
+/**
+ * Monotonic time in milliseconds, the clock of the timeout wheels
+ */
+static uint64_t connmgr_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
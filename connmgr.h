@@ -7,28 +7,126 @@
 #include <inttypes.h>
 #include "lib/tcpsock.h"
 #include "lib/dplist.h"
+#include "lib/timerwheel.h"
 #include "config.h"
 #ifndef TIMEOUT
 #define TIMEOUT 5
 #endif
 #define max(x,y) ((x) > (y) ? (x) : (y))
 
+/*
+ * Size of the receive buffer of every connection, a readable socket is drained with one recv() of up to this many bytes
+ */
+#ifndef CONNMGR_RECV_BUFFER
+#define CONNMGR_RECV_BUFFER 4096
+#endif
+
+/*
+ * Wire protocols, a connection's first bytes tell which one it speaks
+ */
+#define CONNMGR_PROTOCOL_V1 1
+#define CONNMGR_PROTOCOL_V2 2
+
+/*
+ * v1: one reading per record, the id, the value and the timestamp of a sensor_data_t packed back to back in host byte order
+ */
+#define CONNMGR_RECORD_SIZE (sizeof(sensor_id_t) + sizeof(sensor_value_t) + sizeof(sensor_ts_t))
+
+/*
+ * v2: frames of many readings, all fields little endian
+ *   header: magic 0xA5 0x5A, version 2, count (uint16), payload size in bytes (uint16)
+ *   payload: 'count' records of
+ *     id      varint (LEB128)
+ *     value   IEEE 754 double, 8 bytes
+ *     ts      zigzag varint, the difference to the timestamp of the previous record (to 0 for the first one)
+ * A whole frame must fit CONNMGR_RECV_BUFFER, a frame that breaks these rules closes the connection.
+ * A v1 stream is only mistaken for v2 if its first sensor id is 0x5AA5 and its first value byte is 2.
+ */
+#define CONNMGR_V2_MAGIC0   0xA5
+#define CONNMGR_V2_MAGIC1   0x5A
+#define CONNMGR_V2_VERSION  2
+#define CONNMGR_V2_HEADER   7
+#define CONNMGR_V2_DETECT   3           // bytes needed to tell v1 from v2
+
+/*
+ * Event loops the reactors can run on, io_uring falls back to epoll when the kernel does not offer it
+ */
+#define CONNMGR_BACKEND_EPOLL 0
+#define CONNMGR_BACKEND_URING 1
+
+/**
+ * A token bucket limit: 'rate' readings per second on average, up to 'burst' at once. A rate of 0 is no limit
+ */
+typedef struct {
+    double rate;
+    double burst;
+} connmgr_limit_t;
+
+/**
+ * The state of a token bucket, the tokens may go negative: a connection pays off that debt while it is not read
+ */
+typedef struct {
+    double tokens;
+    uint64_t updated_ms;
+} connmgr_bucket_t;
+
+/**
+ * Settings of the connection manager
+ */
+typedef struct {
+    int port;                       /**< the port the sensors connect to */
+    int reactors;                   /**< the amount of reactor threads, 1 or less runs a single reactor in the calling thread */
+    int backend;                    /**< CONNMGR_BACKEND_* every reactor runs on */
+    int udp_port;                   /**< the port of the UDP listener, 0 runs without one */
+    const char *unix_path;          /**< the path of a Unix socket listener next to the TCP port, NULL runs without one */
+    int unix_type;                  /**< SOCK_STREAM, or SOCK_SEQPACKET where every message holds whole records or v2 frames */
+    connmgr_limit_t connection_limit;   /**< readings every connection may send */
+    connmgr_limit_t sensor_limit;   /**< readings every sensor id may send, over all its connections and datagrams */
+    const char *limits_file;        /**< lines of "sensor_id rate burst" that override sensor_limit, NULL or missing: none */
+    tcp_sock_opts_t socket_opts;    /**< options of the listening sockets and the connections, reuseport and nonblock are set by connmgr */
+} connmgr_config_t;
+
+typedef struct connmgr_reactor connmgr_reactor_t;
+
 struct tcp_connection{
     sensor_data_t sensor_data;
     tcpsock_t* socket_information;
     time_t last_update_ts;
+    timer_wheel_timer_t timer;      /**< fires TIMEOUT seconds after the last reading */
+    connmgr_reactor_t *reactor;     /**< the reactor that accepted the connection and owns it */
+    int announced;                  /**< 1 once the first reading was logged as a new connection */
+    int protocol;                   /**< CONNMGR_PROTOCOL_*, 0 until the first bytes arrived */
+    int seqpacket;                  /**< 1 on a SOCK_SEQPACKET Unix socket, every message is read and parsed on its own */
+    connmgr_bucket_t bucket;        /**< charged for every reading, see connmgr_config_t.connection_limit */
+    timer_wheel_timer_t throttle;   /**< armed while the connection is over its limit, or its sensor's, and not read */
+    int paused;                     /**< 1 while throttled */
+    int inflight;                   /**< io_uring: a multishot recv is armed, the record is freed with its last completion */
+    size_t recv_length;             /**< bytes in recv_buffer, never a complete record or frame after read_data() */
+    unsigned char recv_buffer[CONNMGR_RECV_BUFFER];
+    struct tcp_connection *prev;    /**< neighbours in the list of open connections */
+    struct tcp_connection *next;
 };
 typedef struct tcp_connection tcp_connection_t;
 
-void connmgr_listen(int port);
+/**
+ * Runs the connection manager until the server timeout or until the gateway stops
+ * With more than one reactor, every reactor thread listens on its own SO_REUSEPORT socket and owns the connections
+ * the kernel hands it, the calling thread forwards their readings to the shared buffer
+ * Every reactor also takes the datagrams of the UDP listener, if there is one, and the first reactor accepts the
+ * sensors on the same host that connect to the Unix socket path, if there is one
+ * A connection that goes over its limit, or over the limit of a sensor it carries, is not read until it is back
+ * within budget, so TCP pushes back on the sensor. Datagrams over the limit of their sensor are dropped
+ * \param config the ports, the amount of reactors and the backend they run on
+ */
+void connmgr_listen(connmgr_config_t *config);
 void connmgr_free(void);
 void * element_copy(void * element);
 void element_free(void ** element);
 int element_compare(void * x, void * y);
-void read_data(tcp_connection_t * connection,int m);
-void remove_timeout_connections (void);
-void update_timeout_value (void);
-void print_all(void);
+void read_data(tcp_connection_t * connection);
+void remove_timeout_connections (connmgr_reactor_t *reactor);
+void update_timeout_value (connmgr_reactor_t *reactor);
+void print_all(connmgr_reactor_t *reactor);
 
 
 #endif  //CONNMGR_H_
\ No newline at end of file
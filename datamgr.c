@@ -2,115 +2,317 @@
 #include "datamgr.h"
 #include "lib/dplist.h"
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
 #include <pthread.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 #include "sbuffer.h"
+#include "lib/runavg.h"
+#include "lib/qsketch.h"
 
 
 extern int datamgr_read_amount;
 extern sbuffer_t *sbuffer;
-extern pthread_mutex_t datamgr_lock;
-extern pthread_cond_t datamgr_cond;
+extern int datamgr_reader;
 extern char* log_message;
 extern void fifo_log(char* log);
 
 
-typedef struct {
+RUNAVG_DEFINE(datamgr_avg, RUN_AVG_LENGTH)
+
+/*
+ * Kinds of running average a sensor can have, see parse_sensor_map()
+ */
+#define DATAMGR_AVG_FIXED   0       // the last RUN_AVG_LENGTH readings, the length is fixed at compile time
+#define DATAMGR_AVG_COUNT   1       // the last n readings, n set at run time
+#define DATAMGR_AVG_TIME    2       // the readings of the last n seconds, with their minimum and maximum
+#define DATAMGR_AVG_EWMA    3       // exponentially weighted, per reading or over time
+
+/**
+ * The aggregates of a room, updated by every reading of its sensors
+ * The sensors of a room may belong to different workers: a writer takes the room by making 'seq' odd and releases it
+ * by making it even again. A reader never waits, it copies the stats and retries if 'seq' changed meanwhile.
+ * Every room sits in its own cache line, so workers that update different rooms don't slow each other down
+ */
+typedef struct datamgr_room {
+    atomic_uint seq;
+    datamgr_room_stats_t stats;
+    struct element *sensors;    /**< the sensors of the room, linked through room_next */
+} datamgr_room_t;
+
+typedef struct element {
     sensor_id_t sensor_id;
     room_id_t room_id;
-    sensor_value_t sensor_data[RUN_AVG_LENGTH];
     sensor_ts_t last_modified;
-    unsigned char num_data;
-    sensor_value_t data_sum;
+    int avg_kind;               /**< DATAMGR_AVG_*, which member of avg is used */
+    union {
+        datamgr_avg_t fixed;
+        runavg_t count;
+        runavg_time_t time;
+        runavg_ewma_t ewma;
+    } avg;
     sensor_value_t avg_data;
+    qsketch_t sketch;           /**< every reading, for its quantiles */
+    datamgr_room_t *room;       /**< the room of the sensor */
+    struct element *room_next;  /**< the next sensor in the same room */
 } element_t;
 
+/**
+ * a shard owns the sensors with 'sensor_id % shard_count == index' and reads the shared buffer through its own reader,
+ * skipping the readings of the other shards, so the readings of one sensor are always handled in order by the same worker.
+ * Shard 0 is parsed by the thread that calls datamgr_parse_sensor_buffer() through datamgr_reader
+ */
+typedef struct {
+    int index;
+    int reader;                 /**< cursor of the worker on the shared buffer */
+    pthread_t thread;
+} datamgr_shard_t;
+
 void * element_copy(void * element);
 void element_free(void ** element);
 int element_compare(void * x, void * y);
 
+static void datamgr_parse_reading(sensor_data_t *data);
+static void datamgr_parse_shard(int index, sensor_data_t *batch, int amount);
+static void *datamgr_worker_main(void *arg);
+static inline element_t *datamgr_lookup(sensor_id_t sensor_id);
+static inline int datamgr_update_avg(element_t *sensor, sensor_data_t *data);
+static void datamgr_init_avg(element_t *sensor, const char *window);
+static int datamgr_room_sketch(room_id_t room_id, qsketch_t *sketch);
+static void datamgr_update_room(datamgr_room_t *room, sensor_data_t *data);
+
 dplist_t *sensor_dplist = NULL;
+element_t **sensor_index = NULL;    // indexed by sensor id, NULL for ids that are not in the map, read-only after parse_sensor_map()
+datamgr_room_t **room_index = NULL; // indexed by room id, NULL for rooms without sensors, read-only after parse_sensor_map()
+datamgr_shard_t *shards = NULL;
+int shard_count = 0;        // 0: every reading is parsed by the thread that calls datamgr_parse_sensor_buffer()
+size_t worker_min_batch = 1;        // a worker wakes up for this many unread readings ...
+int worker_max_delay_ms = -1;       // ... or after this long, -1 waits without deadline
+unsigned int datamgr_window = 0;    // 0: the running average is taken over RUN_AVG_LENGTH readings
+
+void datamgr_set_window(int length)
+{
+    datamgr_window = (length > 0 && length != RUN_AVG_LENGTH) ? (unsigned int) length : 0;
+}
 
 void parse_sensor_map(FILE *fp_sensor_map)
 {
     ERROR_HANDLER(fp_sensor_map == NULL, "Error openning streams - NULL\n");
     sensor_dplist = dpl_create(element_copy, element_free, element_compare);
-    char l_length[10];
+    // every id gets a slot, so a reading finds its sensor with one load, only the pages of the mapped ids are touched
+    sensor_index = calloc(UINT16_MAX + 1, sizeof(element_t *));
+    room_index = calloc(UINT16_MAX + 1, sizeof(datamgr_room_t *));
+    ERROR_HANDLER(sensor_index == NULL || room_index == NULL, "Memory allocation failed\n");
+    char l_length[64];
+    char window[32];
     unsigned char map_index = 0;
     while(fgets(l_length, sizeof(l_length), fp_sensor_map) != NULL)
     {
         element_t *map = NULL;
         map = calloc(1,sizeof(element_t));
-        map->num_data = 0;
-        map->data_sum = 0;
-        sscanf(l_length, "%hu%hu", &(map->room_id), &(map->sensor_id));
+        ERROR_HANDLER(map == NULL, "Memory allocation failed\n");
+        int fields = sscanf(l_length, "%hu%hu%31s", &(map->room_id), &(map->sensor_id), window);
+        datamgr_init_avg(map, (fields == 3) ? window : NULL);
+        qsketch_init(&map->sketch);
         dpl_insert_at_index(sensor_dplist,map,map_index,false);
         map_index++;
+        if(sensor_index[map->sensor_id] == NULL)    // the first line of an id wins
+        {
+            sensor_index[map->sensor_id] = map;
+            if(room_index[map->room_id] == NULL)
+            {
+                // a whole number of cache lines, aligned to one
+                size_t size = (sizeof(datamgr_room_t) + DATAMGR_CACHE_LINE - 1) / DATAMGR_CACHE_LINE * DATAMGR_CACHE_LINE;
+                datamgr_room_t *room = aligned_alloc(DATAMGR_CACHE_LINE, size);
+                ERROR_HANDLER(room == NULL, "Memory allocation failed\n");
+                memset(room, 0, size);
+                atomic_init(&room->seq, 0);
+                room->stats.room_id = map->room_id;
+                room_index[map->room_id] = room;
+            }
+            map->room = room_index[map->room_id];
+            map->room_next = map->room->sensors;
+            map->room->sensors = map;
+            map->room->stats.sensors++;
+        }
     }
 }
 
-void datamgr_parse_sensor_buffer()
+/**
+ * Returns the sensor with id 'sensor_id', or NULL if it is not in the map
+ */
+static inline element_t *datamgr_lookup(sensor_id_t sensor_id)
 {
-    datamgr_read_amount++;
-    int found = 0;      // indicate if the id of data can be found in the sensor list
-    sensor_data_t *data = malloc(sizeof(sensor_data_t));
-    if(datamgr_first_to_read(sbuffer,data)!=1) printf("data manager read fail\n");
-    element_t *sensor = NULL;
-    for(int i=0; i<dpl_size(sensor_dplist); i++)
+    return (sensor_index != NULL) ? sensor_index[sensor_id] : NULL;
+}
+
+/**
+ * Sets up the running average of 'sensor' as 'window' of its map line asks, see parse_sensor_map()
+ * Without a window, the length of datamgr_set_window() applies
+ */
+static void datamgr_init_avg(element_t *sensor, const char *window)
+{
+    char *end;
+    int result = -1;
+    if(window == NULL)
     {
-        sensor = dpl_get_element_at_index(sensor_dplist, i);
-        if(sensor->sensor_id == data->id)
-        {
-            found = 1;
-            break;
-        } 
+        sensor->avg_kind = (datamgr_window > 0) ? DATAMGR_AVG_COUNT : DATAMGR_AVG_FIXED;
+        result = 0;
+        if(datamgr_window > 0) result = runavg_init(&sensor->avg.count, datamgr_window);
+        else datamgr_avg_init(&sensor->avg.fixed);
+    }
+    else if(strncmp(window, "ewma:", strlen("ewma:")) == 0)
+    {
+        // a weight, or a time constant in seconds
+        const char *amount = window + strlen("ewma:");
+        sensor->avg_kind = DATAMGR_AVG_EWMA;
+        double value = strtod(amount, &end);
+        if(end == amount || !isfinite(value)) result = -1;
+        else if(strcmp(end, "s") == 0) result = (value > 0) ? runavg_ewma_init(&sensor->avg.ewma, 0, value) : -1;
+        else if(*end == '\0') result = runavg_ewma_init(&sensor->avg.ewma, value, 0);
     }
-    if(found == 1)   // the sensor is inside the sensor list, read in the sensor data.
+    else if(isdigit((unsigned char) window[0]))
     {
-       sensor->last_modified = data->ts;
-        if(sensor->num_data<RUN_AVG_LENGTH-1)
+        // a whole number of readings, or of seconds; "1.5", "10x" or "3e2" are refused, not cut short
+        errno = 0;
+        long amount = strtol(window, &end, 10);
+        if(errno == ERANGE || amount < 1 || amount > UINT_MAX) result = -1;
+        else if(strcmp(end, "s") == 0)
         {
-        sensor->avg_data = 0;
-        sensor->sensor_data[sensor->num_data] = data->value;
-        sensor->num_data++;
-        sensor->data_sum = sensor->data_sum + data->value;
-        } else {
-        if(sensor->num_data==RUN_AVG_LENGTH-1)
+            sensor->avg_kind = DATAMGR_AVG_TIME;
+            result = runavg_time_init(&sensor->avg.time, (time_t) amount);
+        }
+        else if(*end == '\0')
         {
-            sensor->num_data++;
-            sensor->sensor_data[sensor->num_data] = data->value;
-            sensor->data_sum = sensor->data_sum + data->value;
-            sensor->avg_data = sensor->data_sum/RUN_AVG_LENGTH;
-        } 
-        else {
-            sensor->data_sum = sensor->data_sum - sensor->sensor_data[0] + data->value;
-            for(int i=0; i<RUN_AVG_LENGTH-1; i++)
-            {
-                sensor->sensor_data[i] = sensor->sensor_data[i+1];
-            }
-            sensor->sensor_data[RUN_AVG_LENGTH-1] = data->value;
-            sensor->avg_data = sensor->data_sum/RUN_AVG_LENGTH;
+            sensor->avg_kind = DATAMGR_AVG_COUNT;
+            result = runavg_init(&sensor->avg.count, (unsigned int) amount);
         }
+    }
+    ERROR_HANDLER(result != 0, "Invalid window in the sensor map\n");
+}
 
-        if(sensor->avg_data<SET_MIN_TEMP)
+/**
+ * Adds the reading 'data' to the running average of 'sensor'
+ * \return 1 once the window is full and avg_data holds its average, 0 before (avg_data is 0 then)
+ */
+static inline int datamgr_update_avg(element_t *sensor, sensor_data_t *data)
+{
+    switch(sensor->avg_kind)
+    {
+        case DATAMGR_AVG_COUNT:
+            sensor->avg_data = runavg_push(&sensor->avg.count, data->value);
+            return runavg_full(&sensor->avg.count);
+        case DATAMGR_AVG_TIME:
+            sensor->avg_data = runavg_time_push(&sensor->avg.time, data->ts, data->value);
+            return runavg_time_full(&sensor->avg.time);
+        case DATAMGR_AVG_EWMA:
+            sensor->avg_data = runavg_ewma_push(&sensor->avg.ewma, data->ts, data->value);
+            return 1;
+        default:
+            sensor->avg_data = datamgr_avg_push(&sensor->avg.fixed, data->value);
+            return datamgr_avg_full(&sensor->avg.fixed);
+    }
+}
+
+void datamgr_parse_sensor_buffer()
+{
+    // move a whole batch per cursor update instead of one reading per round-trip
+    sensor_data_t batch[SBUFFER_BATCH_SIZE];
+    int amount = sbuffer_read_batch(sbuffer, datamgr_reader, batch, SBUFFER_BATCH_SIZE);
+    if(amount < 0)
+    {
+        printf("data manager read fail\n");
+        return;
+    }
+    datamgr_read_amount += amount;
+    datamgr_parse_shard(0, batch, amount);
+}
+
+static void datamgr_parse_shard(int index, sensor_data_t *batch, int amount)
+{
+    for(int i=0; i<amount; i++)
+    {
+        if(shard_count == 0 || batch[i].id % shard_count == index) datamgr_parse_reading(&batch[i]);
+    }
+}
+
+void datamgr_register_workers(int workers)
+{
+    if(workers <= 1) return;
+    shards = calloc(workers, sizeof(datamgr_shard_t));
+    ERROR_HANDLER(shards == NULL, "Memory allocation failed\n");
+    shard_count = workers;
+    shards[0].reader = datamgr_reader;
+    for(int i=1; i<shard_count; i++)
+    {
+        shards[i].index = i;
+        shards[i].reader = sbuffer_register_reader(sbuffer);
+        ERROR_HANDLER(shards[i].reader < 0, "Too many readers\n");
+    }
+}
+
+void datamgr_start_workers(size_t min_batch, int max_delay_ms)
+{
+    worker_min_batch = min_batch;
+    worker_max_delay_ms = max_delay_ms;
+    for(int i=1; i<shard_count; i++)
+    {
+        ERROR_HANDLER(pthread_create(&shards[i].thread, NULL, datamgr_worker_main, &shards[i]) != 0, "Cannot start worker\n");
+    }
+}
+
+static void *datamgr_worker_main(void *arg)
+{
+    datamgr_shard_t *shard = arg;
+    sensor_data_t batch[SBUFFER_BATCH_SIZE];
+    int result;
+    while((result = sbuffer_wait(sbuffer, shard->reader, worker_min_batch, worker_max_delay_ms)) != SBUFFER_CLOSED)
+    {
+        if(result == SBUFFER_NO_DATA) continue;
+        if(result == SBUFFER_EVICTED)
         {
-            asprintf(&log_message,"The sensor node with %hu reports it's too cold.(running avg temperature= %lf)\n",sensor->sensor_id,sensor->avg_data);
-            fifo_log(log_message);
+            printf("data manager worker %d evicted, %zu readings behind\n", shard->index, sbuffer_evicted_lag(sbuffer, shard->reader));
+            break;
         }
-        else if(sensor->avg_data>SET_MAX_TEMP)
+        if(result != SBUFFER_SUCCESS) break;
+        int amount = sbuffer_read_batch(sbuffer, shard->reader, batch, SBUFFER_BATCH_SIZE);
+        if(amount < 0) break;
+        datamgr_parse_shard(shard->index, batch, amount);
+    }
+    return NULL;
+}
+
+static void datamgr_parse_reading(sensor_data_t *data)
+{
+    char *message;      // workers log concurrently, so no shared log_message here
+    element_t *sensor = datamgr_lookup(data->id);
+    if(sensor != NULL)   // the sensor is inside the sensor list, read in the sensor data.
+    {
+        sensor->last_modified = data->ts;
+        qsketch_add(&sensor->sketch, data->value);
+        datamgr_update_room(sensor->room, data);
+        if(datamgr_update_avg(sensor, data))
         {
-            asprintf(&log_message,"The sensor node with %hu reports it's too hot.(running avg temperature= %lf)\n",sensor->sensor_id,sensor->avg_data);  
-            fifo_log(log_message);
-        }
-            
+            if(sensor->avg_data<SET_MIN_TEMP)
+            {
+                asprintf(&message,"The sensor node with %hu reports it's too cold.(running avg temperature= %lf)\n",sensor->sensor_id,sensor->avg_data);
+                fifo_log(message);
+            }
+            else if(sensor->avg_data>SET_MAX_TEMP)
+            {
+                asprintf(&message,"The sensor node with %hu reports it's too hot.(running avg temperature= %lf)\n",sensor->sensor_id,sensor->avg_data);
+                fifo_log(message);
+            }
         }
 
 
     } else {
-        asprintf(&log_message,"Received sensor data with invalid sensor node %d \n", data->id);
-        fifo_log(log_message);
+        asprintf(&message,"Received sensor data with invalid sensor node %d \n", data->id);
+        fifo_log(message);
     }
-    free(data);
 
 }
 
@@ -120,20 +322,7 @@ void datamgr_parse_sensor_buffer()
 
 void datamgr_parse_sensor_files(FILE *fp_sensor_map, FILE *fp_sensor_data)
 {
-    ERROR_HANDLER(fp_sensor_map == NULL, "Error openning streams - NULL\n");
-    sensor_dplist = dpl_create(element_copy, element_free, element_compare);
-    char l_length[10];
-    unsigned char map_index = 0;
-    while(fgets(l_length, sizeof(l_length), fp_sensor_map) != NULL)
-    {
-        element_t *map = NULL;
-        map = calloc(1,sizeof(element_t));
-        map->num_data = 0;
-        map->data_sum = 0;
-        sscanf(l_length, "%hu%hu", &(map->room_id), &(map->sensor_id));
-        dpl_insert_at_index(sensor_dplist,map,map_index,false);
-        map_index++;
-    }
+    parse_sensor_map(fp_sensor_map);
     while(!feof(fp_sensor_data)) 
     {
         sensor_data_t* data = NULL;
@@ -141,41 +330,17 @@ void datamgr_parse_sensor_files(FILE *fp_sensor_map, FILE *fp_sensor_data)
         fread(&(data->id),sizeof(sensor_id_t),1,fp_sensor_data);
         fread(&(data->value),sizeof(sensor_value_t),1,fp_sensor_data);
         fread(&(data->ts),sizeof(sensor_ts_t),1,fp_sensor_data);
-        element_t *sensor = NULL;
-        for(int i=0; i<dpl_size(sensor_dplist); i++)
+        element_t *sensor = datamgr_lookup(data->id);
+        if(sensor == NULL)
         {
-            sensor = dpl_get_element_at_index(sensor_dplist, i);
-            if(sensor->sensor_id == data->id)
-            {
-                break;
-            }
+            free(data);
+            continue;
         }
         sensor->last_modified = data->ts;
-        if(sensor->num_data<RUN_AVG_LENGTH-1)
+        qsketch_add(&sensor->sketch, data->value);
+        datamgr_update_room(sensor->room, data);
+        if(datamgr_update_avg(sensor, data))
         {
-            sensor->avg_data = 0;
-            sensor->sensor_data[sensor->num_data] = data->value;
-            sensor->num_data++;
-            sensor->data_sum = sensor->data_sum + data->value;
-        } 
-        else {
-            if(sensor->num_data==RUN_AVG_LENGTH-1)
-            {
-                sensor->num_data++;
-                sensor->sensor_data[sensor->num_data] = data->value;
-                sensor->data_sum = sensor->data_sum + data->value;
-                sensor->avg_data = sensor->data_sum/RUN_AVG_LENGTH;
-            } 
-            else {
-                sensor->data_sum = sensor->data_sum - sensor->sensor_data[0] + data->value;
-                for(int i=0; i<RUN_AVG_LENGTH-1; i++)
-                {
-                    sensor->sensor_data[i] = sensor->sensor_data[i+1];
-                }
-                sensor->sensor_data[RUN_AVG_LENGTH-1] = data->value;
-                sensor->avg_data = sensor->data_sum/RUN_AVG_LENGTH;
-            }
-
             if(sensor->avg_data<SET_MIN_TEMP)
             {
                 fprintf(stderr,"The temperature of sensor %hu in room %hu is too low. running average: %lf, lower than: %lf, timestamp: %ld\n",sensor->sensor_id,sensor->room_id,sensor->avg_data,(double)SET_MIN_TEMP,sensor->last_modified);
@@ -193,33 +358,121 @@ void datamgr_parse_sensor_files(FILE *fp_sensor_map, FILE *fp_sensor_data)
 
 void datamgr_free()
 {
+    // the workers drain the shared buffer once it is closed and stop
+    for(int i=1; i<shard_count; i++)
+    {
+        pthread_join(shards[i].thread, NULL);
+        sbuffer_unregister_reader(sbuffer, shards[i].reader);
+    }
+    free(shards);
+    shards = NULL;
+    shard_count = 0;
+    for(int room_id=0; room_id<=UINT16_MAX; room_id++)
+    {
+        qsketch_t room;
+        if(room_index == NULL || room_index[room_id] == NULL || datamgr_room_sketch(room_id, &room) == 0) continue;
+        datamgr_room_stats_t stats = datamgr_get_room_stats(room_id);
+        printf("Room %d: %" PRIu64 " readings, mean %.1f min %.1f max %.1f p50 %.1f p95 %.1f p99 %.1f\n", room_id,
+               stats.count, stats.mean, stats.min, stats.max,
+               qsketch_quantile(&room, 0.50), qsketch_quantile(&room, 0.95), qsketch_quantile(&room, 0.99));
+    }
+    for(int room_id=0; room_index != NULL && room_id<=UINT16_MAX; room_id++) free(room_index[room_id]);
+    free(sensor_index);
+    sensor_index = NULL;
+    free(room_index);
+    room_index = NULL;
     dpl_free(&sensor_dplist, true);
 }
 
 uint16_t datamgr_get_room_id(sensor_id_t sensor_id)
 {
-    element_t *sensor, *temp=malloc(sizeof(element_t));
-    temp->sensor_id = sensor_id;
-    sensor = dpl_get_element_at_index(sensor_dplist,dpl_get_index_of_element(sensor_dplist, temp));
-    free(temp);
+    element_t *sensor = datamgr_lookup(sensor_id);
     return (sensor != NULL) ? sensor->room_id : 0;
 }
 
 sensor_value_t datamgr_get_avg(sensor_id_t sensor_id)
 {
-    element_t *sensor, *temp=malloc(sizeof(element_t));
-    temp->sensor_id = sensor_id;
-    sensor = dpl_get_element_at_index(sensor_dplist,dpl_get_index_of_element(sensor_dplist, temp));
-    free(temp);
+    element_t *sensor = datamgr_lookup(sensor_id);
     return (sensor != NULL) ? sensor->avg_data : 0.0;
 }
 
+sensor_value_t datamgr_get_min(sensor_id_t sensor_id)
+{
+    element_t *sensor = datamgr_lookup(sensor_id);
+    return (sensor != NULL && sensor->avg_kind == DATAMGR_AVG_TIME) ? runavg_time_min(&sensor->avg.time) : 0.0;
+}
+
+sensor_value_t datamgr_get_max(sensor_id_t sensor_id)
+{
+    element_t *sensor = datamgr_lookup(sensor_id);
+    return (sensor != NULL && sensor->avg_kind == DATAMGR_AVG_TIME) ? runavg_time_max(&sensor->avg.time) : 0.0;
+}
+
+sensor_value_t datamgr_get_quantile(sensor_id_t sensor_id, double q)
+{
+    element_t *sensor = datamgr_lookup(sensor_id);
+    return (sensor != NULL) ? qsketch_quantile(&sensor->sketch, q) : 0.0;
+}
+
+sensor_value_t datamgr_get_room_quantile(room_id_t room_id, double q)
+{
+    qsketch_t room;
+    return (datamgr_room_sketch(room_id, &room) > 0) ? qsketch_quantile(&room, q) : 0.0;
+}
+
+/**
+ * Merges the sketches of every sensor in room 'room_id' into 'sketch'
+ * \return 1 if the room has readings, 0 if not, 'sketch' is left alone for an id that is not a room
+ */
+static int datamgr_room_sketch(room_id_t room_id, qsketch_t *sketch)
+{
+    // most of the ids are not rooms, don't clear a whole sketch for them
+    if(room_index == NULL || room_index[room_id] == NULL) return 0;
+    qsketch_init(sketch);
+    for(element_t *sensor = room_index[room_id]->sensors; sensor != NULL; sensor = sensor->room_next) qsketch_merge(sketch, &sensor->sketch);
+    return sketch->count > 0;
+}
+
+datamgr_room_stats_t datamgr_get_room_stats(room_id_t room_id)
+{
+    datamgr_room_stats_t stats = { .room_id = room_id };
+    datamgr_room_t *room = (room_index != NULL) ? room_index[room_id] : NULL;
+    if(room == NULL) return stats;
+    unsigned int before, after;
+    do {
+        before = atomic_load_explicit(&room->seq, memory_order_acquire);
+        if(before & 1) continue;    // a writer is busy
+        memcpy(&stats, &room->stats, sizeof(stats));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&room->seq, memory_order_relaxed);
+    } while((before & 1) || before != after);
+    return stats;
+}
+
+/**
+ * Adds the reading 'data' to the aggregates of 'room', the mean is updated without a running sum that could grow large
+ */
+static void datamgr_update_room(datamgr_room_t *room, sensor_data_t *data)
+{
+    unsigned int seq = atomic_load_explicit(&room->seq, memory_order_relaxed);
+    do {
+        while(seq & 1) seq = atomic_load_explicit(&room->seq, memory_order_relaxed);     // another worker has the room
+    } while(!atomic_compare_exchange_weak_explicit(&room->seq, &seq, seq + 1, memory_order_acquire, memory_order_relaxed));
+    atomic_thread_fence(memory_order_release);     // readers that see the new stats also see the odd sequence
+
+    datamgr_room_stats_t *stats = &room->stats;
+    stats->count++;
+    stats->mean += (data->value - stats->mean) / stats->count;
+    if(stats->count == 1 || data->value < stats->min) stats->min = data->value;
+    if(stats->count == 1 || data->value > stats->max) stats->max = data->value;
+    if(data->ts > stats->last_modified) stats->last_modified = data->ts;
+
+    atomic_store_explicit(&room->seq, seq + 2, memory_order_release);
+}
+
 time_t datamgr_get_last_modified(sensor_id_t sensor_id)
 {
-    element_t *sensor, *temp=malloc(sizeof(element_t));
-    temp->sensor_id = sensor_id;
-    sensor = dpl_get_element_at_index(sensor_dplist,dpl_get_index_of_element(sensor_dplist, temp));
-    free(temp);
+    element_t *sensor = datamgr_lookup(sensor_id);
     return (sensor != NULL) ? sensor->last_modified : 0;
 }
 
@@ -228,17 +481,37 @@ int datamgr_get_total_sensors()
     return (sensor_dplist != NULL) ? dpl_size(sensor_dplist) : -1;
 }
 
+/**
+ * Returns a copy of the 'size' bytes at 'memory'
+ */
+static void *datamgr_dup(const void *memory, size_t size)
+{
+    void *copy = malloc(size);
+    ERROR_HANDLER(copy == NULL, "Memory allocation failed\n");
+    return memcpy(copy, memory, size);
+}
+
 void * element_copy(void * element)
 {
     element_t *sensor = NULL;
     sensor = malloc(sizeof(element_t));
     *sensor = *(element_t *)element;
+    // the copy gets its own samples
+    if(sensor->avg_kind == DATAMGR_AVG_COUNT)
+        sensor->avg.count.samples = datamgr_dup(sensor->avg.count.samples, sensor->avg.count.length * sizeof(double));
+    else if(sensor->avg_kind == DATAMGR_AVG_TIME)
+    {
+        runavg_deque_t *deques[] = { &sensor->avg.time.samples, &sensor->avg.time.min, &sensor->avg.time.max };
+        for(int i=0; i<3; i++) deques[i]->items = datamgr_dup(deques[i]->items, deques[i]->capacity * sizeof(runavg_sample_t));
+    }
     return (void *) sensor;
 }
 
 void element_free(void ** element)
 {
     element_t *sensor = *element;
+    if(sensor->avg_kind == DATAMGR_AVG_COUNT) runavg_free(&sensor->avg.count);
+    else if(sensor->avg_kind == DATAMGR_AVG_TIME) runavg_time_free(&sensor->avg.time);
     free(sensor);
     sensor = NULL;
 }
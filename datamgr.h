@@ -13,6 +13,13 @@
 #define RUN_AVG_LENGTH 5
 #endif
 
+/*
+ * Size of a cache line, every room gets its own
+ */
+#ifndef DATAMGR_CACHE_LINE
+#define DATAMGR_CACHE_LINE 64
+#endif
+
 #ifndef SET_MAX_TEMP
 #error SET_MAX_TEMP not set
 #endif
@@ -22,6 +29,19 @@
 #endif
 
 
+/**
+ * The aggregates of every reading of the sensors in a room
+ */
+typedef struct {
+    room_id_t room_id;
+    int sensors;                    /**< sensors of the room in the map */
+    uint64_t count;                 /**< readings so far */
+    sensor_value_t mean;
+    sensor_value_t min;
+    sensor_value_t max;
+    sensor_ts_t last_modified;      /**< time of the newest reading */
+} datamgr_room_stats_t;
+
 /*
  * Use ERROR_HANDLER() for handling memory allocation problems, invalid sensor IDs, non-existing files, etc.
  */
@@ -33,8 +53,48 @@
                     } while(0)
 
 
+/**
+ * Reads the next batch of readings of the datamgr reader from the shared buffer and updates the running averages
+ * With workers registered, only the readings of the sensors with 'sensor_id % workers == 0' are parsed here
+ */
 void datamgr_parse_sensor_buffer();
 
+/**
+ * Shards the sensors over 'workers' workers, every worker owns the sensors with 'sensor_id % workers' equal to its index
+ * and parses their readings in order. Worker 0 is the caller of datamgr_parse_sensor_buffer(), every other worker reads
+ * the shared buffer through its own reader, registered here. With 1 or less workers, the caller parses every reading
+ * Call before the producer starts, so the workers see every reading
+ * \param workers the amount of workers
+ */
+void datamgr_register_workers(int workers);
+
+/**
+ * Starts the threads of the workers registered by datamgr_register_workers()
+ * Call after parse_sensor_map(), the workers stop once the shared buffer is closed and read, datamgr_free() joins them
+ * \param min_batch a worker wakes up once this many readings are unread ...
+ * \param max_delay_ms ... or after this many milliseconds, a negative value waits without deadline
+ */
+void datamgr_start_workers(size_t min_batch, int max_delay_ms);
+
+/**
+ * Sets the amount of readings the running average of every sensor is taken over, call before parse_sensor_map()
+ * 0 or RUN_AVG_LENGTH keeps the window of RUN_AVG_LENGTH readings that is fixed at compile time,
+ * any other length is allocated per sensor, a reading costs the same for every length
+ * \param length the window length in readings
+ */
+void datamgr_set_window(int length);
+
+/**
+ * Reads the sensors from the map, every line is "room_id sensor_id [window]" where the window of the running average is
+ *   n          the last n readings
+ *   ns         the readings of the last n seconds, whatever the rate of the sensor, datamgr_get_min/max() work on it
+ *   ewma:a     an exponentially weighted moving average, every reading moves it by 'a' (0 < a <= 1)
+ *   ewma:ns    the same, but a reading weighs by the time since the previous one, with a time constant of n seconds
+ * Without a window, the length of datamgr_set_window() applies. Every window costs O(1) per reading (amortized)
+ * A time window is full once it spans n seconds, an exponential average right from the first reading
+ * Use ERROR_HANDLER() if a window is not valid
+ * \param fp_sensor_map file pointer to the map file
+ */
 void parse_sensor_map(FILE *fp_sensor_map);
 
 /**
@@ -46,7 +106,7 @@ void parse_sensor_map(FILE *fp_sensor_map);
 void datamgr_parse_sensor_files(FILE *fp_sensor_map, FILE *fp_sensor_data);
 
 /**
- * This method should be called to clean up the datamgr, and to free all used memory. 
+ * This method should be called to clean up the datamgr, and to free all used memory. It prints the p50, p95 and p99 of every room first.
  * After this, any call to datamgr_get_room_id, datamgr_get_avg, datamgr_get_last_modified or datamgr_get_total_sensors will not return a valid result
  */
 void datamgr_free();
@@ -67,6 +127,45 @@ uint16_t datamgr_get_room_id(sensor_id_t sensor_id);
  */
 sensor_value_t datamgr_get_avg(sensor_id_t sensor_id);
 
+/**
+ * Gets the lowest reading of a certain sensor ID within its time window
+ * \param sensor_id the sensor id to look for
+ * \return the minimum, 0 if the sensor is invalid or has no time window
+ */
+sensor_value_t datamgr_get_min(sensor_id_t sensor_id);
+
+/**
+ * Gets the highest reading of a certain sensor ID within its time window
+ * \param sensor_id the sensor id to look for
+ * \return the maximum, 0 if the sensor is invalid or has no time window
+ */
+sensor_value_t datamgr_get_max(sensor_id_t sensor_id);
+
+/**
+ * Gets a quantile of every reading of a certain sensor ID so far, from a sketch of fixed size (see lib/qsketch.h)
+ * While readings arrive, the result may miss the ones that are being added
+ * \param sensor_id the sensor id to look for
+ * \param q the quantile between 0 and 1, e.g. 0.95 for p95
+ * \return the quantile, 0 if the sensor is invalid or has no readings yet
+ */
+sensor_value_t datamgr_get_quantile(sensor_id_t sensor_id, double q);
+
+/**
+ * Gets a quantile of every reading of the sensors in a certain room so far, by merging the sketches of its sensors
+ * \param room_id the room id to look for
+ * \param q the quantile between 0 and 1, e.g. 0.95 for p95
+ * \return the quantile, 0 if no sensor of the room has readings yet
+ */
+sensor_value_t datamgr_get_room_quantile(room_id_t room_id, double q);
+
+/**
+ * Gets the aggregates of a certain room, kept up to date by every reading of its sensors
+ * The snapshot is consistent: it holds the same readings in every field. Reading it never holds up the workers
+ * \param room_id the room id to look for
+ * \return the aggregates, with count and sensors 0 if the room has no sensors in the map
+ */
+datamgr_room_stats_t datamgr_get_room_stats(room_id_t room_id);
+
 /**
  * Returns the time of the last reading for a certain sensor ID
  * Use ERROR_HANDLER() if sensor_id is invalid
@@ -0,0 +1,139 @@
+/**
+ * \author Zeping Zhang
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "mempool.h"
+
+/**
+ * a free object stores the link to the next free object in its first bytes
+ */
+typedef struct mempool_object {
+    struct mempool_object *next;
+} mempool_object_t;
+
+/**
+ * slabs are chained so the pool can give them back to the heap
+ */
+typedef struct mempool_slab {
+    struct mempool_slab *next;
+} mempool_slab_t;
+
+#define SLAB_HEADER_SIZE ((sizeof(mempool_slab_t) + 15) & ~(size_t)15)
+
+struct mempool {
+    pthread_t owner;                                /**< the only thread that allocates */
+    size_t object_size;
+    size_t objects_per_slab;
+    mempool_object_t *free_list;                    /**< owner-only free list */
+    mempool_slab_t *slabs;                          /**< every slab of the pool */
+    _Atomic(mempool_object_t *) remote_list;        /**< objects freed by other threads, pushed lock-free */
+    atomic_size_t live;
+    atomic_size_t high_water;
+    atomic_size_t slab_count;
+    atomic_size_t remote_frees;
+};
+
+static int mempool_grow(mempool_t *pool);
+
+mempool_t *mempool_create(size_t object_size, size_t objects_per_slab)
+{
+    if (objects_per_slab == 0) return NULL;
+    mempool_t *pool = malloc(sizeof(mempool_t));
+    if (pool == NULL) return NULL;
+    if (object_size < sizeof(mempool_object_t)) object_size = sizeof(mempool_object_t);
+    // keep every object aligned like malloc would
+    pool->object_size = (object_size + 15) & ~(size_t)15;
+    pool->objects_per_slab = objects_per_slab;
+    pool->owner = pthread_self();
+    pool->free_list = NULL;
+    pool->slabs = NULL;
+    atomic_init(&pool->remote_list, NULL);
+    atomic_init(&pool->live, 0);
+    atomic_init(&pool->high_water, 0);
+    atomic_init(&pool->slab_count, 0);
+    atomic_init(&pool->remote_frees, 0);
+    return pool;
+}
+
+void mempool_destroy(mempool_t **pool)
+{
+    if (pool == NULL || *pool == NULL) return;
+    mempool_slab_t *slab = (*pool)->slabs;
+    while (slab != NULL)
+    {
+        mempool_slab_t *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    free(*pool);
+    *pool = NULL;
+}
+
+void *mempool_alloc(mempool_t *pool)
+{
+    if (pool == NULL) return NULL;
+    if (pool->free_list == NULL)
+    {
+        // take over everything other threads returned in one exchange, no ABA issue since we never pop one by one
+        pool->free_list = atomic_exchange_explicit(&pool->remote_list, NULL, memory_order_acquire);
+        if (pool->free_list == NULL && mempool_grow(pool) != 0) return NULL;
+    }
+    mempool_object_t *object = pool->free_list;
+    pool->free_list = object->next;
+
+    size_t live = atomic_fetch_add_explicit(&pool->live, 1, memory_order_relaxed) + 1;
+    if (live > atomic_load_explicit(&pool->high_water, memory_order_relaxed))
+        atomic_store_explicit(&pool->high_water, live, memory_order_relaxed);
+    return object;
+}
+
+void mempool_free(mempool_t *pool, void *object)
+{
+    if (pool == NULL || object == NULL) return;
+    mempool_object_t *o = object;
+    atomic_fetch_sub_explicit(&pool->live, 1, memory_order_relaxed);
+    if (pthread_equal(pthread_self(), pool->owner))
+    {
+        o->next = pool->free_list;
+        pool->free_list = o;
+        return;
+    }
+    // push on the return list, the owner picks it up on its next empty free list
+    o->next = atomic_load_explicit(&pool->remote_list, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&pool->remote_list, &o->next, o,
+                                                  memory_order_release, memory_order_relaxed));
+    atomic_fetch_add_explicit(&pool->remote_frees, 1, memory_order_relaxed);
+}
+
+void mempool_get_stats(mempool_t *pool, mempool_stats_t *stats)
+{
+    if (pool == NULL || stats == NULL) return;
+    stats->live = atomic_load_explicit(&pool->live, memory_order_relaxed);
+    stats->high_water = atomic_load_explicit(&pool->high_water, memory_order_relaxed);
+    stats->slabs = atomic_load_explicit(&pool->slab_count, memory_order_relaxed);
+    stats->remote_frees = atomic_load_explicit(&pool->remote_frees, memory_order_relaxed);
+}
+
+/**
+ * Allocates a new slab and threads all of its objects onto the owner free list
+ * \return 0 on success, -1 if memory allocation failed
+ */
+static int mempool_grow(mempool_t *pool)
+{
+    mempool_slab_t *slab = malloc(SLAB_HEADER_SIZE + pool->object_size * pool->objects_per_slab);
+    if (slab == NULL) return -1;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    char *first = (char *) slab + SLAB_HEADER_SIZE;
+    for (size_t i = pool->objects_per_slab; i > 0; i--)
+    {
+        mempool_object_t *o = (mempool_object_t *) (first + (i - 1) * pool->object_size);
+        o->next = pool->free_list;
+        pool->free_list = o;
+    }
+    atomic_fetch_add_explicit(&pool->slab_count, 1, memory_order_relaxed);
+    return 0;
+}
@@ -0,0 +1,62 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#ifndef _MEMPOOL_H_
+#define _MEMPOOL_H_
+
+#include <stddef.h>
+
+/**
+ * A pool of fixed-size objects carved out of slabs
+ * A pool is owned by the thread that created it: only the owner allocates, and frees by the owner go
+ * straight back to its free list without any atomic operation. Any other thread may free objects too,
+ * those land on a lock-free return list that the owner takes over in one step when its own list runs dry.
+ * Give every thread that allocates its own pool.
+ */
+typedef struct mempool mempool_t;
+
+/**
+ * Counters of a pool, see mempool_get_stats()
+ */
+typedef struct {
+    size_t live;            /**< objects handed out and not yet freed */
+    size_t high_water;      /**< highest value 'live' ever had */
+    size_t slabs;           /**< slabs allocated from the heap */
+    size_t remote_frees;    /**< objects returned by a thread other than the owner */
+} mempool_stats_t;
+
+/** Creates a new pool owned by the calling thread
+ * \param object_size the size of every object, rounded up to pointer alignment
+ * \param objects_per_slab the amount of objects that is allocated from the heap at once
+ * \return a pointer to the new pool, or NULL if memory allocation failed
+ */
+mempool_t *mempool_create(size_t object_size, size_t objects_per_slab);
+
+/** Frees all slabs of the pool, including objects that are still live, and sets '*pool' to NULL
+ * If 'pool' or '*pool' is NULL, nothing is done
+ * \param pool a double pointer to the pool
+ */
+void mempool_destroy(mempool_t **pool);
+
+/** Returns an object of the pool, only the owner thread may call this
+ * A new slab is allocated from the heap only when the free list and the return list are both empty
+ * \param pool a pointer to the pool
+ * \return a pointer to an uninitialized object, or NULL if memory allocation failed
+ */
+void *mempool_alloc(mempool_t *pool);
+
+/** Returns 'object' to the pool, any thread may call this
+ * If 'object' is NULL, nothing is done
+ * \param pool the pool 'object' was allocated from
+ * \param object a pointer returned by mempool_alloc()
+ */
+void mempool_free(mempool_t *pool, void *object);
+
+/** Copies the counters of the pool into '*stats', the copy is only exact when no other thread frees concurrently
+ * \param pool a pointer to the pool
+ * \param stats a pointer to pre-allocated mempool_stats_t space
+ */
+void mempool_get_stats(mempool_t *pool, mempool_stats_t *stats);
+
+#endif  //_MEMPOOL_H_
@@ -0,0 +1,44 @@
+/**
+ * \author Zeping Zhang
+ */
+#include <string.h>
+#include "qsketch.h"
+
+void qsketch_init(qsketch_t *sketch)
+{
+    memset(sketch, 0, sizeof(qsketch_t));
+}
+
+void qsketch_merge(qsketch_t *into, const qsketch_t *from)
+{
+    if (from->count == 0) return;
+    if (into->count == 0 || from->min < into->min) into->min = from->min;
+    if (into->count == 0 || from->max > into->max) into->max = from->max;
+    for (int i = 0; i < QSKETCH_BINS; i++) into->bins[i] += from->bins[i];
+    into->below += from->below;
+    into->above += from->above;
+    into->count += from->count;
+}
+
+double qsketch_quantile(const qsketch_t *sketch, double q)
+{
+    if (sketch->count == 0) return 0;
+    if (q <= 0) return sketch->min;
+    if (q >= 1) return sketch->max;
+    // the rank of the quantile among the readings, counted from 1
+    uint64_t rank = (uint64_t) (q * sketch->count) + 1;
+    if (rank > sketch->count) rank = sketch->count;
+    uint64_t seen = sketch->below;
+    if (rank <= seen) return sketch->min;
+    double width = (QSKETCH_MAX - QSKETCH_MIN) / QSKETCH_BINS;
+    for (int i = 0; i < QSKETCH_BINS; i++)
+    {
+        seen += sketch->bins[i];
+        if (rank > seen) continue;
+        double value = QSKETCH_MIN + (i + 0.5) * width;
+        if (value < sketch->min) value = sketch->min;
+        if (value > sketch->max) value = sketch->max;
+        return value;
+    }
+    return sketch->max;
+}
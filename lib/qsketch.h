@@ -0,0 +1,72 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#ifndef _QSKETCH_H_
+#define _QSKETCH_H_
+
+#include <stdint.h>
+
+/*
+ * The range a sketch resolves and the amount of bins it is split into, by default 0.1 degree over -40..85 degrees
+ * Readings outside the range are only counted, a quantile that falls among them is the smallest or largest reading
+ */
+#ifndef QSKETCH_MIN
+#define QSKETCH_MIN -40.0
+#endif
+
+#ifndef QSKETCH_MAX
+#define QSKETCH_MAX 85.0
+#endif
+
+#ifndef QSKETCH_BINS
+#define QSKETCH_BINS 1250
+#endif
+
+/**
+ * A quantile sketch of fixed size: a histogram of equally wide bins over [QSKETCH_MIN, QSKETCH_MAX)
+ * Adding a reading is one increment, two sketches merge by adding their bins, so the sketch of a group is the
+ * merge of the sketches of its members. A quantile is off by at most half a bin, plus the spread of the readings
+ * outside the range
+ */
+typedef struct {
+    uint32_t bins[QSKETCH_BINS];
+    uint32_t below;                 /**< readings under QSKETCH_MIN */
+    uint32_t above;                 /**< readings at or over QSKETCH_MAX */
+    uint64_t count;                 /**< every reading added */
+    double min;                     /**< the smallest and largest reading, exact */
+    double max;
+} qsketch_t;
+
+/** Empties 'sketch'
+ */
+void qsketch_init(qsketch_t *sketch);
+
+/** Adds 'value' to 'sketch', a NaN is left out
+ */
+static inline void qsketch_add(qsketch_t *sketch, double value)
+{
+    if (value != value) return;
+    if (sketch->count == 0 || value < sketch->min) sketch->min = value;
+    if (sketch->count == 0 || value > sketch->max) sketch->max = value;
+    sketch->count++;
+    if (value < QSKETCH_MIN) sketch->below++;
+    else if (value >= QSKETCH_MAX) sketch->above++;
+    else
+    {
+        int bin = (int) ((value - QSKETCH_MIN) * (QSKETCH_BINS / (QSKETCH_MAX - QSKETCH_MIN)));
+        sketch->bins[bin < QSKETCH_BINS ? bin : QSKETCH_BINS - 1]++;     // rounding may hit the end
+    }
+}
+
+/** Adds every reading of 'from' to 'into'
+ */
+void qsketch_merge(qsketch_t *into, const qsketch_t *from);
+
+/** Returns the 'q' quantile of the readings in 'sketch', e.g. 0.95 for p95
+ * \param q between 0 and 1
+ * \return the middle of the bin the quantile falls in, within the smallest and largest reading, 0 for an empty sketch
+ */
+double qsketch_quantile(const qsketch_t *sketch, double q);
+
+#endif  //_QSKETCH_H_
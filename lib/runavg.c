@@ -0,0 +1,211 @@
+/**
+ * \author Zeping Zhang
+ */
+#include <math.h>
+#include "runavg.h"
+
+/*
+ * Samples a time window has room for before its queues first grow, a power of two
+ */
+#ifndef RUNAVG_DEQUE_INITIAL
+#define RUNAVG_DEQUE_INITIAL 16
+#endif
+
+int runavg_init(runavg_t *avg, unsigned int length)
+{
+    memset(avg, 0, sizeof(runavg_t));
+    if (length == 0) return -1;
+    avg->samples = calloc(length, sizeof(double));
+    if (avg->samples == NULL) return -1;
+    avg->length = length;
+    return 0;
+}
+
+void runavg_free(runavg_t *avg)
+{
+    free(avg->samples);
+    avg->samples = NULL;
+    avg->length = 0;
+    avg->count = 0;
+}
+
+static int runavg_deque_init(runavg_deque_t *deque, unsigned int capacity);
+static int runavg_deque_reserve(runavg_deque_t *deque);
+static inline void runavg_deque_push_back(runavg_deque_t *deque, runavg_sample_t sample);
+static inline runavg_sample_t *runavg_deque_front(runavg_deque_t *deque);
+static inline runavg_sample_t *runavg_deque_back(runavg_deque_t *deque);
+static inline void runavg_deque_pop_front(runavg_deque_t *deque);
+static inline void runavg_deque_pop_back(runavg_deque_t *deque);
+
+int runavg_time_init(runavg_time_t *avg, time_t span)
+{
+    memset(avg, 0, sizeof(runavg_time_t));
+    if (span < 1) return -1;
+    avg->span = span;
+    if (runavg_deque_init(&avg->samples, RUNAVG_DEQUE_INITIAL) != 0 || runavg_deque_init(&avg->min, RUNAVG_DEQUE_INITIAL) != 0
+        || runavg_deque_init(&avg->max, RUNAVG_DEQUE_INITIAL) != 0)
+    {
+        runavg_time_free(avg);
+        return -1;
+    }
+    return 0;
+}
+
+void runavg_time_free(runavg_time_t *avg)
+{
+    free(avg->samples.items);
+    free(avg->min.items);
+    free(avg->max.items);
+    memset(avg, 0, sizeof(runavg_time_t));
+}
+
+double runavg_time_push(runavg_time_t *avg, time_t ts, double value)
+{
+    // when memory runs out the sample is left out before anything changed, the window carries on with the others
+    if (runavg_deque_reserve(&avg->samples) != 0 || runavg_deque_reserve(&avg->min) != 0 || runavg_deque_reserve(&avg->max) != 0)
+        return runavg_time_full(avg) ? avg->sum / avg->samples.count : 0;
+    if (!avg->started)
+    {
+        avg->first_ts = ts;
+        avg->last_ts = ts;
+        avg->started = 1;
+    }
+    if (ts < avg->last_ts) ts = avg->last_ts;     // the queues must stay in time order
+    avg->last_ts = ts;
+    runavg_sample_t sample = { .ts = ts, .value = value };
+
+    runavg_deque_push_back(&avg->samples, sample);
+    // a younger sample that is at least as small (large) outlives every older, larger (smaller) one
+    while (avg->min.count > 0 && runavg_deque_back(&avg->min)->value >= value) runavg_deque_pop_back(&avg->min);
+    while (avg->max.count > 0 && runavg_deque_back(&avg->max)->value <= value) runavg_deque_pop_back(&avg->max);
+    runavg_deque_push_back(&avg->min, sample);
+    runavg_deque_push_back(&avg->max, sample);
+    avg->sum += value;
+
+    time_t oldest = ts - avg->span;     // samples taken at or before this moment left the window
+    while (runavg_deque_front(&avg->samples)->ts <= oldest)
+    {
+        avg->sum -= runavg_deque_front(&avg->samples)->value;
+        runavg_deque_pop_front(&avg->samples);
+    }
+    while (avg->min.count > 0 && runavg_deque_front(&avg->min)->ts <= oldest) runavg_deque_pop_front(&avg->min);
+    while (avg->max.count > 0 && runavg_deque_front(&avg->max)->ts <= oldest) runavg_deque_pop_front(&avg->max);
+
+    // recompute the sum once per capacity worth of samples, its rounding errors would pile up otherwise
+    if (++avg->since_sum >= avg->samples.capacity)
+    {
+        avg->sum = 0;
+        for (unsigned int i = 0; i < avg->samples.count; i++)
+            avg->sum += avg->samples.items[(avg->samples.head + i) & (avg->samples.capacity - 1)].value;
+        avg->since_sum = 0;
+    }
+    return runavg_time_full(avg) ? avg->sum / avg->samples.count : 0;
+}
+
+int runavg_ewma_init(runavg_ewma_t *avg, double alpha, double tau)
+{
+    memset(avg, 0, sizeof(runavg_ewma_t));
+    if (tau > 0)
+    {
+        avg->tau = tau;
+        return 0;
+    }
+    if (!(alpha > 0 && alpha <= 1)) return -1;
+    avg->alpha = alpha;
+    return 0;
+}
+
+double runavg_ewma_push(runavg_ewma_t *avg, time_t ts, double value)
+{
+    if (avg->count++ == 0)
+    {
+        avg->value = value;
+        avg->base = value;
+        avg->weight = 1;
+        avg->bucket_ts = ts;
+        avg->bucket_sum = value;
+        avg->bucket_count = 1;
+        return avg->value;
+    }
+    if (avg->tau == 0)
+    {
+        avg->value += avg->alpha * (value - avg->value);
+        return avg->value;
+    }
+    if (ts > avg->bucket_ts)
+    {
+        // the previous second is final, the new one weighs by the time that passed since
+        avg->base = avg->value;
+        avg->weight = 1 - exp(-(double) (ts - avg->bucket_ts) / avg->tau);
+        avg->bucket_ts = ts;
+        avg->bucket_sum = 0;
+        avg->bucket_count = 0;
+    }
+    // a sample of an earlier second than the current one counts for the current one
+    avg->bucket_sum += value;
+    avg->bucket_count++;
+    avg->value = avg->base + avg->weight * (avg->bucket_sum / avg->bucket_count - avg->base);
+    return avg->value;
+}
+
+/**
+ * Allocates an empty queue of 'capacity' samples, a power of two
+ */
+static int runavg_deque_init(runavg_deque_t *deque, unsigned int capacity)
+{
+    deque->items = malloc(capacity * sizeof(runavg_sample_t));
+    if (deque->items == NULL) return -1;
+    deque->capacity = capacity;
+    deque->head = 0;
+    deque->count = 0;
+    return 0;
+}
+
+/**
+ * Makes room for one more sample, the ring is doubled and unrolled when it is full
+ * Returns 0 on success, -1 if the ring could not grow, it is left as it was then
+ */
+static int runavg_deque_reserve(runavg_deque_t *deque)
+{
+    if (deque->count < deque->capacity) return 0;
+    runavg_sample_t *items = malloc(2 * deque->capacity * sizeof(runavg_sample_t));
+    if (items == NULL) return -1;
+    unsigned int first = deque->capacity - deque->head;     // samples from the head to the end of the ring
+    memcpy(items, deque->items + deque->head, first * sizeof(runavg_sample_t));
+    memcpy(items + first, deque->items, deque->head * sizeof(runavg_sample_t));
+    free(deque->items);
+    deque->items = items;
+    deque->head = 0;
+    deque->capacity *= 2;
+    return 0;
+}
+
+/**
+ * Appends 'sample' to a queue that has room for it, see runavg_deque_reserve()
+ */
+static inline void runavg_deque_push_back(runavg_deque_t *deque, runavg_sample_t sample)
+{
+    deque->items[(deque->head + deque->count) & (deque->capacity - 1)] = sample;
+    deque->count++;
+}
+
+static inline runavg_sample_t *runavg_deque_front(runavg_deque_t *deque)
+{
+    return &deque->items[deque->head];
+}
+
+static inline runavg_sample_t *runavg_deque_back(runavg_deque_t *deque)
+{
+    return &deque->items[(deque->head + deque->count - 1) & (deque->capacity - 1)];
+}
+
+static inline void runavg_deque_pop_front(runavg_deque_t *deque)
+{
+    deque->head = (deque->head + 1) & (deque->capacity - 1);
+    deque->count--;
+}
+
+static inline void runavg_deque_pop_back(runavg_deque_t *deque)
+{
+    deque->count--;
+}
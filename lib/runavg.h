@@ -0,0 +1,213 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#ifndef _RUNAVG_H_
+#define _RUNAVG_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Running averages over the last 'length' samples. The samples sit in a ring, a new sample overwrites the oldest one
+ * and the sum is updated with the difference, so a sample costs the same whatever the window length.
+ * The sum is recomputed from the samples every time the ring wraps, so rounding errors can't pile up; that costs
+ * one pass over the window every 'length' samples, still constant per sample.
+ * The average is 0 until the window holds 'length' samples.
+ */
+
+/**
+ * Defines a running average over a window of 'length' samples, fixed at compile time:
+ *   name_t                                   the window, no allocation needed
+ *   void name_init(name_t *avg)              empties the window
+ *   double name_push(name_t *avg, double v)  adds 'v', drops the oldest sample of a full window, returns the average
+ *   int name_full(const name_t *avg)         1 once the window holds 'length' samples
+ * The compiler sees the length, so short windows get the wrap and the division without a variable
+ */
+#define RUNAVG_DEFINE(name, length)                                                 \
+    typedef struct {                                                                \
+        double samples[length];                                                     \
+        double sum;                                                                 \
+        unsigned int head;          /* slot of the next sample */                   \
+        unsigned int count;         /* samples in the window, up to length */       \
+    } name##_t;                                                                     \
+                                                                                    \
+    static inline void name##_init(name##_t *avg)                                   \
+    {                                                                               \
+        memset(avg, 0, sizeof(name##_t));                                           \
+    }                                                                               \
+                                                                                    \
+    static inline double name##_push(name##_t *avg, double value)                   \
+    {                                                                               \
+        if (avg->count < (length)) avg->count++;                                    \
+        else avg->sum -= avg->samples[avg->head];                                   \
+        avg->samples[avg->head] = value;                                            \
+        avg->sum += value;                                                          \
+        if (++avg->head == (length))                                                \
+        {                                                                           \
+            avg->head = 0;                                                          \
+            avg->sum = 0;                                                           \
+            for (unsigned int i = 0; i < (length); i++) avg->sum += avg->samples[i]; \
+        }                                                                           \
+        return (avg->count == (length)) ? avg->sum / (length) : 0;                  \
+    }                                                                               \
+                                                                                    \
+    static inline int name##_full(const name##_t *avg)                              \
+    {                                                                               \
+        return avg->count == (length);                                              \
+    }
+
+/**
+ * A running average over a window whose length is only known at run time, e.g. a large window of 1000 samples
+ */
+typedef struct {
+    double *samples;
+    unsigned int length;
+    double sum;
+    unsigned int head;              /**< slot of the next sample */
+    unsigned int count;             /**< samples in the window, up to length */
+} runavg_t;
+
+/** Allocates the samples of an empty window of 'length' samples
+ * \param avg a pointer to pre-allocated runavg_t space
+ * \param length the amount of samples the average is taken over, at least 1
+ * \return 0 on success, -1 if 'length' is 0 or the samples can't be allocated
+ */
+int runavg_init(runavg_t *avg, unsigned int length);
+
+/** Frees the samples of 'avg'
+ */
+void runavg_free(runavg_t *avg);
+
+/** Adds 'value' to the window, the oldest sample is dropped when the window is full
+ * \return the average of the window, 0 while it is not full
+ */
+static inline double runavg_push(runavg_t *avg, double value)
+{
+    if (avg->count < avg->length) avg->count++;
+    else avg->sum -= avg->samples[avg->head];
+    avg->samples[avg->head] = value;
+    avg->sum += value;
+    if (++avg->head == avg->length)
+    {
+        avg->head = 0;
+        avg->sum = 0;
+        for (unsigned int i = 0; i < avg->length; i++) avg->sum += avg->samples[i];
+    }
+    return (avg->count == avg->length) ? avg->sum / avg->length : 0;
+}
+
+/** Returns 1 once the window holds 'length' samples
+ */
+static inline int runavg_full(const runavg_t *avg)
+{
+    return avg->count == avg->length;
+}
+
+/**
+ * A reading and the time it was taken
+ */
+typedef struct {
+    time_t ts;
+    double value;
+} runavg_sample_t;
+
+/**
+ * A double ended queue of samples, kept in a ring that doubles when it is full
+ */
+typedef struct {
+    runavg_sample_t *items;
+    unsigned int capacity;
+    unsigned int head;              /**< slot of the oldest sample */
+    unsigned int count;
+} runavg_deque_t;
+
+/**
+ * A running average, minimum and maximum over the samples of the last 'span' seconds, whatever their rate
+ * Every sample enters and leaves the window once. The minimum and maximum come from monotonic queues: a sample
+ * that can never be the minimum again, because a smaller and younger one arrived, is dropped right away.
+ * That makes every sample cost O(1) amortized. A sample older than the newest one counts as taken at its time.
+ */
+typedef struct {
+    time_t span;
+    time_t first_ts;                /**< time of the first sample, the window is full once it is 'span' seconds old */
+    time_t last_ts;                 /**< time of the newest sample */
+    runavg_deque_t samples;         /**< every sample in the window, oldest first */
+    runavg_deque_t min;             /**< increasing values, the front is the minimum of the window */
+    runavg_deque_t max;             /**< decreasing values, the front is the maximum of the window */
+    double sum;
+    unsigned int since_sum;         /**< samples added since the sum was last recomputed */
+    int started;                    /**< 1 once the first sample arrived */
+} runavg_time_t;
+
+/** Sets up an empty window over the last 'span' seconds
+ * \param avg a pointer to pre-allocated runavg_time_t space
+ * \param span the length of the window in seconds, at least 1
+ * \return 0 on success, -1 if 'span' is below 1 or memory can't be allocated
+ */
+int runavg_time_init(runavg_time_t *avg, time_t span);
+
+/** Frees the samples of 'avg'
+ */
+void runavg_time_free(runavg_time_t *avg);
+
+/** Adds 'value' taken at 'ts' and drops the samples that are 'span' seconds older than the newest one
+ * \return the average of the window, 0 while it is not full
+ */
+double runavg_time_push(runavg_time_t *avg, time_t ts, double value);
+
+/** Returns 1 once the samples cover 'span' seconds
+ */
+static inline int runavg_time_full(const runavg_time_t *avg)
+{
+    return avg->samples.count > 0 && avg->last_ts - avg->first_ts >= avg->span;
+}
+
+/** Returns the smallest sample in the window, 0 if it is empty
+ */
+static inline double runavg_time_min(const runavg_time_t *avg)
+{
+    return (avg->min.count > 0) ? avg->min.items[avg->min.head].value : 0;
+}
+
+/** Returns the largest sample in the window, 0 if it is empty
+ */
+static inline double runavg_time_max(const runavg_time_t *avg)
+{
+    return (avg->max.count > 0) ? avg->max.items[avg->max.head].value : 0;
+}
+
+/**
+ * An exponentially weighted moving average, in one of two modes:
+ *   alpha   every sample moves the average by 'alpha' of its distance to it, whatever the time between them
+ *   tau     the weight of a sample decays with time, by e every 'tau' seconds, so a sensor that reports often
+ *           does not move the average faster than one that reports rarely. The samples of one second are
+ *           averaged first, their timestamps can't tell them apart
+ */
+typedef struct {
+    double alpha;                   /**< weight of every new sample, 0 in tau mode */
+    double tau;                     /**< time constant in seconds, 0 in alpha mode */
+    double value;                   /**< the current average */
+    unsigned long count;            /**< samples added so far */
+    double base;                    /**< tau mode: the average before the samples of the current second */
+    double weight;                  /**< tau mode: the weight of the current second against 'base' */
+    time_t bucket_ts;               /**< tau mode: the current second, and the sum and amount of its samples */
+    double bucket_sum;
+    unsigned int bucket_count;
+} runavg_ewma_t;
+
+/** Sets up an empty average, with a weight 'alpha' per sample if 'tau' is 0, else with time constant 'tau'
+ * \param avg a pointer to pre-allocated runavg_ewma_t space
+ * \param alpha the weight of a new sample, in (0, 1]
+ * \param tau the time constant in seconds, 0 to use 'alpha'
+ * \return 0 on success, -1 if the mode is not valid
+ */
+int runavg_ewma_init(runavg_ewma_t *avg, double alpha, double tau);
+
+/** Adds 'value' taken at 'ts'
+ * \return the average, the first sample is taken as it is
+ */
+double runavg_ewma_push(runavg_ewma_t *avg, time_t ts, double value);
+
+#endif  //_RUNAVG_H_
@@ -5,12 +5,18 @@
 #define _GNU_SOURCE
 
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <time.h>
 
 #include "tcpsock.h"
 
@@ -49,16 +55,32 @@
 
 
 static tcpsock_t *tcp_sock_create();
+static int tcp_set_option(int sd, int level, int name, int value);
+static int tcp_apply_opts(int sd, const tcp_sock_opts_t *opts, int listening, int family);
+static int tcp_set_peer(tcpsock_t *s, const struct sockaddr_storage *addr);
 
 int tcp_passive_open(tcpsock_t **sock, int port) {
+    return tcp_passive_open_opts(sock, port, NULL);
+}
+
+int tcp_passive_open_reuseport(tcpsock_t **sock, int port) {
+    tcp_sock_opts_t opts = { .reuseport = 1 };
+    return tcp_passive_open_opts(sock, port, &opts);
+}
+
+int tcp_passive_open_opts(tcpsock_t **sock, int port, const tcp_sock_opts_t *opts) {
     int result;
     struct sockaddr_in addr;
+    tcp_sock_opts_t none = { 0 };
+    if (opts == NULL) opts = &none;
     TCP_ERR_HANDLER(((port < MIN_PORT) || (port > MAX_PORT)), return TCP_ADDRESS_ERROR);
     tcpsock_t *s = tcp_sock_create();
     TCP_ERR_HANDLER(s == NULL, return TCP_MEMORY_ERROR);
-    s->sd = socket(PROTOCOLFAMILY, TYPE, PROTOCOL);
+    s->sd = socket(PROTOCOLFAMILY, TYPE | (opts->nonblock ? SOCK_NONBLOCK : 0), PROTOCOL);
     TCP_DEBUG_PRINTF(s->sd < 0, "Socket() failed with errno = %d [%s]", errno, strerror(errno));
     TCP_ERR_HANDLER(s->sd < 0, free(s);return TCP_SOCKOP_ERROR);
+    result = tcp_apply_opts(s->sd, opts, 1, AF_INET);
+    TCP_ERR_HANDLER(result != 0, close(s->sd);free(s);return TCP_SOCKOP_ERROR);
     // Construct the server address structure
     memset(&addr, 0, sizeof(struct sockaddr_in));
     addr.sin_family = PROTOCOLFAMILY;
@@ -66,10 +88,10 @@ int tcp_passive_open(tcpsock_t **sock, int port) {
     addr.sin_port = htons(port);
     result = bind(s->sd, (struct sockaddr *) &addr, sizeof(addr));
     TCP_DEBUG_PRINTF(result == -1, "Bind() failed with errno = %d [%s]", errno, strerror(errno));
-    TCP_ERR_HANDLER(result != 0, free(s);return TCP_SOCKOP_ERROR);
-    result = listen(s->sd, MAX_PENDING);
+    TCP_ERR_HANDLER(result != 0, close(s->sd);free(s);return TCP_SOCKOP_ERROR);
+    result = listen(s->sd, opts->backlog > 0 ? opts->backlog : MAX_PENDING);
     TCP_DEBUG_PRINTF(result == -1, "Listen() failed with errno = %d [%s]", errno, strerror(errno));
-    TCP_ERR_HANDLER(result != 0, free(s);return TCP_SOCKOP_ERROR);
+    TCP_ERR_HANDLER(result != 0, close(s->sd);free(s);return TCP_SOCKOP_ERROR);
     s->ip_addr = NULL; // address set to INADDR_ANY - not a specific IP address
     s->port = port;
     s->cookie = MAGIC_COOKIE;
@@ -77,6 +99,69 @@ int tcp_passive_open(tcpsock_t **sock, int port) {
     return TCP_NO_ERROR;
 }
 
+int tcp_passive_open_unix(tcpsock_t **sock, const char *path, int type, const tcp_sock_opts_t *opts) {
+    int result;
+    struct sockaddr_un addr;
+    tcp_sock_opts_t none = { 0 };
+    if (opts == NULL) opts = &none;
+    TCP_ERR_HANDLER(path == NULL || strlen(path) >= sizeof(addr.sun_path), return TCP_ADDRESS_ERROR);
+    TCP_ERR_HANDLER(type != SOCK_STREAM && type != SOCK_SEQPACKET, return TCP_ADDRESS_ERROR);
+    // a socket file left behind by an earlier run would make bind() fail, anything else at 'path' is not ours to remove
+    struct stat st;
+    int stale = (lstat(path, &st) == 0);
+    TCP_DEBUG_PRINTF(stale && !S_ISSOCK(st.st_mode), "Path %s exists and is not a socket", path);
+    TCP_ERR_HANDLER(stale && !S_ISSOCK(st.st_mode), return TCP_ADDRESS_ERROR);
+    tcpsock_t *s = tcp_sock_create();
+    TCP_ERR_HANDLER(s == NULL, return TCP_MEMORY_ERROR);
+    s->family = AF_UNIX;
+    s->sd = socket(AF_UNIX, type | (opts->nonblock ? SOCK_NONBLOCK : 0), 0);
+    TCP_DEBUG_PRINTF(s->sd < 0, "Socket() failed with errno = %d [%s]", errno, strerror(errno));
+    TCP_ERR_HANDLER(s->sd < 0, free(s);return TCP_SOCKOP_ERROR);
+    result = tcp_apply_opts(s->sd, opts, 1, AF_UNIX);
+    TCP_ERR_HANDLER(result != 0, close(s->sd);free(s);return TCP_SOCKOP_ERROR);
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (stale) unlink(path);
+    result = bind(s->sd, (struct sockaddr *) &addr, sizeof(addr));
+    TCP_DEBUG_PRINTF(result == -1, "Bind() failed with errno = %d [%s]", errno, strerror(errno));
+    TCP_ERR_HANDLER(result != 0, close(s->sd);free(s);return TCP_SOCKOP_ERROR);
+    result = listen(s->sd, opts->backlog > 0 ? opts->backlog : MAX_PENDING);
+    TCP_DEBUG_PRINTF(result == -1, "Listen() failed with errno = %d [%s]", errno, strerror(errno));
+    TCP_ERR_HANDLER(result != 0, close(s->sd);unlink(path);free(s);return TCP_SOCKOP_ERROR);
+    s->path = strdup(path);
+    TCP_ERR_HANDLER(s->path == NULL, close(s->sd);unlink(path);free(s);return TCP_MEMORY_ERROR);
+    s->ip_addr = NULL;
+    s->port = 0;
+    s->cookie = MAGIC_COOKIE;
+    *sock = s;
+    return TCP_NO_ERROR;
+}
+
+int tcp_active_open_unix(tcpsock_t **sock, const char *path, int type) {
+    int result;
+    struct sockaddr_un addr;
+    TCP_ERR_HANDLER(path == NULL || strlen(path) >= sizeof(addr.sun_path), return TCP_ADDRESS_ERROR);
+    TCP_ERR_HANDLER(type != SOCK_STREAM && type != SOCK_SEQPACKET, return TCP_ADDRESS_ERROR);
+    tcpsock_t *client = tcp_sock_create();
+    TCP_ERR_HANDLER(client == NULL, return TCP_MEMORY_ERROR);
+    client->family = AF_UNIX;
+    client->sd = socket(AF_UNIX, type, 0);
+    TCP_DEBUG_PRINTF(client->sd < 0, "Socket() failed with errno = %d [%s]", errno, strerror(errno));
+    TCP_ERR_HANDLER(client->sd < 0, free(client);return TCP_SOCKOP_ERROR);
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    result = connect(client->sd, (struct sockaddr *) &addr, sizeof(addr));
+    TCP_DEBUG_PRINTF(result == -1, "Connect() failed with errno = %d [%s]", errno, strerror(errno));
+    TCP_ERR_HANDLER(result != 0, close(client->sd);free(client);return TCP_SOCKOP_ERROR);
+    client->ip_addr = NULL;
+    client->port = 0;
+    client->cookie = MAGIC_COOKIE;
+    *sock = client;
+    return TCP_NO_ERROR;
+}
+
 int tcp_active_open(tcpsock_t **sock, int remote_port, char *remote_ip) {
     struct sockaddr_in addr;
     tcpsock_t *client;
@@ -94,19 +179,19 @@ int tcp_active_open(tcpsock_t **sock, int remote_port, char *remote_ip) {
     memset(&addr, 0, sizeof(struct sockaddr_in));
     addr.sin_family = PROTOCOLFAMILY;
     result = inet_aton(remote_ip, (struct in_addr *) &addr.sin_addr.s_addr);
-    TCP_ERR_HANDLER(result == 0, free(client);return TCP_ADDRESS_ERROR);
+    TCP_ERR_HANDLER(result == 0, close(client->sd);free(client);return TCP_ADDRESS_ERROR);
     addr.sin_port = htons(remote_port);
     result = connect(client->sd, (struct sockaddr *) &addr, sizeof(addr));
     TCP_DEBUG_PRINTF(result == -1, "Connect() failed with errno = %d [%s]", errno, strerror(errno));
-    TCP_ERR_HANDLER(result != 0, free(client);return TCP_SOCKOP_ERROR);
+    TCP_ERR_HANDLER(result != 0, close(client->sd);free(client);return TCP_SOCKOP_ERROR);
     memset(&addr, 0, sizeof(struct sockaddr_in));
     length = sizeof(addr);
     result = getsockname(client->sd, (struct sockaddr *) &addr, (socklen_t *) &length);
     TCP_DEBUG_PRINTF(result == -1, "getsockname() failed with errno = %d [%s]", errno, strerror(errno));
-    TCP_ERR_HANDLER(result != 0, free(client);return TCP_SOCKOP_ERROR);
+    TCP_ERR_HANDLER(result != 0, close(client->sd);free(client);return TCP_SOCKOP_ERROR);
     p = inet_ntoa(addr.sin_addr);  //returns addr to statically allocated buffer
     client->ip_addr = (char *) malloc(sizeof(char) * CHAR_IP_ADDR_LENGTH);
-    TCP_ERR_HANDLER(client->ip_addr == NULL, free(client);return TCP_MEMORY_ERROR);
+    TCP_ERR_HANDLER(client->ip_addr == NULL, close(client->sd);free(client);return TCP_MEMORY_ERROR);
     client->ip_addr = strncpy(client->ip_addr, p, CHAR_IP_ADDR_LENGTH);
     client->port = ntohs(addr.sin_port);
     client->cookie = MAGIC_COOKIE;
@@ -129,27 +214,33 @@ int tcp_close(tcpsock_t **socket) {
             result = shutdown((*socket)->sd, SHUT_RDWR);
             //if ((result of shutdown==-1)&&(errno!=ENOTCONN)) //socket wasn't connected
             TCP_DEBUG_PRINTF(result == -1, "Shutdown() failed with errno = %d [%s]", errno, strerror(errno));
-            if (result != -1) {
+            // a listening socket was never connected, shutdown() fails on it with ENOTCONN but it still has to be closed
+            if (result != -1 || errno == ENOTCONN) {
                 result = close((*socket)->sd); // try to close the socket descriptor
                 TCP_DEBUG_PRINTF(result == -1, "Close() failed with errno = %d [%s]", errno, strerror(errno));
             }
         }
+        if ((*socket)->path != NULL)
+        {
+            unlink((*socket)->path);
+            free((*socket)->path);
+        }
     }
     // overwrite memory before free to make socket invalid (even if memory is accidently reused)!
     (*socket)->cookie = 0;
     (*socket)->port = -1;
     (*socket)->sd = -1;
     (*socket)->ip_addr = NULL;
+    (*socket)->path = NULL;
     free(*socket);
     *socket = NULL;
     return TCP_NO_ERROR;
 }
 
 int tcp_wait_for_connection(tcpsock_t *socket, tcpsock_t **new_socket) {
-    struct sockaddr_in addr;
+    struct sockaddr_storage addr;
     tcpsock_t *s;
-    unsigned int length = sizeof(struct sockaddr_in);
-    char *p;
+    socklen_t length = sizeof(addr);
 
     TCP_ERR_HANDLER(socket == NULL, return TCP_SOCKET_ERROR);
     TCP_ERR_HANDLER(socket->cookie != MAGIC_COOKIE, return TCP_SOCKET_ERROR);
@@ -158,16 +249,61 @@ int tcp_wait_for_connection(tcpsock_t *socket, tcpsock_t **new_socket) {
     s->sd = accept(socket->sd, (struct sockaddr *) &addr, &length);
     TCP_DEBUG_PRINTF(s->sd == -1, "Accept() failed with errno = %d [%s]", errno, strerror(errno));
     TCP_ERR_HANDLER(s->sd == -1, free(s);return TCP_SOCKOP_ERROR);
-    p = inet_ntoa(addr.sin_addr);  //returns addr to statically allocated buffer
-    s->ip_addr = (char *) malloc(sizeof(char) * CHAR_IP_ADDR_LENGTH);
-    TCP_ERR_HANDLER(s->ip_addr == NULL, free(s);return TCP_MEMORY_ERROR);
-    s->ip_addr = strncpy(s->ip_addr, p, CHAR_IP_ADDR_LENGTH);
-    s->port = ntohs(addr.sin_port);
+    TCP_ERR_HANDLER(tcp_set_peer(s, &addr) != TCP_NO_ERROR, close(s->sd);free(s);return TCP_MEMORY_ERROR);
     s->cookie = MAGIC_COOKIE;
     *new_socket = s;
     return TCP_NO_ERROR;
 }
 
+int tcp_attach_connection(tcpsock_t **new_socket, int sd) {
+    struct sockaddr_storage addr;
+    tcpsock_t *s;
+    socklen_t length = sizeof(addr);
+
+    TCP_ERR_HANDLER(sd < 0, return TCP_SOCKOP_ERROR);
+    TCP_ERR_HANDLER(getpeername(sd, (struct sockaddr *) &addr, &length) == -1, return TCP_SOCKOP_ERROR);
+    s = tcp_sock_create();
+    TCP_ERR_HANDLER(s == NULL, return TCP_MEMORY_ERROR);
+    TCP_ERR_HANDLER(tcp_set_peer(s, &addr) != TCP_NO_ERROR, free(s);return TCP_MEMORY_ERROR);
+    s->sd = sd;
+    s->cookie = MAGIC_COOKIE;
+    *new_socket = s;
+    return TCP_NO_ERROR;
+}
+
+int tcp_wait_for_connection_opts(tcpsock_t *socket, tcpsock_t **new_socket, const tcp_sock_opts_t *opts) {
+    struct sockaddr_storage addr;
+    tcpsock_t *s;
+    socklen_t length = sizeof(addr);
+
+    if (opts == NULL) return tcp_wait_for_connection(socket, new_socket);
+    TCP_ERR_HANDLER(socket == NULL, return TCP_SOCKET_ERROR);
+    TCP_ERR_HANDLER(socket->cookie != MAGIC_COOKIE, return TCP_SOCKET_ERROR);
+    s = tcp_sock_create();
+    TCP_ERR_HANDLER(s == NULL, return TCP_MEMORY_ERROR);
+    // accept4() hands out the socket non-blocking already, without an extra fcntl()
+    s->sd = accept4(socket->sd, (struct sockaddr *) &addr, &length, opts->nonblock ? SOCK_NONBLOCK : 0);
+    TCP_DEBUG_PRINTF(s->sd == -1, "Accept4() failed with errno = %d [%s]", errno, strerror(errno));
+    TCP_ERR_HANDLER(s->sd == -1, free(s);return TCP_SOCKOP_ERROR);
+    TCP_ERR_HANDLER(tcp_apply_opts(s->sd, opts, 0, socket->family) != 0, close(s->sd);free(s);return TCP_SOCKOP_ERROR);
+    TCP_ERR_HANDLER(tcp_set_peer(s, &addr) != TCP_NO_ERROR, close(s->sd);free(s);return TCP_MEMORY_ERROR);
+    s->cookie = MAGIC_COOKIE;
+    *new_socket = s;
+    return TCP_NO_ERROR;
+}
+
+int tcp_set_opts(tcpsock_t *socket, const tcp_sock_opts_t *opts) {
+    TCP_ERR_HANDLER(socket == NULL, return TCP_SOCKET_ERROR);
+    TCP_ERR_HANDLER(socket->cookie != MAGIC_COOKIE, return TCP_SOCKET_ERROR);
+    if (opts == NULL) return TCP_NO_ERROR;
+    TCP_ERR_HANDLER(tcp_apply_opts(socket->sd, opts, 0, socket->family) != 0, return TCP_SOCKOP_ERROR);
+    if (opts->nonblock) {
+        int flags = fcntl(socket->sd, F_GETFL);
+        TCP_ERR_HANDLER(flags == -1 || fcntl(socket->sd, F_SETFL, flags | O_NONBLOCK) == -1, return TCP_SOCKOP_ERROR);
+    }
+    return TCP_NO_ERROR;
+}
+
 int tcp_send(tcpsock_t *socket, void *buffer, int *buf_size) {
     TCP_ERR_HANDLER(socket == NULL, return TCP_SOCKET_ERROR);
     TCP_ERR_HANDLER(socket->cookie != MAGIC_COOKIE, return TCP_SOCKET_ERROR);
@@ -208,6 +344,132 @@ int tcp_receive(tcpsock_t *socket, void *buffer, int *buf_size) {
     return TCP_NO_ERROR;
 }
 
+int tcp_receive_some(tcpsock_t *socket, void *buffer, int *buf_size) {
+    TCP_ERR_HANDLER(socket == NULL, return TCP_SOCKET_ERROR);
+    TCP_ERR_HANDLER(socket->cookie != MAGIC_COOKIE, return TCP_SOCKET_ERROR);
+    if ((buffer == NULL) || (*buf_size == 0))  //nothing to read
+    {
+        *buf_size = 0;
+        return TCP_NO_ERROR;
+    }
+    int result = recv(socket->sd, buffer, *buf_size, MSG_DONTWAIT);
+    *buf_size = (result > 0) ? result : 0;
+    TCP_DEBUG_PRINTF(result == 0, "Recv() : no connection to peer\n");
+    TCP_ERR_HANDLER(result == 0, return TCP_CONNECTION_CLOSED);
+    if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return TCP_NO_ERROR;   //nothing available
+    TCP_ERR_HANDLER((result < 0) && (errno == ENOTCONN), return TCP_CONNECTION_CLOSED);
+    TCP_DEBUG_PRINTF(result < 0, "Recv() failed with errno = %d [%s]", errno, strerror(errno));
+    TCP_ERR_HANDLER(result < 0, return TCP_SOCKOP_ERROR);
+    return TCP_NO_ERROR;
+}
+
+int tcp_receive_message(tcpsock_t *socket, void *buffer, int *buf_size) {
+    TCP_ERR_HANDLER(socket == NULL, return TCP_SOCKET_ERROR);
+    TCP_ERR_HANDLER(socket->cookie != MAGIC_COOKIE, return TCP_SOCKET_ERROR);
+    if ((buffer == NULL) || (*buf_size == 0))  //nothing to read
+    {
+        *buf_size = 0;
+        return TCP_NO_ERROR;
+    }
+    int size = *buf_size;
+    // with MSG_TRUNC recv() returns the full length of the message, even the part that did not fit
+    int result = recv(socket->sd, buffer, size, MSG_DONTWAIT | MSG_TRUNC);
+    *buf_size = (result > 0) ? ((result < size) ? result : size) : 0;
+    TCP_DEBUG_PRINTF(result == 0, "Recv() : no connection to peer\n");
+    TCP_ERR_HANDLER(result == 0, return TCP_CONNECTION_CLOSED);
+    if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return TCP_NO_ERROR;   //nothing available
+    TCP_ERR_HANDLER((result < 0) && (errno == ENOTCONN), return TCP_CONNECTION_CLOSED);
+    TCP_DEBUG_PRINTF(result < 0, "Recv() failed with errno = %d [%s]", errno, strerror(errno));
+    TCP_ERR_HANDLER(result < 0, return TCP_SOCKOP_ERROR);
+    if (result > size) return TCP_MESSAGE_TRUNCATED;
+    return TCP_NO_ERROR;
+}
+
+int tcp_receive_exact(tcpsock_t *socket, void *buffer, int *buf_size, int timeout_ms) {
+    TCP_ERR_HANDLER(socket == NULL, return TCP_SOCKET_ERROR);
+    TCP_ERR_HANDLER(socket->cookie != MAGIC_COOKIE, return TCP_SOCKET_ERROR);
+    if ((buffer == NULL) || (*buf_size == 0))  //nothing to read
+    {
+        *buf_size = 0;
+        return TCP_NO_ERROR;
+    }
+    int wanted = *buf_size;
+    *buf_size = 0;
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (*buf_size < wanted)
+    {
+        int result = recv(socket->sd, (char *) buffer + *buf_size, wanted - *buf_size, MSG_WAITALL);
+        if (result > 0)
+        {
+            *buf_size += result;
+            continue;
+        }
+        TCP_DEBUG_PRINTF(result == 0, "Recv() : no connection to peer\n");
+        TCP_ERR_HANDLER(result == 0, return TCP_CONNECTION_CLOSED);
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            // a blocking socket only gets here when its SO_RCVTIMEO ran out
+            TCP_ERR_HANDLER(!(fcntl(socket->sd, F_GETFL) & O_NONBLOCK), return TCP_TIMEOUT);
+            // a non-blocking socket: wait until the rest arrives or the time is up
+            int left = -1;
+            if (timeout_ms >= 0)
+            {
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                left = timeout_ms - (int) ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+                TCP_ERR_HANDLER(left <= 0, return TCP_TIMEOUT);
+            }
+            struct pollfd fd = { .fd = socket->sd, .events = POLLIN };
+            int ready = poll(&fd, 1, left);
+            TCP_ERR_HANDLER(ready < 0 && errno != EINTR, return TCP_SOCKOP_ERROR);
+            TCP_ERR_HANDLER(ready == 0, return TCP_TIMEOUT);
+            continue;
+        }
+        TCP_ERR_HANDLER(errno == ENOTCONN, return TCP_CONNECTION_CLOSED);
+        TCP_DEBUG_PRINTF(1, "Recv() failed with errno = %d [%s]", errno, strerror(errno));
+        return TCP_SOCKOP_ERROR;
+    }
+    return TCP_NO_ERROR;
+}
+
+int tcp_receivev(tcpsock_t *socket, const struct iovec *iov, int iovcnt, int *size) {
+    TCP_ERR_HANDLER(socket == NULL, return TCP_SOCKET_ERROR);
+    TCP_ERR_HANDLER(socket->cookie != MAGIC_COOKIE, return TCP_SOCKET_ERROR);
+    if ((iov == NULL) || (iovcnt <= 0))  //nothing to read
+    {
+        *size = 0;
+        return TCP_NO_ERROR;
+    }
+    *size = readv(socket->sd, iov, iovcnt);
+    TCP_DEBUG_PRINTF(*size == 0, "Readv() : no connection to peer\n");
+    TCP_ERR_HANDLER(*size == 0, return TCP_CONNECTION_CLOSED);
+    TCP_ERR_HANDLER((*size < 0) && (errno == ENOTCONN), return TCP_CONNECTION_CLOSED);
+    TCP_DEBUG_PRINTF(*size < 0, "Readv() failed with errno = %d [%s]", errno, strerror(errno));
+    TCP_ERR_HANDLER(*size < 0, return TCP_SOCKOP_ERROR);
+    return TCP_NO_ERROR;
+}
+
+int tcp_sendv(tcpsock_t *socket, const struct iovec *iov, int iovcnt, int *size) {
+    TCP_ERR_HANDLER(socket == NULL, return TCP_SOCKET_ERROR);
+    TCP_ERR_HANDLER(socket->cookie != MAGIC_COOKIE, return TCP_SOCKET_ERROR);
+    if ((iov == NULL) || (iovcnt <= 0))  //nothing to send
+    {
+        *size = 0;
+        return TCP_NO_ERROR;
+    }
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = (struct iovec *) iov;
+    message.msg_iovlen = iovcnt;
+    // use MSG_NOSIGNAL flag to avoid a signal to be sent, writev() has no such flag
+    *size = sendmsg(socket->sd, &message, MSG_NOSIGNAL);
+    TCP_ERR_HANDLER(((*size < 0) && ((errno == EPIPE) || (errno == ENOTCONN))), return TCP_CONNECTION_CLOSED);
+    TCP_DEBUG_PRINTF(*size < 0, "Sendmsg() failed with errno = %d [%s]", errno, strerror(errno));
+    TCP_ERR_HANDLER(*size < 0, return TCP_SOCKOP_ERROR);
+    return TCP_NO_ERROR;
+}
+
 int tcp_get_ip_addr(tcpsock_t *socket, char **ip_addr) {
     TCP_ERR_HANDLER(socket == NULL, return TCP_SOCKET_ERROR);
     TCP_ERR_HANDLER(socket->cookie != MAGIC_COOKIE, return TCP_SOCKET_ERROR);
@@ -229,6 +491,63 @@ int tcp_get_sd(tcpsock_t *socket, int *sd) {
     return TCP_NO_ERROR;
 }
 
+static int tcp_set_option(int sd, int level, int name, int value) {
+    int result = setsockopt(sd, level, name, &value, sizeof(value));
+    TCP_DEBUG_PRINTF(result == -1, "Setsockopt(%d) failed with errno = %d [%s]", name, errno, strerror(errno));
+    return result;
+}
+
+/**
+ * Sets the options of 'opts' that are not 0 on 'sd', the listening ones only if 'listening'
+ * A local (AF_UNIX) socket only takes the buffer sizes, it has no TCP options
+ * Returns 0 on success, -1 if an option was refused
+ */
+static int tcp_apply_opts(int sd, const tcp_sock_opts_t *opts, int listening, int family) {
+    if (family == AF_UNIX) {
+        if (opts->rcvbuf > 0 && tcp_set_option(sd, SOL_SOCKET, SO_RCVBUF, opts->rcvbuf) != 0) return -1;
+        if (opts->sndbuf > 0 && tcp_set_option(sd, SOL_SOCKET, SO_SNDBUF, opts->sndbuf) != 0) return -1;
+        return 0;
+    }
+    if (listening) {
+        if (opts->reuseport && tcp_set_option(sd, SOL_SOCKET, SO_REUSEPORT, 1) != 0) return -1;
+        // buffers have to be set before listen(), the window scale of a connection is fixed at its handshake
+        if (opts->rcvbuf > 0 && tcp_set_option(sd, SOL_SOCKET, SO_RCVBUF, opts->rcvbuf) != 0) return -1;
+        if (opts->sndbuf > 0 && tcp_set_option(sd, SOL_SOCKET, SO_SNDBUF, opts->sndbuf) != 0) return -1;
+        if (opts->defer_accept_s > 0 && tcp_set_option(sd, IPPROTO_TCP, TCP_DEFER_ACCEPT, opts->defer_accept_s) != 0) return -1;
+        return 0;
+    }
+    if (opts->nodelay && tcp_set_option(sd, IPPROTO_TCP, TCP_NODELAY, 1) != 0) return -1;
+    if (opts->quickack && tcp_set_option(sd, IPPROTO_TCP, TCP_QUICKACK, 1) != 0) return -1;
+    if (opts->busy_poll_us > 0 && tcp_set_option(sd, SOL_SOCKET, SO_BUSY_POLL, opts->busy_poll_us) != 0) return -1;
+    if (opts->keepalive) {
+        if (tcp_set_option(sd, SOL_SOCKET, SO_KEEPALIVE, 1) != 0) return -1;
+        if (opts->keepidle_s > 0 && tcp_set_option(sd, IPPROTO_TCP, TCP_KEEPIDLE, opts->keepidle_s) != 0) return -1;
+        if (opts->keepintvl_s > 0 && tcp_set_option(sd, IPPROTO_TCP, TCP_KEEPINTVL, opts->keepintvl_s) != 0) return -1;
+        if (opts->keepcnt > 0 && tcp_set_option(sd, IPPROTO_TCP, TCP_KEEPCNT, opts->keepcnt) != 0) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Fills out the address of the peer of 's', a local (AF_UNIX) peer has no IP address and port 0
+ * Returns TCP_NO_ERROR, or TCP_MEMORY_ERROR if the IP address can't be stored
+ */
+static int tcp_set_peer(tcpsock_t *s, const struct sockaddr_storage *addr) {
+    s->family = addr->ss_family;
+    if (addr->ss_family != AF_INET) {
+        s->ip_addr = NULL;
+        s->port = 0;
+        return TCP_NO_ERROR;
+    }
+    const struct sockaddr_in *in = (const struct sockaddr_in *) addr;
+    char *p = inet_ntoa(in->sin_addr);  //returns addr to statically allocated buffer
+    s->ip_addr = (char *) malloc(sizeof(char) * CHAR_IP_ADDR_LENGTH);
+    if (s->ip_addr == NULL) return TCP_MEMORY_ERROR;
+    s->ip_addr = strncpy(s->ip_addr, p, CHAR_IP_ADDR_LENGTH);
+    s->port = ntohs(in->sin_port);
+    return TCP_NO_ERROR;
+}
+
 static tcpsock_t *tcp_sock_create() {
     tcpsock_t *s = (tcpsock_t *) malloc(sizeof(tcpsock_t));
     if (s) // init the socket to default values
@@ -237,6 +556,8 @@ static tcpsock_t *tcp_sock_create() {
         s->port = -1;
         s->ip_addr = NULL;
         s->sd = -1;
+        s->family = AF_INET;
+        s->path = NULL;
     }
     return s;
 }
@@ -5,6 +5,8 @@
 #ifndef __TCPSOCK_H__
 #define __TCPSOCK_H__
 
+#include <sys/uio.h>
+
 #define MIN_PORT    1024
 #define MAX_PORT    65536
 
@@ -14,6 +16,8 @@
 #define    TCP_SOCKOP_ERROR         3   // socket operator (socket, listen, bind, accept,...) error
 #define    TCP_CONNECTION_CLOSED    4   // send/receive indicate connection is closed
 #define    TCP_MEMORY_ERROR         5   // mem alloc error
+#define    TCP_TIMEOUT              6   // receive did not complete in time
+#define    TCP_MESSAGE_TRUNCATED    7   // a message did not fit the receive buffer
 
 #define MAX_PENDING 10
 
@@ -26,9 +30,30 @@ struct tcpsock {
     int sd;             /**< socket descriptor */
     char *ip_addr;      /**< socket IP address */
     int port;           /**< socket port number */
+    int family;         /**< AF_INET, or AF_UNIX for a local socket (no IP address, port 0) */
+    char *path;         /**< AF_UNIX listening socket: the path it is bound to, removed on close, else NULL */
 };
 typedef struct tcpsock tcpsock_t;
 
+/**
+ * Socket options, applied when a socket is opened or accepted. A zeroed structure keeps every kernel default
+ */
+typedef struct {
+    int backlog;            /**< listen() backlog, 0: MAX_PENDING */
+    int reuseport;          /**< SO_REUSEPORT on a listening socket, several sockets can then listen on one port */
+    int rcvbuf;             /**< SO_RCVBUF in bytes, set on the listening socket so accepted sockets inherit it, 0: default */
+    int sndbuf;             /**< SO_SNDBUF in bytes, like rcvbuf */
+    int nodelay;            /**< TCP_NODELAY: send small segments at once instead of coalescing them */
+    int quickack;           /**< TCP_QUICKACK: acknowledge at once instead of delaying, set on every accepted socket */
+    int busy_poll_us;       /**< SO_BUSY_POLL: microseconds a blocking receive busy-polls the device, 0: off */
+    int defer_accept_s;     /**< TCP_DEFER_ACCEPT: seconds a connection may wait for its first data before accept() sees it, 0: off */
+    int nonblock;           /**< SOCK_NONBLOCK on the opened or accepted socket */
+    int keepalive;          /**< SO_KEEPALIVE, with the three settings below (0: default) */
+    int keepidle_s;         /**< TCP_KEEPIDLE: idle seconds before the first probe */
+    int keepintvl_s;        /**< TCP_KEEPINTVL: seconds between probes */
+    int keepcnt;            /**< TCP_KEEPCNT: unanswered probes before the connection is dropped */
+} tcp_sock_opts_t;
+
 /**
  * Creates a new socket and opens this socket in 'passive listening mode' (waiting for an active connection setup request)
  * The socket is bound to port number 'port' and to any active IP interface of the system
@@ -43,6 +68,53 @@ typedef struct tcpsock tcpsock_t;
  */
 int tcp_passive_open(tcpsock_t **socket, int port);
 
+/**
+ * Same as tcp_passive_open(), but the socket is bound with SO_REUSEPORT
+ * Several sockets of the same process can then listen on 'port', the kernel spreads the incoming connections over them
+ * \param socket a double pointer, that will be filled out with the newly created socket
+ * \param port a port number between MIN_PORT and MAX_PORT
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_passive_open_reuseport(tcpsock_t **socket, int port);
+
+/**
+ * Same as tcp_passive_open(), with the options 'opts' applied before the socket starts listening
+ * If an option can't be set, TCP_SOCKOP_ERROR is returned
+ * \param socket a double pointer, that will be filled out with the newly created socket
+ * \param port a port number between MIN_PORT and MAX_PORT
+ * \param opts the options, NULL is the same as tcp_passive_open()
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_passive_open_opts(tcpsock_t **socket, int port, const tcp_sock_opts_t *opts);
+
+/**
+ * Creates a new Unix domain socket bound to 'path' and opens it in 'passive listening mode', for peers on the same host
+ * Connections accepted on it behave like TCP connections for every other function of this library, without the TCP stack
+ * A socket file left at 'path' by an earlier run is removed first, and the file is removed again by tcp_close()
+ * If 'path' is NULL or too long, or 'type' is not SOCK_STREAM or SOCK_SEQPACKET, TCP_ADDRESS_ERROR is returned
+ * If something other than a socket exists at 'path', it is left alone and TCP_ADDRESS_ERROR is returned
+ * If memory allocation for the newly created socket fails, TCP_MEMORY_ERROR is returned
+ * If a socket operation (socket, listen, bind, accept,...) fails, TCP_SOCKOP_ERROR is returned
+ * \param socket a double pointer, that will be filled out with the newly created socket
+ * \param path the file system path of the socket
+ * \param type SOCK_STREAM, or SOCK_SEQPACKET to keep the boundaries of every send
+ * \param opts the options, only backlog, rcvbuf, sndbuf and nonblock apply, NULL keeps the defaults
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_passive_open_unix(tcpsock_t **socket, const char *path, int type, const tcp_sock_opts_t *opts);
+
+/**
+ * Creates a new Unix domain socket and connects it to the listening socket at 'path'
+ * If 'path' is NULL or too long, or 'type' is not SOCK_STREAM or SOCK_SEQPACKET, TCP_ADDRESS_ERROR is returned
+ * If memory allocation for the newly created socket fails, TCP_MEMORY_ERROR is returned
+ * If a socket operation (socket, connect,...) fails, TCP_SOCKOP_ERROR is returned
+ * \param socket a double pointer, that will be filled out with the newly created socket
+ * \param path the file system path of the listening socket
+ * \param type the type the listening socket was opened with
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_active_open_unix(tcpsock_t **socket, const char *path, int type);
+
 /**
  * Creates a new TCP socket and opens a TCP connection to the system with IP address 'remote_ip' on port 'remote_port'
  * The newly created socket is return as '*socket'
@@ -82,6 +154,39 @@ int tcp_close(tcpsock_t **socket);
  */
 int tcp_wait_for_connection(tcpsock_t *socket, tcpsock_t **new_socket);
 
+/**
+ * Same as tcp_wait_for_connection(), the new socket gets the per-connection options of 'opts'
+ * With opts->nonblock the new socket is non-blocking from the start (accept4), on a non-blocking 'socket' the call does not block either
+ * If an option can't be set, TCP_SOCKOP_ERROR is returned and the new connection is closed
+ * \param socket the socket that needs to be monitored for a new incomming connection
+ * \param new_socket a double pointer, that will be filled out with the newly created socket for the connection with the client
+ * \param opts the options, NULL is the same as tcp_wait_for_connection()
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_wait_for_connection_opts(tcpsock_t *socket, tcpsock_t **new_socket, const tcp_sock_opts_t *opts);
+
+/**
+ * Applies the per-connection options of 'opts' (nodelay, quickack, busy poll, keepalive, nonblock) to a connected socket
+ * Meant for sockets accepted outside of this library, see tcp_attach_connection()
+ * If 'socket' is NULL or not yet bound, TCP_SOCKET_ERROR is returned
+ * If an option can't be set, TCP_SOCKOP_ERROR is returned
+ * \param socket the connected socket
+ * \param opts the options
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_set_opts(tcpsock_t *socket, const tcp_sock_opts_t *opts);
+
+/**
+ * Wraps the descriptor 'sd' of a connection that was accepted outside of this library (e.g. by io_uring) in a new socket
+ * The ip address and port of the remote system are looked up on the descriptor
+ * If memory allocation for the new socket fails, TCP_MEMORY_ERROR is returned and 'sd' is left open
+ * If the descriptor is not a connected socket, TCP_SOCKOP_ERROR is returned and 'sd' is left open
+ * \param new_socket a double pointer, that will be filled out with the newly created socket
+ * \param sd the descriptor of the accepted connection
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_attach_connection(tcpsock_t **new_socket, int sd);
+
 /**
  * Initiates a send command on the socket 'socket' and tries to send the total '*buf_size' bytes of data in 'buffer' (recall that the function might block for a while)
  * The function sets '*buf_size' to the number of bytes that were really sent, which might be less than the initial '*buf_size'
@@ -106,6 +211,73 @@ int tcp_send(tcpsock_t *socket, void *buffer, int *buf_size);
  */
 int tcp_receive(tcpsock_t *socket, void *buffer, int *buf_size);
 
+/**
+ * Receives whatever is available on the socket 'socket', up to '*buf_size' bytes in 'buffer', without ever blocking
+ * The function sets '*buf_size' to the number of bytes that were received, 0 if nothing was available
+ * If a socket error happens while receiving data or the connection is closed, TCP_SOCKOP_ERROR or TCP_CONNECTION_CLOSED is returned, respectively
+ * If 'socket' is NULL or not yet bound, TCP_SOCKET_ERROR is returned
+ * \param socket the socket where the data needs to be received from
+ * \param buffer a pointer to the buffer that can store the data that is received
+ * \param buf_size the most bytes that will be read from the socket
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_receive_some(tcpsock_t *socket, void *buffer, int *buf_size);
+
+/**
+ * Receives the next message of the SOCK_SEQPACKET socket 'socket' in 'buffer', without ever blocking
+ * The function sets '*buf_size' to the number of bytes that were received, 0 if no message was waiting
+ * If the message is larger than '*buf_size', the kernel drops the rest of it, '*buf_size' bytes are kept and TCP_MESSAGE_TRUNCATED is returned
+ * If a socket error happens while receiving data or the connection is closed, TCP_SOCKOP_ERROR or TCP_CONNECTION_CLOSED is returned, respectively
+ * If 'socket' is NULL or not yet bound, TCP_SOCKET_ERROR is returned
+ * \param socket the socket where the message needs to be received from
+ * \param buffer a pointer to the buffer that can store the message
+ * \param buf_size the size of 'buffer'
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_receive_message(tcpsock_t *socket, void *buffer, int *buf_size);
+
+/**
+ * Receives exactly '*buf_size' bytes in 'buffer', it keeps receiving (and waits on a non-blocking socket) until they all arrived
+ * The function sets '*buf_size' to the number of bytes that were received, which is only less than the initial '*buf_size' on an error
+ * If a socket error happens while receiving data or the connection is closed first, TCP_SOCKOP_ERROR or TCP_CONNECTION_CLOSED is returned, respectively
+ * If the bytes did not all arrive within 'timeout_ms', TCP_TIMEOUT is returned. A blocking socket waits in recv() instead,
+ * set SO_RCVTIMEO on it to bound the wait: when that runs out, TCP_TIMEOUT is returned as well
+ * If 'socket' is NULL or not yet bound, TCP_SOCKET_ERROR is returned
+ * \param socket the socket where the data needs to be received from
+ * \param buffer a pointer to the buffer that can store the data that is received
+ * \param buf_size the amount of bytes that must be read from the socket
+ * \param timeout_ms how long a non-blocking socket waits for the rest in milliseconds, a negative value waits without limit
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_receive_exact(tcpsock_t *socket, void *buffer, int *buf_size, int timeout_ms);
+
+/**
+ * Receives into the 'iovcnt' buffers of 'iov' with one readv(), filling them in order (recall that the function might block for a while)
+ * The function sets '*size' to the number of bytes that were received, which might be less than the buffers hold
+ * If a socket error happens while receiving data or the connection is closed, TCP_SOCKOP_ERROR or TCP_CONNECTION_CLOSED is returned, respectively
+ * If 'socket' is NULL or not yet bound, TCP_SOCKET_ERROR is returned
+ * \param socket the socket where the data needs to be received from
+ * \param iov the buffers that can store the data that is received
+ * \param iovcnt the amount of buffers in 'iov'
+ * \param size a pointer to an int that will hold the number of bytes that were received
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_receivev(tcpsock_t *socket, const struct iovec *iov, int iovcnt, int *size);
+
+/**
+ * Sends the 'iovcnt' buffers of 'iov' in order with one system call (recall that the function might block for a while)
+ * Like tcp_send(), a closed connection does not raise SIGPIPE, so the call is sendmsg() rather than writev()
+ * The function sets '*size' to the number of bytes that were really sent, which might be less than the buffers hold
+ * If a socket error happens while sending the data or the connection is closed, TCP_SOCKOP_ERROR or TCP_CONNECTION_CLOSED is returned, respectively
+ * If 'socket' is NULL or not yet bound, TCP_SOCKET_ERROR is returned
+ * \param socket the socket where the data needs to be sent on
+ * \param iov the buffers that hold the data that needs to be sent
+ * \param iovcnt the amount of buffers in 'iov'
+ * \param size a pointer to an int that will hold the number of bytes that were sent
+ * \return TCP_NO_ERROR if no error occurs during execution
+ */
+int tcp_sendv(tcpsock_t *socket, const struct iovec *iov, int iovcnt, int *size);
+
 /**
  * Set '*ip_addr' to the IP address of 'socket' (could be NULL if the IP address is not set)
  * No memory allocation is done (pointer reference assignment!), hence, no free must be called to avoid a memory leak
@@ -0,0 +1,158 @@
+/**
+ * \author Zeping Zhang
+ */
+#include <stdlib.h>
+#include "timerwheel.h"
+
+#define WHEEL_LEVELS    4
+#define WHEEL_BITS      6
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_MAX_DELTA (((uint64_t)1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1)   // farther timers wait in the last slot
+
+struct timer_wheel {
+    unsigned int tick_ms;
+    uint64_t tick;                                          /**< next tick to be processed */
+    timer_wheel_timer_t *slot[WHEEL_LEVELS][WHEEL_SLOTS];  /**< doubly linked lists of waiting timers */
+    timer_wheel_timer_t *expired;                           /**< timers whose tick has passed, not yet popped */
+    unsigned long armed;                                    /**< amount of armed timers, expired ones included */
+};
+
+static void timer_wheel_link(timer_wheel_timer_t **head, timer_wheel_timer_t *timer);
+static void timer_wheel_place(timer_wheel_t *wheel, timer_wheel_timer_t *timer);
+static unsigned int timer_wheel_cascade(timer_wheel_t *wheel, int level);
+
+timer_wheel_t *timer_wheel_create(uint64_t now_ms, unsigned int tick_ms)
+{
+    if (tick_ms == 0) return NULL;
+    timer_wheel_t *wheel = calloc(1, sizeof(timer_wheel_t));
+    if (wheel == NULL) return NULL;
+    wheel->tick_ms = tick_ms;
+    wheel->tick = now_ms / tick_ms;
+    return wheel;
+}
+
+void timer_wheel_destroy(timer_wheel_t **wheel)
+{
+    if (wheel == NULL || *wheel == NULL) return;
+    free(*wheel);
+    *wheel = NULL;
+}
+
+void timer_wheel_timer_init(timer_wheel_timer_t *timer, void *data)
+{
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->list = NULL;
+    timer->expires = 0;
+    timer->data = data;
+}
+
+void timer_wheel_arm(timer_wheel_t *wheel, timer_wheel_timer_t *timer, uint64_t expires_ms)
+{
+    timer_wheel_cancel(wheel, timer);
+    // round up, so the timer never fires before 'expires_ms'
+    timer->expires = (expires_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    wheel->armed++;
+    timer_wheel_place(wheel, timer);
+}
+
+void timer_wheel_cancel(timer_wheel_t *wheel, timer_wheel_timer_t *timer)
+{
+    if (timer->list == NULL) return;
+    if (timer->prev != NULL) timer->prev->next = timer->next;
+    else *timer->list = timer->next;
+    if (timer->next != NULL) timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->list = NULL;
+    wheel->armed--;
+}
+
+timer_wheel_timer_t *timer_wheel_pop_expired(timer_wheel_t *wheel, uint64_t now_ms)
+{
+    uint64_t now_tick = now_ms / wheel->tick_ms;
+    if (wheel->armed == 0 && now_tick >= wheel->tick) wheel->tick = now_tick + 1;   // nothing to cascade, skip ahead
+    while (wheel->expired == NULL && wheel->tick <= now_tick)
+    {
+        unsigned int index = wheel->tick & WHEEL_MASK;
+        // at the start of every revolution the next slot of the coarser level is spread over the finer ones
+        if (index == 0 && timer_wheel_cascade(wheel, 1) == 0 && timer_wheel_cascade(wheel, 2) == 0) timer_wheel_cascade(wheel, 3);
+        wheel->expired = wheel->slot[0][index];
+        wheel->slot[0][index] = NULL;
+        for (timer_wheel_timer_t *timer = wheel->expired; timer != NULL; timer = timer->next) timer->list = &wheel->expired;
+        wheel->tick++;
+    }
+    timer_wheel_timer_t *timer = wheel->expired;
+    if (timer == NULL) return NULL;
+    timer_wheel_cancel(wheel, timer);
+    return timer;
+}
+
+int64_t timer_wheel_next_timeout(timer_wheel_t *wheel, uint64_t now_ms)
+{
+    if (wheel->armed == 0) return -1;
+    if (wheel->expired != NULL) return 0;
+    // the finest level only needs a look up to the next cascade, which may bring in earlier timers
+    uint64_t target = (wheel->tick & WHEEL_MASK) == 0 ? wheel->tick : (wheel->tick | WHEEL_MASK) + 1;
+    for (uint64_t tick = wheel->tick; tick < target; tick++)
+    {
+        if (wheel->slot[0][tick & WHEEL_MASK] != NULL)
+        {
+            target = tick;
+            break;
+        }
+    }
+    uint64_t target_ms = target * wheel->tick_ms;
+    return target_ms > now_ms ? (int64_t)(target_ms - now_ms) : 0;
+}
+
+/**
+ * Pushes 'timer' in front of the list '*head'
+ */
+static void timer_wheel_link(timer_wheel_timer_t **head, timer_wheel_timer_t *timer)
+{
+    timer->list = head;
+    timer->prev = NULL;
+    timer->next = *head;
+    if (*head != NULL) (*head)->prev = timer;
+    *head = timer;
+}
+
+/**
+ * Links an armed timer into the slot that matches its distance to the current tick
+ */
+static void timer_wheel_place(timer_wheel_t *wheel, timer_wheel_timer_t *timer)
+{
+    if (timer->expires < wheel->tick)
+    {
+        timer_wheel_link(&wheel->expired, timer);
+        return;
+    }
+    uint64_t delta = timer->expires - wheel->tick;
+    // too far away for the wheel, it waits in the farthest slot and is re-placed every time the last level cascades it
+    // 'expires' itself is kept, so it still fires on its own tick
+    uint64_t slot_tick = delta > WHEEL_MAX_DELTA ? wheel->tick + WHEEL_MAX_DELTA : timer->expires;
+    if (delta > WHEEL_MAX_DELTA) delta = WHEEL_MAX_DELTA;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << ((level + 1) * WHEEL_BITS))) level++;
+    unsigned int index = (slot_tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    timer_wheel_link(&wheel->slot[level][index], timer);
+}
+
+/**
+ * Re-places every timer of the current slot of 'level', returns the index of that slot
+ */
+static unsigned int timer_wheel_cascade(timer_wheel_t *wheel, int level)
+{
+    unsigned int index = (wheel->tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    timer_wheel_timer_t *timer = wheel->slot[level][index];
+    wheel->slot[level][index] = NULL;
+    while (timer != NULL)
+    {
+        timer_wheel_timer_t *next = timer->next;
+        timer_wheel_place(wheel, timer);
+        timer = next;
+    }
+    return index;
+}
@@ -0,0 +1,80 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#ifndef _TIMERWHEEL_H_
+#define _TIMERWHEEL_H_
+
+#include <stdint.h>
+
+/**
+ * A hierarchical timer wheel: 4 levels of 64 slots, every level 64 times coarser than the one below
+ * Arming, re-arming and cancelling a timer is O(1), expired timers are handed out in O(expired) and
+ * timers of the coarser levels are cascaded down once per revolution of the level below.
+ * Times are in milliseconds on any monotonic clock chosen by the caller, a timer never fires early
+ * and at most one tick late. A wheel is not thread-safe, it belongs to one thread.
+ */
+typedef struct timer_wheel timer_wheel_t;
+
+/**
+ * A timer, embedded in the record it times out
+ * The wheel does not allocate timers, it only links them, so the memory must stay valid while armed
+ */
+typedef struct timer_wheel_timer {
+    struct timer_wheel_timer *prev;     /**< neighbours in the slot the timer waits in */
+    struct timer_wheel_timer *next;
+    struct timer_wheel_timer **list;    /**< head of the list the timer is linked in, NULL while not armed */
+    uint64_t expires;                   /**< tick the timer fires on */
+    void *data;                         /**< owner of the timer, free for the caller */
+} timer_wheel_timer_t;
+
+/** Creates a new, empty wheel
+ * \param now_ms the current time
+ * \param tick_ms the resolution of the wheel, at least 1
+ * \return a pointer to the new wheel, or NULL if memory allocation failed
+ */
+timer_wheel_t *timer_wheel_create(uint64_t now_ms, unsigned int tick_ms);
+
+/** Frees the wheel and sets '*wheel' to NULL, the timers that are still armed are left alone
+ * If 'wheel' or '*wheel' is NULL, nothing is done
+ * \param wheel a double pointer to the wheel
+ */
+void timer_wheel_destroy(timer_wheel_t **wheel);
+
+/** Prepares 'timer' for use, the timer is not armed
+ * \param timer a pointer to the timer
+ * \param data the value of timer->data
+ */
+void timer_wheel_timer_init(timer_wheel_timer_t *timer, void *data);
+
+/** Arms 'timer' to fire at 'expires_ms', a timer that is already armed is moved
+ * \param wheel a pointer to the wheel
+ * \param timer an initialized timer
+ * \param expires_ms the time the timer fires, a time in the past fires on the next call of timer_wheel_pop_expired()
+ */
+void timer_wheel_arm(timer_wheel_t *wheel, timer_wheel_timer_t *timer, uint64_t expires_ms);
+
+/** Disarms 'timer', nothing is done if it is not armed
+ * \param wheel a pointer to the wheel
+ * \param timer an initialized timer
+ */
+void timer_wheel_cancel(timer_wheel_t *wheel, timer_wheel_timer_t *timer);
+
+/** Advances the wheel to 'now_ms' and disarms and returns one expired timer
+ * Call it until it returns NULL to collect every timer that expired
+ * \param wheel a pointer to the wheel
+ * \param now_ms the current time
+ * \return an expired timer, or NULL if no timer expired
+ */
+timer_wheel_timer_t *timer_wheel_pop_expired(timer_wheel_t *wheel, uint64_t now_ms);
+
+/** Returns how long the caller may sleep before timer_wheel_pop_expired() has work again
+ * The result is the time until the first tick that fires a timer or cascades a coarser level, which is
+ * never later than the first expiry. Finding it costs at most one scan of the 64 finest slots.
+ * \param wheel a pointer to the wheel
+ * \param now_ms the current time
+ * \return the delay in milliseconds, or -1 if no timer is armed
+ */
+int64_t timer_wheel_next_timeout(timer_wheel_t *wheel, uint64_t now_ms);
+
+#endif  //_TIMERWHEEL_H_
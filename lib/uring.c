@@ -0,0 +1,267 @@
+/**
+ * \author Zeping Zhang
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "uring.h"
+
+static int uring_enter(uring_t *ring, unsigned int to_submit, unsigned int min_complete, unsigned int flags, void *arg, size_t arg_size);
+static int uring_probe_run(uring_t *ring, int listener, int receiver);
+
+int uring_init(uring_t *ring, unsigned int entries, unsigned int cq_entries)
+{
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(uring_t));
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = cq_entries;
+    ring->fd = syscall(SYS_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return -errno;
+    ring->features = params.features;
+    // both rings in one mapping and timeouts on io_uring_enter() keep the rest simple
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+    {
+        close(ring->fd);
+        return -EOPNOTSUPP;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        int error = errno;
+        close(ring->fd);
+        return -error;
+    }
+    ring->cq_ring = ring->sq_ring;
+    ring->cq_ring_size = 0;     // shared with the submission ring, unmapped once
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        int error = errno;
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        return -error;
+    }
+
+    unsigned char *sq = ring->sq_ring;
+    ring->sq_head = (unsigned int *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *) (sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    unsigned char *cq = ring->cq_ring;
+    ring->cq_head = (unsigned int *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    // submission entry i always sits in slot i, so the indirection array is filled once
+    for (unsigned int i = 0; i < ring->sq_entries; i++) ring->sq_array[i] = i;
+    return 0;
+}
+
+int uring_probe_multishot()
+{
+    uring_t ring;
+    uring_buffers_t buffers;
+    int result = uring_init(&ring, 4, 8);
+    if (result != 0) return result;
+    result = uring_buffers_create(&ring, &buffers, 0, 2, 64);
+    if (result != 0)
+    {
+        uring_free(&ring);
+        return result;
+    }
+
+    // an address of only the family binds the listener to a free abstract name, nothing shows up in the file system
+    int listener = -1, client = -1, pair[2] = { -1, -1 };
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    socklen_t length = sizeof(sa_family_t);
+    if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 || bind(listener, (struct sockaddr *) &addr, length) == -1
+        || listen(listener, 1) == -1 || (length = sizeof(addr), getsockname(listener, (struct sockaddr *) &addr, &length)) == -1
+        || (client = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 || connect(client, (struct sockaddr *) &addr, length) == -1
+        || socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1 || write(pair[1], "", 1) != 1)
+        result = -errno;
+    else result = uring_probe_run(&ring, listener, pair[0]);
+
+    // closing the ring cancels both requests, only then the buffers are safe to free
+    uring_free(&ring);
+    uring_buffers_free(&ring, &buffers);
+    if (listener != -1) close(listener);
+    if (client != -1) close(client);
+    if (pair[0] != -1) close(pair[0]);
+    if (pair[1] != -1) close(pair[1]);
+    return result;
+}
+
+/**
+ * Arms a multishot accept on 'listener' and a multishot recv on 'receiver', which both have something pending,
+ * and waits for their first completions. A kernel without multishot support fails them with -EINVAL
+ */
+static int uring_probe_run(uring_t *ring, int listener, int receiver)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = 1;
+    sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = receiver;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = 2;
+
+    unsigned int answered = 0, supported = 0;
+    for (int tries = 0; answered != 3 && tries < 10; tries++)
+    {
+        int result = uring_submit_and_wait(ring, 100);
+        if (result < 0) return result;
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(ring)) != NULL)
+        {
+            answered |= cqe->user_data;
+            if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_MORE)) supported |= cqe->user_data;
+            if (cqe->user_data == 1 && cqe->res >= 0) close(cqe->res);
+            uring_cqe_seen(ring);
+        }
+    }
+    return (supported == 3) ? 0 : -EOPNOTSUPP;
+}
+
+void uring_free(uring_t *ring)
+{
+    if (ring->fd < 0) return;
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t *ring)
+{
+    unsigned int tail = *ring->sq_tail + ring->sq_pending;
+    if (tail - atomic_load_explicit((_Atomic unsigned int *) ring->sq_head, memory_order_acquire) >= ring->sq_entries)
+    {
+        if (uring_submit_and_wait(ring, 0) < 0) return NULL;
+        tail = *ring->sq_tail;
+        if (tail - atomic_load_explicit((_Atomic unsigned int *) ring->sq_head, memory_order_acquire) >= ring->sq_entries) return NULL;
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[tail & *ring->sq_mask];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_pending++;
+    return sqe;
+}
+
+int uring_submit_and_wait(uring_t *ring, int timeout_ms)
+{
+    unsigned int tail = *ring->sq_tail + ring->sq_pending;
+    // release: the kernel that sees the new tail also sees the entries
+    atomic_store_explicit((_Atomic unsigned int *) ring->sq_tail, tail, memory_order_release);
+    ring->sq_pending = 0;
+    // entries a call refused with -EBUSY are still queued, they go out with the new ones
+    unsigned int to_submit = tail - atomic_load_explicit((_Atomic unsigned int *) ring->sq_head, memory_order_acquire);
+
+    int wait = timeout_ms != 0 && uring_peek_cqe(ring) == NULL;
+    if (!wait && to_submit == 0) return 0;
+    struct __kernel_timespec ts = { .tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L };
+    struct io_uring_getevents_arg arg = {
+        .sigmask = 0,
+        .sigmask_sz = _NSIG / 8,
+        .ts = (timeout_ms > 0) ? (unsigned long) &ts : 0,
+    };
+    int result = wait ? uring_enter(ring, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg))
+                      : uring_enter(ring, to_submit, 0, 0, NULL, 0);
+    if (result < 0 && (errno == ETIME || errno == EINTR)) return 0;
+    return (result < 0) ? -errno : 0;
+}
+
+struct io_uring_cqe *uring_peek_cqe(uring_t *ring)
+{
+    unsigned int head = *ring->cq_head;
+    // acquire: the completion is written before the kernel moves the tail
+    if (head == atomic_load_explicit((_Atomic unsigned int *) ring->cq_tail, memory_order_acquire)) return NULL;
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(uring_t *ring)
+{
+    atomic_store_explicit((_Atomic unsigned int *) ring->cq_head, *ring->cq_head + 1, memory_order_release);
+}
+
+int uring_buffers_create(uring_t *ring, uring_buffers_t *buffers, unsigned short group, unsigned int entries, size_t buffer_size)
+{
+    buffers->entries = entries;
+    buffers->buffer_size = buffer_size;
+    buffers->group = group;
+    buffers->ring_size = entries * sizeof(struct io_uring_buf);
+    // the ring has to be page aligned, the kernel reads it directly
+    buffers->ring = mmap(NULL, buffers->ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers->ring == MAP_FAILED) return -errno;
+    buffers->memory = malloc(entries * buffer_size);
+    if (buffers->memory == NULL)
+    {
+        munmap(buffers->ring, buffers->ring_size);
+        return -ENOMEM;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long) buffers->ring;
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    if (syscall(SYS_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        int error = errno;
+        free(buffers->memory);
+        munmap(buffers->ring, buffers->ring_size);
+        return -error;
+    }
+    buffers->ring->tail = 0;
+    for (unsigned int id = 0; id < entries; id++) uring_buffer_recycle(buffers, id);
+    return 0;
+}
+
+void uring_buffers_free(uring_t *ring, uring_buffers_t *buffers)
+{
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = buffers->group;
+    if (ring->fd >= 0) syscall(SYS_io_uring_register, ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    free(buffers->memory);
+    munmap(buffers->ring, buffers->ring_size);
+}
+
+unsigned char *uring_buffer(uring_buffers_t *buffers, unsigned int id)
+{
+    return buffers->memory + (size_t) id * buffers->buffer_size;
+}
+
+void uring_buffer_recycle(uring_buffers_t *buffers, unsigned int id)
+{
+    unsigned short tail = buffers->ring->tail;
+    struct io_uring_buf *buf = &buffers->ring->bufs[tail & (buffers->entries - 1)];
+    buf->addr = (unsigned long) uring_buffer(buffers, id);
+    buf->len = buffers->buffer_size;
+    buf->bid = id;
+    // release: the kernel that sees the new tail also sees the entry
+    atomic_store_explicit((_Atomic unsigned short *) &buffers->ring->tail, tail + 1, memory_order_release);
+}
+
+static int uring_enter(uring_t *ring, unsigned int to_submit, unsigned int min_complete, unsigned int flags, void *arg, size_t arg_size)
+{
+    ring->enters++;
+    return syscall(SYS_io_uring_enter, ring->fd, to_submit, min_complete, flags, arg, arg_size);
+}
@@ -0,0 +1,119 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/**
+ * A minimal io_uring instance on top of the raw system calls, no liburing needed
+ * Submission entries are prepared with uring_get_sqe() and handed to the kernel in one go by uring_submit_and_wait()
+ * A ring is not thread-safe, it belongs to one thread.
+ */
+typedef struct {
+    int fd;
+    unsigned int features;          /**< IORING_FEAT_* reported by the kernel */
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int sq_entries;
+    unsigned int sq_pending;        /**< entries prepared since the last submit */
+    struct io_uring_sqe *sqes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned long enters;           /**< io_uring_enter() calls made so far */
+} uring_t;
+
+/**
+ * A group of equally sized buffers the kernel picks from for IOSQE_BUFFER_SELECT requests
+ */
+typedef struct {
+    struct io_uring_buf_ring *ring;
+    size_t ring_size;
+    unsigned char *memory;          /**< 'entries' buffers of 'buffer_size' bytes */
+    unsigned int entries;
+    size_t buffer_size;
+    unsigned short group;
+} uring_buffers_t;
+
+/** Sets up 'ring' with room for 'entries' submissions and 'cq_entries' completions
+ * The kernel must support a single mmap for both rings and timeouts on io_uring_enter() (Linux 5.11)
+ * \param ring a pointer to pre-allocated uring_t space
+ * \param entries the size of the submission queue, a power of two
+ * \param cq_entries the size of the completion queue, a power of two above 'entries'
+ * \return 0 on success, or a negative errno when io_uring is missing, forbidden or too old
+ */
+int uring_init(uring_t *ring, unsigned int entries, unsigned int cq_entries);
+
+/** Checks on a throwaway ring that the kernel keeps an accept and a recv with provided buffers running (multishot,
+ * Linux 6.0): both are armed on private Unix sockets and must complete once without ending
+ * \return 0 if both are supported, -EOPNOTSUPP if one of them is not, or a negative errno when the check itself failed
+ */
+int uring_probe_multishot();
+
+/** Tears down 'ring', the kernel cancels every request that is still pending
+ * \param ring a ring set up by uring_init()
+ */
+void uring_free(uring_t *ring);
+
+/** Returns a zeroed submission entry, the queue is submitted first when it is full
+ * \param ring a pointer to the ring
+ * \return a pointer to the entry, or NULL if the queue is full and could not be submitted
+ */
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+
+/** Submits every prepared entry and waits until at least one completion is available or 'timeout_ms' passed
+ * \param ring a pointer to the ring
+ * \param timeout_ms the longest wait in milliseconds, 0 does not wait and a negative value waits without deadline
+ * \return 0 on success or on timeout, or a negative errno. -EBUSY means the completion queue overflowed and the kernel
+ * took no new entries: handle the completions and call again, the entries stay queued
+ */
+int uring_submit_and_wait(uring_t *ring, int timeout_ms);
+
+/** Returns the oldest completion that was not yet marked as seen, or NULL if there is none
+ * \param ring a pointer to the ring
+ */
+struct io_uring_cqe *uring_peek_cqe(uring_t *ring);
+
+/** Gives the oldest completion back to the kernel, the pointer returned by uring_peek_cqe() is no longer valid
+ * \param ring a pointer to the ring
+ */
+void uring_cqe_seen(uring_t *ring);
+
+/** Allocates 'entries' buffers of 'buffer_size' bytes and registers them as buffer group 'group' (Linux 5.19)
+ * \param ring a pointer to the ring
+ * \param buffers a pointer to pre-allocated uring_buffers_t space
+ * \param group the id requests select the group with
+ * \param entries the amount of buffers, a power of two below 32768
+ * \param buffer_size the size of every buffer
+ * \return 0 on success or a negative errno
+ */
+int uring_buffers_create(uring_t *ring, uring_buffers_t *buffers, unsigned short group, unsigned int entries, size_t buffer_size);
+
+/** Unregisters the group and frees its buffers. Call it after uring_free() while requests may still be pending:
+ * the kernel only stops writing into the buffers once the ring is closed, the group then needs no unregistering
+ * \param ring the ring the group is registered with
+ * \param buffers a group created by uring_buffers_create()
+ */
+void uring_buffers_free(uring_t *ring, uring_buffers_t *buffers);
+
+/** Returns the memory of buffer 'id', as reported in the flags of a completion
+ */
+unsigned char *uring_buffer(uring_buffers_t *buffers, unsigned int id);
+
+/** Hands buffer 'id' back to the kernel once its content has been used
+ */
+void uring_buffer_recycle(uring_buffers_t *buffers, unsigned int id);
+
+#endif  //_URING_H_
@@ -6,26 +6,69 @@
 #include "config.h"
 #include "connmgr.h"
 #include <pthread.h>
+#include <sys/socket.h>
+#include <limits.h>
+#include <math.h>
 #include "sbuffer.h"
 #include "datamgr.h"
 #include "sensor_db.h"
 #define FIFO_NAME 	"FIFOlog" 
 #define MAX     80
+#ifndef SBUFFER_POLICY
+#define SBUFFER_POLICY SBUFFER_POLICY_BLOCK   // default of -p: what connmgr does when the consumers fall behind
+#endif
+#ifndef SBUFFER_BUDGET
+#define SBUFFER_BUDGET 0                      // default of -p: bytes of readings sbuffer may hold, 0 = the whole ring
+#endif
+#ifndef DB_MIN_BATCH
+#define DB_MIN_BATCH 64                       // the database manager wakes up for this many readings ...
+#endif
+#ifndef DB_MAX_DELAY_MS
+#define DB_MAX_DELAY_MS 100                   // ... or when the oldest unread reading waited this long
+#endif
+#ifndef DATAMGR_MIN_BATCH
+#define DATAMGR_MIN_BATCH 64                  // every data manager worker wakes up for this many readings ...
+#endif
+#ifndef DATAMGR_MAX_DELAY_MS
+#define DATAMGR_MAX_DELAY_MS 100              // ... or when the oldest unread reading waited this long
+#endif
+#ifndef CAPTURE_MIN_BATCH
+#define CAPTURE_MIN_BATCH SBUFFER_BATCH_SIZE  // the capture thread wakes up for this many readings ...
+#endif
+#ifndef CAPTURE_MAX_DELAY_MS
+#define CAPTURE_MAX_DELAY_MS 500              // ... or when the oldest unread reading waited this long
+#endif
+#ifndef CAPTURE_BUFFER
+#define CAPTURE_BUFFER (1 << 20)              // bytes of capture collected before one write() to disk
+#endif
+#define CAPTURE_FILE "sensor_data_recv"
+#define MAX_THREADS 1024                      // upper limit of -r
+#define MAX_WORKERS (SBUFFER_MAX_READERS - 2) // upper limit of -w: every worker but the first takes a reader of sbuffer
 #include "errmacros.h"
 
 //********Global variables********
 int server_port;
-pthread_t connmgr_thread, datamgr_thread, sensor_db_thread;
+int datamgr_workers = 1;    // -w: amount of threads the sensor table is sharded over
+int datamgr_avg_window = 0; // -a: readings in the running average, 0 keeps RUN_AVG_LENGTH
+int connmgr_reactors = 1;   // -r: amount of threads that accept and read the sensor connections
+int connmgr_backend = CONNMGR_BACKEND_EPOLL;   // -b: event loop of the reactors
+int connmgr_udp_port = -1;  // -u: port of the UDP listener, 0 disables it, by default the server port
+char *connmgr_unix_path = NULL;             // -U: path of a Unix socket listener, none by default
+int connmgr_unix_type = SOCK_STREAM;        // -U seqpacket:path keeps the message boundaries
+connmgr_limit_t connmgr_connection_limit = {0, 0};  // -c: readings per second and burst of every connection
+connmgr_limit_t connmgr_sensor_limit = {0, 0};      // -s: the same for every sensor id, sensor_limits.map overrides it
+tcp_sock_opts_t connmgr_socket_opts = { .backlog = SOMAXCONN };   // -o: socket options, see parse_socket_opts()
+int capture_echo = 0;       // -e: print every n-th reading on the console, 0 prints none
+int capture_binary = 0;     // -f binary: capture packed records instead of text lines
+int sbuffer_policy = SBUFFER_POLICY;        // -p: backpressure policy of sbuffer, see parse_policy()
+size_t sbuffer_budget = SBUFFER_BUDGET;     // -p policy:budget, bytes of readings sbuffer may hold
+pthread_t connmgr_thread, datamgr_thread, sensor_db_thread, capture_thread;
 sbuffer_t *sbuffer;
+int datamgr_reader, sensor_db_reader, capture_reader;   // cursors of the consumers on sbuffer
 int connection_end;
 int datamgr_read_amount=0;
 int db_read_amount=0;
 
-pthread_mutex_t datamgr_lock = PTHREAD_MUTEX_INITIALIZER; /*mutex to use with condition 
-                                                    variable to sleep datamgr thread */
-pthread_mutex_t sensor_db_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t cond1 = PTHREAD_COND_INITIALIZER;
-pthread_cond_t cond_db = PTHREAD_COND_INITIALIZER;
 pthread_rwlock_t *flag_lock;
 FILE *fifo_write;
 FILE *fifo_read; 
@@ -37,19 +80,85 @@ char *log_message;
 void* connmgr_main(void* port);
 void* datamgr_main();
 void* sensor_db_main();
+void* capture_main();
 void reconnect_to_db(DBCONN *conn);
 int callback(void *NotUsed, int argc, char **argv, char **azColName);
 void fifo_log(char* log);
+int parse_socket_opts(char *list, tcp_sock_opts_t *opts);
+int parse_number(const char *arg, long min, long max, int *value);
+int parse_limit(const char *arg, connmgr_limit_t *limit);
+void usage(char *program);
+int parse_policy(char *arg, int *policy, size_t *budget);
 
 //********Main process********
 int main(int argc, char *argv[]) {
     
-    if (argc != 2) {
+    int opt;
+    while ((opt = getopt(argc, argv, "w:a:r:b:u:U:e:f:c:s:o:p:")) != -1) {
+        switch (opt) {
+            case 'w':
+                if (parse_number(optarg, 1, MAX_WORKERS, &datamgr_workers) != 0) usage(argv[0]);
+                break;
+            case 'a':
+                if (parse_number(optarg, 0, INT_MAX, &datamgr_avg_window) != 0) usage(argv[0]);
+                break;
+            case 'r':
+                if (parse_number(optarg, 1, MAX_THREADS, &connmgr_reactors) != 0) usage(argv[0]);
+                break;
+            case 'b':
+                if (strcmp(optarg, "uring") == 0) connmgr_backend = CONNMGR_BACKEND_URING;
+                else if (strcmp(optarg, "epoll") == 0) connmgr_backend = CONNMGR_BACKEND_EPOLL;
+                else {
+                    printf("Unknown backend %s, use epoll or uring\n", optarg);
+                    exit(EXIT_SUCCESS);
+                }
+                break;
+            case 'u':
+                if (parse_number(optarg, 0, UINT16_MAX, &connmgr_udp_port) != 0) usage(argv[0]);
+                break;
+            case 'U':
+                if (strncmp(optarg, "seqpacket:", strlen("seqpacket:")) == 0) {
+                    connmgr_unix_type = SOCK_SEQPACKET;
+                    connmgr_unix_path = optarg + strlen("seqpacket:");
+                } else connmgr_unix_path = optarg;
+                break;
+            case 'e':
+                if (parse_number(optarg, 0, INT_MAX, &capture_echo) != 0) usage(argv[0]);
+                break;
+            case 'f':
+                if (strcmp(optarg, "binary") == 0) capture_binary = 1;
+                else if (strcmp(optarg, "text") == 0) capture_binary = 0;
+                else usage(argv[0]);
+                break;
+            case 'c':
+                if (parse_limit(optarg, &connmgr_connection_limit) != 0) usage(argv[0]);
+                break;
+            case 's':
+                if (parse_limit(optarg, &connmgr_sensor_limit) != 0) usage(argv[0]);
+                break;
+            case 'o':
+                if (parse_socket_opts(optarg, &connmgr_socket_opts) != 0) {
+                    printf("Invalid socket option list, use backlog=n, rcvbuf=bytes, sndbuf=bytes, nodelay, quickack, busy_poll=us, defer_accept=s or keepalive[=idle:interval:count]\n");
+                    usage(argv[0]);
+                }
+                break;
+            case 'p':
+                if (parse_policy(optarg, &sbuffer_policy, &sbuffer_budget) != 0) {
+                    printf("Unknown policy %s, use block, drop_oldest, drop_newest or spill, optionally followed by :budget_bytes\n", optarg);
+                    exit(EXIT_SUCCESS);
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) {
         printf("Fail to set server_port!");
         exit(EXIT_SUCCESS);
     } else {
         // user input validation
-        server_port = atoi(argv[1]);
+        server_port = atoi(argv[optind]);
+        if (connmgr_udp_port < 0) connmgr_udp_port = server_port;
     }
 
     pid_t pid = fork();
@@ -85,6 +194,12 @@ int main(int argc, char *argv[]) {
     else
     {  // main process 
     sbuffer_init(&sbuffer);
+    sbuffer_set_policy(sbuffer, sbuffer_policy, sbuffer_budget);
+    // register the consumers before the connection manager starts so they see every reading
+    datamgr_reader = sbuffer_register_reader(sbuffer);
+    sensor_db_reader = sbuffer_register_reader(sbuffer);
+    capture_reader = sbuffer_register_reader(sbuffer);
+    datamgr_register_workers(datamgr_workers);
     connection_end=0;
 
     int result = mkfifo(FIFO_NAME, 0666);
@@ -100,22 +215,27 @@ int main(int argc, char *argv[]) {
     if(pthread_create(&connmgr_thread,NULL,connmgr_main,&server_port) != 0) exit(EXIT_FAILURE);
     if(pthread_create(&datamgr_thread,NULL,datamgr_main,NULL) != 0) exit(EXIT_FAILURE);
     if(pthread_create(&sensor_db_thread,NULL,sensor_db_main,NULL) != 0) exit(EXIT_FAILURE);
+    if(pthread_create(&capture_thread,NULL,capture_main,NULL) != 0) exit(EXIT_FAILURE);
 
     pthread_join(connmgr_thread,NULL);
     pthread_join(datamgr_thread,NULL);
     pthread_join(sensor_db_thread,NULL);
+    pthread_join(capture_thread,NULL);
 
     
-    pthread_cond_destroy(&cond1);
-    pthread_cond_destroy(&cond_db);
-    pthread_mutex_destroy(&datamgr_lock);
-    pthread_mutex_destroy(&sensor_db_lock);
     pthread_rwlock_destroy(flag_lock);
     free(flag_lock);
 
     result = fclose(fifo_write);
     FILE_CLOSE_ERROR(result);
 
+    sbuffer_stats_t stats;
+    sbuffer_get_stats(sbuffer, &stats);
+    printf("Shared buffer: blocked %zu times, %zu oldest dropped, %zu newest dropped, %zu spilled (%zu segments left), %zu readers evicted\n",
+           stats.blocked, stats.dropped_oldest, stats.dropped_newest, stats.spilled, stats.segments, stats.evicted);
+    sbuffer_unregister_reader(sbuffer, datamgr_reader);
+    sbuffer_unregister_reader(sbuffer, sensor_db_reader);
+    sbuffer_unregister_reader(sbuffer, capture_reader);
     sbuffer_free(&sbuffer);
 
     }
@@ -128,16 +248,19 @@ int main(int argc, char *argv[]) {
 
 void* connmgr_main(void* port)
 {
-    int port_i = *(int*)port;
-    connmgr_listen(port_i);
+    connmgr_config_t config = { .port = *(int*)port, .reactors = connmgr_reactors, .backend = connmgr_backend,
+                                .udp_port = connmgr_udp_port, .unix_path = connmgr_unix_path,
+                                .unix_type = connmgr_unix_type, .connection_limit = connmgr_connection_limit,
+                                .sensor_limit = connmgr_sensor_limit, .limits_file = "sensor_limits.map",
+                                .socket_opts = connmgr_socket_opts };
+    connmgr_listen(&config);
     printf("Connection manager ended\n");
     // protect flag -- write
     pthread_rwlock_wrlock(flag_lock);
     connection_end = 1;
     pthread_rwlock_unlock(flag_lock);
 
-    pthread_cond_signal(&cond1);
-    pthread_cond_signal(&cond_db);
+    sbuffer_close(sbuffer);  // the consumers drain what is left and stop
     connmgr_free();
     return NULL;
 }
@@ -145,30 +268,26 @@ void* connmgr_main(void* port)
 void* datamgr_main()
 {
     FILE* snsr_ptr = fopen("room_sensor.map", "r");
+    datamgr_set_window(datamgr_avg_window);
     parse_sensor_map(snsr_ptr);
+    datamgr_start_workers(DATAMGR_MIN_BATCH, DATAMGR_MAX_DELAY_MS);
 
-    // protect flag -- read
-    pthread_rwlock_rdlock(flag_lock);
-    int connection_end_flag=connection_end;
-    pthread_rwlock_unlock(flag_lock);
-
-    while (connection_end_flag==0 || datamgr_unread_amount(sbuffer)>0)
+    // wake up per DATAMGR_MIN_BATCH readings or after DATAMGR_MAX_DELAY_MS, the loop ends once sbuffer is closed and read
+    int result;
+    while ((result = sbuffer_wait(sbuffer, datamgr_reader, DATAMGR_MIN_BATCH, DATAMGR_MAX_DELAY_MS)) != SBUFFER_CLOSED)
     {
-        pthread_mutex_lock(&datamgr_lock);
-        if (datamgr_unread_amount(sbuffer)==0)
+        if (result == SBUFFER_NO_DATA) continue;
+        if (result == SBUFFER_EVICTED)
         {
-            pthread_cond_wait(&cond1, &datamgr_lock);
+            printf("data manager evicted, %zu readings behind\n", sbuffer_evicted_lag(sbuffer, datamgr_reader));
+            break;
         }
-        pthread_mutex_unlock(&datamgr_lock);
-        // protect flag -- read
-        pthread_rwlock_rdlock(flag_lock);
-        connection_end_flag=connection_end;
-        pthread_rwlock_unlock(flag_lock);
-
-        if(datamgr_unread_amount(sbuffer)>0) datamgr_parse_sensor_buffer();
-
-
-        
+        if (result != SBUFFER_SUCCESS)
+        {
+            printf("data manager read fail\n");
+            break;
+        }
+        datamgr_parse_sensor_buffer();
     }
     printf("Data manager ended\n");
     datamgr_free();
@@ -178,6 +297,7 @@ void* datamgr_main()
 
 void* sensor_db_main()
 {
+    sensor_data_t batch[SBUFFER_BATCH_SIZE];
     db_read_amount=0;
     DBCONN *conn = init_connection(1);
     if(conn==NULL) reconnect_to_db(conn);
@@ -186,24 +306,21 @@ void* sensor_db_main()
         fifo_log(log_message);
     }
 
-    // protect flag -- read
-    pthread_rwlock_rdlock(flag_lock);
-    int connection_end_flag=connection_end;
-    pthread_rwlock_unlock(flag_lock);
-
-    while (connection_end_flag==0 || datamgr_unread_amount(sbuffer)>0)
+    // wake up per DB_MIN_BATCH readings or after DB_MAX_DELAY_MS, so every transaction carries a batch
+    int result;
+    while ((result = sbuffer_wait(sbuffer, sensor_db_reader, DB_MIN_BATCH, DB_MAX_DELAY_MS)) != SBUFFER_CLOSED)
     {
-        pthread_mutex_lock(&sensor_db_lock);
-        if (sensor_db_unread_amount(sbuffer)==0)
+        if (result == SBUFFER_NO_DATA) continue;
+        if (result == SBUFFER_EVICTED)
         {
-            pthread_cond_wait(&cond_db, &sensor_db_lock);
+            printf("database manager evicted, %zu readings behind\n", sbuffer_evicted_lag(sbuffer, sensor_db_reader));
+            break;
+        }
+        if (result != SBUFFER_SUCCESS)
+        {
+            printf("database manager read fail\n");
+            break;
         }
-        pthread_mutex_unlock(&sensor_db_lock);
-
-        // protect flag -- read
-        pthread_rwlock_rdlock(flag_lock);
-        connection_end_flag=connection_end;
-        pthread_rwlock_unlock(flag_lock);
 
         if(conn==NULL) 
         {
@@ -211,14 +328,13 @@ void* sensor_db_main()
             fifo_log(log_message);
             reconnect_to_db(conn);
         }
-        if(sensor_db_unread_amount(sbuffer)>0)
+        int amount = sbuffer_read_batch(sbuffer, sensor_db_reader, batch, SBUFFER_BATCH_SIZE);
+        if(amount<0) printf("database manager read fail\n");
+        else
         {
-            db_read_amount++;
-            sensor_data_t *data = malloc(sizeof(sensor_data_t));
-            if(sensor_db_first_to_read(sbuffer,data)!=1) printf("data manager read fail\n");
-            insert_sensor(conn,data->id,data->value,data->ts);
-            free(data);
-        } 
+            db_read_amount += amount;
+            insert_sensor_batch(conn,batch,amount);
+        }
     }
 
     printf("Database manager ended\n");
@@ -227,6 +343,62 @@ void* sensor_db_main()
     return NULL;
 }
 
+void* capture_main()
+{
+    /* Records every reading in CAPTURE_FILE, so the connection manager never formats or writes anything
+     * itself. By default a reading is a text line "id value timestamp" as before; with -f binary it is
+     * packed like a v1 record on the wire (id, value, timestamp in host byte order, CONNMGR_RECORD_SIZE
+     * bytes each), which skips the formatting. The console only sees every capture_echo-th reading */
+    sensor_data_t batch[SBUFFER_BATCH_SIZE];
+    unsigned char records[SBUFFER_BATCH_SIZE * CONNMGR_RECORD_SIZE];
+    unsigned long captured = 0;
+    FILE *capture_file = fopen(CAPTURE_FILE, "w");
+    FILE_OPEN_ERROR(capture_file);
+    if (setvbuf(capture_file, NULL, _IOFBF, CAPTURE_BUFFER) != 0) printf("capture buffer not set, using the default\n");
+
+    int result;
+    while ((result = sbuffer_wait(sbuffer, capture_reader, CAPTURE_MIN_BATCH, CAPTURE_MAX_DELAY_MS)) != SBUFFER_CLOSED)
+    {
+        if (result == SBUFFER_NO_DATA) continue;
+        if (result == SBUFFER_EVICTED)
+        {
+            printf("capture evicted, %zu readings behind\n", sbuffer_evicted_lag(sbuffer, capture_reader));
+            break;
+        }
+        if (result != SBUFFER_SUCCESS)
+        {
+            printf("capture read fail\n");
+            break;
+        }
+        int amount = sbuffer_read_batch(sbuffer, capture_reader, batch, SBUFFER_BATCH_SIZE);
+        if (amount < 0)
+        {
+            printf("capture read fail\n");
+            break;
+        }
+        for (int i = 0; i < amount; i++)
+        {
+            if (capture_binary)
+            {
+                unsigned char *record = records + i * CONNMGR_RECORD_SIZE;
+                memcpy(record, &batch[i].id, sizeof(sensor_id_t));
+                memcpy(record + sizeof(sensor_id_t), &batch[i].value, sizeof(sensor_value_t));
+                memcpy(record + sizeof(sensor_id_t) + sizeof(sensor_value_t), &batch[i].ts, sizeof(sensor_ts_t));
+            }
+            else if (fprintf(capture_file, "%d %f %ld\n", batch[i].id, batch[i].value, (long int) batch[i].ts) < 0) perror("fprintf()");
+            if (capture_echo > 0 && (captured + i) % capture_echo == 0)
+                printf("sensor id = %" PRIu16 " - temperature = %g - timestamp = %ld\n", batch[i].id, batch[i].value, (long int) batch[i].ts);
+        }
+        if (capture_binary && fwrite(records, CONNMGR_RECORD_SIZE, amount, capture_file) != (size_t) amount) perror("fwrite()");
+        captured += amount;
+    }
+
+    printf("Capture ended: %lu readings in %s\n", captured, CAPTURE_FILE);
+    result = fclose(capture_file);
+    FILE_CLOSE_ERROR(result);
+    return NULL;
+}
+
 void reconnect_to_db(DBCONN *conn)
 {
     sleep(5);
@@ -257,6 +429,117 @@ int callback(void *NotUsed, int argc, char **argv, char **azColName) {
     return 0;
 }
 
+/**
+ * Parses a comma separated list of socket options into 'opts', e.g. "backlog=1024,nodelay,keepalive=30:10:3"
+ * Options: backlog=n, rcvbuf=bytes, sndbuf=bytes, nodelay, quickack, busy_poll=us, defer_accept=s, keepalive[=idle:interval:count]
+ * Returns 0 on success, -1 on an unknown option, a missing or unexpected value, or a value out of range
+ */
+int parse_socket_opts(char *list, tcp_sock_opts_t *opts)
+{
+    char *save;
+    for (char *option = strtok_r(list, ",", &save); option != NULL; option = strtok_r(NULL, ",", &save))
+    {
+        char *value = strchr(option, '=');
+        if (value != NULL) *value++ = '\0';
+        int result = -1;
+        if (strcmp(option, "backlog") == 0 && value != NULL) result = parse_number(value, 1, INT_MAX, &opts->backlog);
+        else if (strcmp(option, "rcvbuf") == 0 && value != NULL) result = parse_number(value, 1, INT_MAX, &opts->rcvbuf);
+        else if (strcmp(option, "sndbuf") == 0 && value != NULL) result = parse_number(value, 1, INT_MAX, &opts->sndbuf);
+        else if (strcmp(option, "nodelay") == 0 && value == NULL)
+        {
+            opts->nodelay = 1;
+            result = 0;
+        }
+        else if (strcmp(option, "quickack") == 0 && value == NULL)
+        {
+            opts->quickack = 1;
+            result = 0;
+        }
+        else if (strcmp(option, "busy_poll") == 0 && value != NULL) result = parse_number(value, 0, INT_MAX, &opts->busy_poll_us);
+        else if (strcmp(option, "defer_accept") == 0 && value != NULL) result = parse_number(value, 0, INT_MAX, &opts->defer_accept_s);
+        else if (strcmp(option, "keepalive") == 0)
+        {
+            opts->keepalive = 1;
+            result = 0;
+            if (value != NULL)
+            {
+                // all three of idle:interval:count
+                char *interval = strchr(value, ':');
+                char *count = (interval != NULL) ? strchr(interval + 1, ':') : NULL;
+                if (count == NULL) return -1;
+                *interval++ = '\0';
+                *count++ = '\0';
+                result = parse_number(value, 1, INT_MAX, &opts->keepidle_s) | parse_number(interval, 1, INT_MAX, &opts->keepintvl_s)
+                         | parse_number(count, 1, INT_MAX, &opts->keepcnt);
+            }
+        }
+        if (result != 0) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Parses the whole of 'arg' as a decimal number between 'min' and 'max' into '*value'
+ * Returns 0 on success, -1 if 'arg' is empty, has trailing characters or is out of range; '*value' is left alone then
+ */
+int parse_number(const char *arg, long min, long max, int *value)
+{
+    char *end;
+    errno = 0;
+    long number = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno != 0 || number < min || number > max) return -1;
+    *value = (int) number;
+    return 0;
+}
+
+/**
+ * Parses 'arg' of -c or -s, a rate in readings per second and a burst, e.g. "100:20"
+ * Returns 0 on success, -1 unless both are there, nothing follows them and both are above 0; '*limit' is left alone then
+ */
+int parse_limit(const char *arg, connmgr_limit_t *limit)
+{
+    double rate, burst;
+    char extra;
+    if (sscanf(arg, "%lf:%lf%c", &rate, &burst, &extra) != 2 || !(rate > 0) || !(burst > 0) || !isfinite(rate) || !isfinite(burst)) return -1;
+    limit->rate = rate;
+    limit->burst = burst;
+    return 0;
+}
+
+/**
+ * Prints how to call the gateway and exits
+ */
+void usage(char *program)
+{
+    printf("Usage: %s [-w datamgr_workers] [-a avg_window] [-r connmgr_reactors] [-b epoll|uring] [-u udp_port] [-U [seqpacket:]unix_path] [-e echo_every] [-f text|binary] [-c conn_rate:burst] [-s sensor_rate:burst] [-o socket_option,...] [-p policy[:budget_bytes]] server_port\n", program);
+    exit(EXIT_SUCCESS);
+}
+
+/**
+ * Parses 'arg' of -p, a backpressure policy optionally followed by the budget in bytes, e.g. "spill:1048576"
+ * Returns 0 on success, -1 if the policy is unknown or the budget is not a number
+ */
+int parse_policy(char *arg, int *policy, size_t *budget)
+{
+    char *value = strchr(arg, ':');
+    size_t length = (value != NULL) ? (size_t) (value - arg) : strlen(arg);
+    if (length == strlen("block") && strncmp(arg, "block", length) == 0) *policy = SBUFFER_POLICY_BLOCK;
+    else if (length == strlen("drop_oldest") && strncmp(arg, "drop_oldest", length) == 0) *policy = SBUFFER_POLICY_DROP_OLDEST;
+    else if (length == strlen("drop_newest") && strncmp(arg, "drop_newest", length) == 0) *policy = SBUFFER_POLICY_DROP_NEWEST;
+    else if (length == strlen("spill") && strncmp(arg, "spill", length) == 0) *policy = SBUFFER_POLICY_SPILL;
+    else return -1;
+    if (value != NULL)
+    {
+        char *end;
+        value++;
+        errno = 0;
+        unsigned long long bytes = strtoull(value, &end, 10);
+        if (end == value || *end != '\0' || errno != 0 || *value == '-') return -1;
+        *budget = bytes;
+    }
+    return 0;
+}
+
 void fifo_log(char* log)
 {
 	char *send_buf; 
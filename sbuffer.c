@@ -4,201 +4,727 @@
 
 #define _GNU_SOURCE
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <errno.h>
+#include <time.h>
 #include "sbuffer.h"
 #include <pthread.h>
 
+#define CACHE_LINE_SIZE 64
+
+#define READER_FREE     0
+#define READER_ACTIVE   1
+#define READER_EVICTED  2
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() (void)0
+#endif
+
+/**
+ * a cursor is a sequence number that only grows, the slot it points to is 'seq & mask'
+ * every cursor sits on its own cache line so the producer and the readers don't false share
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t seq;
+} sbuffer_cursor_t;
 
 /**
- * basic node for the buffer, these nodes are linked together to create the buffer
+ * a registered reader, only active readers hold back reclamation
  */
-typedef struct sbuffer_node {
-    struct sbuffer_node *next;  /**< a pointer to the next node*/
-    sensor_data_t data;         /**< a structure containing the data */
-    int datamgr_read;
-    int sensor_db_read;
-} sbuffer_node_t;
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t seq;    /**< sequence of the next slot this reader reads */
+    atomic_int state;                               /**< READER_FREE, READER_ACTIVE or READER_EVICTED */
+    atomic_size_t wake_at;                          /**< parked until head reaches this sequence, 0 = not parked */
+    atomic_uint futex;                              /**< bumped by every wake-up, the reader sleeps on it */
+    atomic_size_t evicted_lag;                      /**< readings this reader was behind when it was evicted */
+} sbuffer_reader_t;
+
+/**
+ * a spill segment holds the readings with sequence first .. first+count-1, they never went through the ring
+ */
+typedef struct sbuffer_segment {
+    struct sbuffer_segment *next;   /**< segments are ordered by sequence */
+    size_t first;                   /**< sequence of the first reading in the segment */
+    size_t count;                   /**< readings written so far, at most SBUFFER_SEGMENT_RECORDS */
+    sensor_data_t *records;         /**< the mapped file */
+    int fd;
+    char *path;
+} sbuffer_segment_t;
 
 /**
  * a structure to keep track of the buffer
+ * head - readers[i].seq is the amount of readings reader i has not read yet,
+ * a slot can be overwritten once every active reader cursor has passed it
  */
 struct sbuffer {
-    sbuffer_node_t *head;       /**< a pointer to the first node in the buffer */
-    sbuffer_node_t *tail;       /**< a pointer to the last node in the buffer */
-    pthread_rwlock_t *rwlock;
+    sbuffer_cursor_t head;                          /**< sequence of the next slot the producer writes */
+    sbuffer_cursor_t tail;                          /**< sequence of the oldest slot that is not yet reclaimed */
+    sbuffer_reader_t readers[SBUFFER_MAX_READERS];  /**< the reader slots */
+    size_t mask;                                    /**< capacity of the ring - 1 */
+    size_t high_water;                              /**< readings the buffer may hold before the policy kicks in */
+    int policy;                                     /**< one of SBUFFER_POLICY_* */
+    int spilling;                                   /**< producer-only: new readings go to the segments */
+    sbuffer_segment_t *segments;                    /**< oldest spill segment, protected by spill_lock */
+    sbuffer_segment_t *last_segment;                /**< segment the producer appends to, protected by spill_lock */
+    unsigned int segment_id;                        /**< numbers the segment files, protected by spill_lock */
+    atomic_size_t segment_count;                    /**< readers skip spill_lock while this is 0 */
+    pthread_mutex_t spill_lock;
+    atomic_size_t blocked;                          /**< backpressure counters, see sbuffer_stats_t */
+    atomic_size_t dropped_oldest;
+    atomic_size_t dropped_newest;
+    atomic_size_t spilled;
+    atomic_size_t evicted;
+    atomic_int parked;                              /**< amount of parked readers, the producer skips wake-ups while 0 */
+    atomic_size_t producer_wake_at;                 /**< the blocked producer is parked until the reader at this sequence - 1 moves, 0 = not parked */
+    atomic_uint producer_futex;                     /**< bumped by every wake-up of the producer, it sleeps on it */
+    atomic_int closed;                              /**< set by sbuffer_close() */
+    size_t max_lag;                                 /**< readers this far behind are evicted while the producer is blocked, 0 = never */
+    sensor_data_t *slots;                           /**< the ring itself */
+    pthread_mutex_t register_lock;                  /**< serializes (un)registration, never taken on the data path */
 };
 
+static size_t sbuffer_slowest_reader(sbuffer_t *buffer);
+static size_t sbuffer_drop_oldest(sbuffer_t *buffer, size_t tail, size_t new_tail);
+static int sbuffer_spill(sbuffer_t *buffer, size_t head, sensor_data_t *data, size_t count);
+static size_t sbuffer_fetch(sbuffer_t *buffer, size_t seq, sensor_data_t *out, size_t count);
+static sbuffer_segment_t *sbuffer_segment_create(sbuffer_t *buffer, size_t first);
+static void sbuffer_segment_destroy(sbuffer_segment_t *segment);
+static void sbuffer_reclaim_segments(sbuffer_t *buffer);
+static void sbuffer_publish(sbuffer_t *buffer, size_t head);
+static void sbuffer_wake(sbuffer_reader_t *reader);
+static void sbuffer_park_producer(sbuffer_t *buffer, size_t head);
+static void sbuffer_wake_producer(sbuffer_t *buffer, size_t seq);
+static void sbuffer_copy_in(sbuffer_t *buffer, size_t seq, sensor_data_t *data, size_t count);
+static void sbuffer_copy_out(sbuffer_t *buffer, size_t seq, sensor_data_t *out, size_t count);
+
 int sbuffer_init(sbuffer_t **buffer) {
-    *buffer = malloc(sizeof(sbuffer_t));
-    if (*buffer == NULL) return SBUFFER_FAILURE;
-    (*buffer)->head = NULL;
-    (*buffer)->tail = NULL;
+    return sbuffer_init_capacity(buffer, SBUFFER_CAPACITY);
+}
 
-    (*buffer)->rwlock = malloc(sizeof(pthread_rwlock_t)); // initialize the rwlock
-    pthread_rwlock_init((*buffer)->rwlock,NULL);
+int sbuffer_init_capacity(sbuffer_t **buffer, size_t capacity) {
+    *buffer = NULL;
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) return SBUFFER_FAILURE;
+    *buffer = aligned_alloc(CACHE_LINE_SIZE, sizeof(sbuffer_t));
+    if (*buffer == NULL) return SBUFFER_FAILURE;
+    (*buffer)->slots = malloc(capacity * sizeof(sensor_data_t));
+    if ((*buffer)->slots == NULL) {
+        free(*buffer);
+        *buffer = NULL;
+        return SBUFFER_FAILURE;
+    }
+    (*buffer)->mask = capacity - 1;
+    (*buffer)->high_water = capacity;
+    (*buffer)->policy = SBUFFER_POLICY_BLOCK;
+    (*buffer)->spilling = 0;
+    (*buffer)->segments = NULL;
+    (*buffer)->last_segment = NULL;
+    (*buffer)->segment_id = 0;
+    atomic_init(&(*buffer)->segment_count, 0);
+    pthread_mutex_init(&(*buffer)->spill_lock, NULL);
+    atomic_init(&(*buffer)->blocked, 0);
+    atomic_init(&(*buffer)->dropped_oldest, 0);
+    atomic_init(&(*buffer)->dropped_newest, 0);
+    atomic_init(&(*buffer)->spilled, 0);
+    atomic_init(&(*buffer)->evicted, 0);
+    atomic_init(&(*buffer)->parked, 0);
+    atomic_init(&(*buffer)->producer_wake_at, 0);
+    atomic_init(&(*buffer)->producer_futex, 0);
+    atomic_init(&(*buffer)->closed, 0);
+    (*buffer)->max_lag = 0;
+    atomic_init(&(*buffer)->head.seq, 0);
+    atomic_init(&(*buffer)->tail.seq, 0);
+    for (int i = 0; i < SBUFFER_MAX_READERS; i++)
+    {
+        atomic_init(&(*buffer)->readers[i].seq, 0);
+        atomic_init(&(*buffer)->readers[i].state, READER_FREE);
+        atomic_init(&(*buffer)->readers[i].wake_at, 0);
+        atomic_init(&(*buffer)->readers[i].futex, 0);
+        atomic_init(&(*buffer)->readers[i].evicted_lag, 0);
+    }
+    pthread_mutex_init(&(*buffer)->register_lock, NULL);
 
     return SBUFFER_SUCCESS;
 }
 
 int sbuffer_free(sbuffer_t **buffer) {
-    sbuffer_node_t *dummy;
     if ((buffer == NULL) || (*buffer == NULL)) {
         return SBUFFER_FAILURE;
     }
-    pthread_rwlock_destroy((*buffer)->rwlock);
-    free((*buffer)->rwlock);
-
-    while ((*buffer)->head) {
-        dummy = (*buffer)->head;
-        (*buffer)->head = (*buffer)->head->next;
-        free(dummy);
+    pthread_mutex_destroy(&(*buffer)->register_lock);
+    while ((*buffer)->segments != NULL)
+    {
+        sbuffer_segment_t *segment = (*buffer)->segments;
+        (*buffer)->segments = segment->next;
+        sbuffer_segment_destroy(segment);
     }
+    pthread_mutex_destroy(&(*buffer)->spill_lock);
+    free((*buffer)->slots);
     free(*buffer);
     *buffer = NULL;
     return SBUFFER_SUCCESS;
 }
 
 int sbuffer_remove(sbuffer_t *buffer, sensor_data_t *data) {
-    sbuffer_node_t *dummy;
     if (buffer == NULL) return SBUFFER_FAILURE;
-    if (buffer->head == NULL) return SBUFFER_NO_DATA;
-    *data = buffer->head->data;
-    dummy = buffer->head;
-    if (buffer->head == buffer->tail) // buffer has only one node
-    {
-        buffer->head = buffer->tail = NULL;
-    } else  // buffer has many nodes empty
+    size_t tail = sbuffer_slowest_reader(buffer);
+    if (tail == atomic_load_explicit(&buffer->head.seq, memory_order_acquire)) return SBUFFER_NO_DATA;
+    sbuffer_fetch(buffer, tail, data, 1);
+    for (int i = 0; i < SBUFFER_MAX_READERS; i++)
     {
-        buffer->head = buffer->head->next;
+        if (atomic_load_explicit(&buffer->readers[i].state, memory_order_relaxed) != READER_ACTIVE) continue;
+        if (atomic_load_explicit(&buffer->readers[i].seq, memory_order_relaxed) == tail)
+            atomic_store_explicit(&buffer->readers[i].seq, tail + 1, memory_order_release);
     }
-    free(dummy);
+    atomic_store_explicit(&buffer->tail.seq, tail + 1, memory_order_release);
+    if (atomic_load_explicit(&buffer->segment_count, memory_order_relaxed) > 0) sbuffer_reclaim_segments(buffer);
     return SBUFFER_SUCCESS;
 }
 
 int sbuffer_insert(sbuffer_t *buffer, sensor_data_t *data) {
-    sbuffer_node_t *dummy;
-    if (buffer == NULL) return SBUFFER_FAILURE;
-    dummy = malloc(sizeof(sbuffer_node_t));
-    if (dummy == NULL) return SBUFFER_FAILURE;
-    dummy->data = *data;
-    dummy->next = NULL;
-    dummy->datamgr_read=0;
-    dummy->sensor_db_read=0;
+    return sbuffer_insert_batch(buffer, data, 1);
+}
 
-    pthread_rwlock_wrlock(buffer->rwlock);
+int sbuffer_insert_batch(sbuffer_t *buffer, sensor_data_t *data, size_t count) {
+    if (buffer == NULL || (data == NULL && count > 0)) return SBUFFER_FAILURE;
+    // only the producer writes head and tail, relaxed loads of its own cursors are enough
+    size_t head = atomic_load_explicit(&buffer->head.seq, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&buffer->tail.seq, memory_order_relaxed);
+    int waiting = 0;
 
-    if (buffer->tail == NULL) // buffer empty (buffer->head should also be NULL
+    // once spilling, stay on disk until the backlog fits in half the budget, so the ring and the segments don't alternate
+    if (buffer->spilling)
     {
-        buffer->head = buffer->tail = dummy;
-    } else // buffer not empty
+        if (head - sbuffer_slowest_reader(buffer) >= (buffer->high_water + 1) / 2) return sbuffer_spill(buffer, head, data, count);
+        buffer->spilling = 0;
+    }
+
+    while (count > 0)
     {
-        buffer->tail->next = dummy;
-        buffer->tail = buffer->tail->next;
+        // the buffer looks full: reclaim every slot the readers have passed
+        if (head - tail >= buffer->high_water)
+        {
+            tail = sbuffer_slowest_reader(buffer);
+            atomic_store_explicit(&buffer->tail.seq, tail, memory_order_relaxed);
+        }
+        // still at the high-water mark: apply the backpressure policy
+        if (head - tail >= buffer->high_water)
+        {
+            if (buffer->policy == SBUFFER_POLICY_DROP_NEWEST)
+            {
+                atomic_fetch_add_explicit(&buffer->dropped_newest, count, memory_order_relaxed);
+                return SBUFFER_DROPPED;
+            }
+            if (buffer->policy == SBUFFER_POLICY_SPILL)
+            {
+                buffer->spilling = 1;
+                return sbuffer_spill(buffer, head, data, count);
+            }
+            if (buffer->policy == SBUFFER_POLICY_DROP_OLDEST)
+            {
+                size_t room = (count < buffer->high_water) ? count : buffer->high_water;
+                tail = sbuffer_drop_oldest(buffer, tail, head + room - buffer->high_water);
+                atomic_store_explicit(&buffer->tail.seq, tail, memory_order_relaxed);
+                continue;
+            }
+            // SBUFFER_POLICY_BLOCK: wait for the slowest reader, count every wait once
+            if (!waiting) atomic_fetch_add_explicit(&buffer->blocked, 1, memory_order_relaxed);
+            if (buffer->max_lag > 0) sbuffer_evict_lagging(buffer, buffer->max_lag);
+            // poll the cursors for a short while, then sleep until the slowest reader moves
+            if (waiting++ < SBUFFER_SPIN) cpu_relax();
+            else sbuffer_park_producer(buffer, head);
+            continue;
+        }
+        waiting = 0;
+
+        size_t run = buffer->high_water - (head - tail);
+        if (run > count) run = count;
+        sbuffer_copy_in(buffer, head, data, run);
+        head += run;
+        data += run;
+        count -= run;
+        // publish the run: readers that see the new head also see the data
+        sbuffer_publish(buffer, head);
     }
-    pthread_rwlock_unlock(buffer->rwlock);
     return SBUFFER_SUCCESS;
 }
 
+int sbuffer_set_policy(sbuffer_t *buffer, int policy, size_t budget)
+{
+    if (buffer == NULL) return SBUFFER_FAILURE;
+    if (policy < SBUFFER_POLICY_BLOCK || policy > SBUFFER_POLICY_SPILL) return SBUFFER_FAILURE;
+    size_t high_water = budget / sizeof(sensor_data_t);
+    if (high_water == 0 || high_water > buffer->mask + 1) high_water = buffer->mask + 1;
+    buffer->policy = policy;
+    buffer->high_water = high_water;
+    return SBUFFER_SUCCESS;
+}
+
+void sbuffer_get_stats(sbuffer_t *buffer, sbuffer_stats_t *stats)
+{
+    if (buffer == NULL || stats == NULL) return;
+    stats->blocked = atomic_load_explicit(&buffer->blocked, memory_order_relaxed);
+    stats->dropped_oldest = atomic_load_explicit(&buffer->dropped_oldest, memory_order_relaxed);
+    stats->dropped_newest = atomic_load_explicit(&buffer->dropped_newest, memory_order_relaxed);
+    stats->spilled = atomic_load_explicit(&buffer->spilled, memory_order_relaxed);
+    stats->segments = atomic_load_explicit(&buffer->segment_count, memory_order_relaxed);
+    stats->evicted = atomic_load_explicit(&buffer->evicted, memory_order_relaxed);
+}
+
 int sbuffer_size(sbuffer_t *buffer)
 {
-    int size = 0;
     if (buffer == NULL) return -1;
-    pthread_rwlock_rdlock(buffer->rwlock);
-    if (buffer->head != NULL)
+    size_t head = atomic_load_explicit(&buffer->head.seq, memory_order_acquire);
+    return (int) (head - sbuffer_slowest_reader(buffer));
+}
+
+int sbuffer_read(sbuffer_t *buffer, int reader, sensor_data_t *data)
+{
+    int amount = sbuffer_read_batch(buffer, reader, data, 1);
+    if (amount < 0) return amount;
+    return (amount == 0) ? SBUFFER_NO_DATA : SBUFFER_SUCCESS;
+}
+
+int sbuffer_read_batch(sbuffer_t *buffer, int reader, sensor_data_t *out, size_t max)
+{
+    if (buffer == NULL || out == NULL) return SBUFFER_FAILURE;
+    if (reader < 0 || reader >= SBUFFER_MAX_READERS) return SBUFFER_FAILURE;
+    sbuffer_reader_t *r = &buffer->readers[reader];
+    int state = atomic_load_explicit(&r->state, memory_order_acquire);
+    if (state == READER_EVICTED) return SBUFFER_EVICTED;
+    if (state != READER_ACTIVE) return SBUFFER_FAILURE;
+    // every reader is served by one thread, only the drop-oldest policy moves its cursor as well
+    size_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+    for (;;)
     {
-        sbuffer_node_t *dummy = buffer->head;
-        while (dummy != NULL)
+        size_t available = atomic_load_explicit(&buffer->head.seq, memory_order_acquire) - seq;
+        if (available > max) available = max;
+        if (available == 0) return 0;
+        // the run stops at the border between the ring and a spill segment
+        available = sbuffer_fetch(buffer, seq, out, available);
+        // an evicted reader no longer protects its slots, so the copy may have been overwritten: check after copying
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&r->state, memory_order_relaxed) != READER_ACTIVE) return SBUFFER_EVICTED;
+        // release: the producer may only overwrite the slots after the copy above is done
+        if (atomic_compare_exchange_strong_explicit(&r->seq, &seq, seq + available,
+                                                    memory_order_release, memory_order_acquire))
         {
-            size++;
-            dummy = dummy->next;
+            if (atomic_load_explicit(&buffer->segment_count, memory_order_relaxed) > 0) sbuffer_reclaim_segments(buffer);
+            // pairs with the parking producer: we move the cursor and then read producer_wake_at, it does the reverse
+            atomic_thread_fence(memory_order_seq_cst);
+            sbuffer_wake_producer(buffer, seq);
+            return (int) available;
         }
+        // the producer dropped readings under us, 'seq' now holds the moved cursor: copy again from there
     }
-    pthread_rwlock_unlock(buffer->rwlock);
-    return size;
 }
 
-int datamgr_first_to_read(sbuffer_t *buffer, sensor_data_t *data)
+int sbuffer_unread(sbuffer_t *buffer, int reader)
 {
-    if (buffer == NULL) return -1;
-    if (buffer->head == NULL) return -1;
-    pthread_rwlock_wrlock(buffer->rwlock);
-    if(buffer->head->datamgr_read==1&&buffer->head->sensor_db_read==1)
+    if (buffer == NULL) return 0;
+    if (reader < 0 || reader >= SBUFFER_MAX_READERS) return 0;
+    if (atomic_load_explicit(&buffer->readers[reader].state, memory_order_acquire) != READER_ACTIVE) return 0;
+    size_t seq = atomic_load_explicit(&buffer->readers[reader].seq, memory_order_relaxed);
+    return (int) (atomic_load_explicit(&buffer->head.seq, memory_order_acquire) - seq);
+}
+
+int sbuffer_wait(sbuffer_t *buffer, int reader, size_t min_batch, int timeout_ms)
+{
+    if (buffer == NULL) return SBUFFER_FAILURE;
+    if (reader < 0 || reader >= SBUFFER_MAX_READERS) return SBUFFER_FAILURE;
+    sbuffer_reader_t *r = &buffer->readers[reader];
+    if (min_batch == 0) min_batch = 1;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+
+    for (int spin = 0; ; spin++)
     {
-        sensor_data_t *remove=malloc(sizeof(sensor_data_t));
-        sbuffer_remove(buffer,remove);
-        free(remove);
+        int state = atomic_load_explicit(&r->state, memory_order_acquire);
+        if (state == READER_EVICTED) return SBUFFER_EVICTED;
+        if (state != READER_ACTIVE) return SBUFFER_FAILURE;
+        size_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+        size_t unread = atomic_load_explicit(&buffer->head.seq, memory_order_acquire) - seq;
+        if (unread >= min_batch) return SBUFFER_SUCCESS;
+        if (atomic_load_explicit(&buffer->closed, memory_order_acquire))
+            return (unread > 0) ? SBUFFER_SUCCESS : SBUFFER_CLOSED;
+        if (spin < SBUFFER_SPIN)
+        {
+            cpu_relax();
+            continue;
+        }
+
+        // park: announce the threshold first, then check head again so a publish in between is never missed
+        struct timespec now, left;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left.tv_sec = deadline.tv_sec - now.tv_sec;
+        left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+        if (left.tv_nsec < 0) { left.tv_sec--; left.tv_nsec += 1000000000L; }
+        if (timeout_ms >= 0 && left.tv_sec < 0) return (unread > 0) ? SBUFFER_SUCCESS : SBUFFER_NO_DATA;
+
+        unsigned int futex = atomic_load(&r->futex);
+        atomic_store(&r->wake_at, seq + min_batch);
+        atomic_fetch_add(&buffer->parked, 1);
+        if (atomic_load(&buffer->head.seq) - seq < min_batch && !atomic_load(&buffer->closed))
+        {
+            syscall(SYS_futex, (unsigned int *) &r->futex, FUTEX_WAIT_PRIVATE, futex,
+                    (timeout_ms >= 0) ? &left : NULL, NULL, 0);
+        }
+        atomic_store(&r->wake_at, 0);
+        atomic_fetch_sub(&buffer->parked, 1);
+        spin = SBUFFER_SPIN - 1;    // go straight back to parking after a spurious wake-up
     }
-    
-    sbuffer_node_t *dummy = buffer->head;
-    while (dummy->datamgr_read ==1&&dummy->next!=NULL)
+}
+
+void sbuffer_close(sbuffer_t *buffer)
+{
+    if (buffer == NULL) return;
+    atomic_store(&buffer->closed, 1);
+    for (int i = 0; i < SBUFFER_MAX_READERS; i++) sbuffer_wake(&buffer->readers[i]);
+}
+
+int sbuffer_register_reader(sbuffer_t *buffer)
+{
+    int reader = SBUFFER_FAILURE;
+    if (buffer == NULL) return SBUFFER_FAILURE;
+    pthread_mutex_lock(&buffer->register_lock);
+    for (int i = 0; i < SBUFFER_MAX_READERS; i++)
     {
-        dummy = dummy->next;
+        if (atomic_load_explicit(&buffer->readers[i].state, memory_order_relaxed) != READER_FREE) continue;
+        // start at head: the new reader only sees what is inserted from now on
+        atomic_store(&buffer->readers[i].seq, atomic_load(&buffer->head.seq));
+        atomic_store(&buffer->readers[i].evicted_lag, 0);
+        atomic_store(&buffer->readers[i].state, READER_ACTIVE);
+        reader = i;
+        break;
     }
-    dummy->datamgr_read = 1;
-    pthread_rwlock_unlock(buffer->rwlock);
-    data->id = dummy->data.id;
-    data->ts = dummy->data.ts;
-    data->value = dummy->data.value;
-    
-    return 1;
+    pthread_mutex_unlock(&buffer->register_lock);
+    return reader;
 }
 
-int sensor_db_first_to_read(sbuffer_t *buffer, sensor_data_t *data)
+int sbuffer_unregister_reader(sbuffer_t *buffer, int reader)
 {
-    if (buffer == NULL) return -1;
-    if (buffer->head == NULL) return -1;
-    pthread_rwlock_wrlock(buffer->rwlock);
-    if(buffer->head->datamgr_read==1&&buffer->head->sensor_db_read==1)
+    if (buffer == NULL) return SBUFFER_FAILURE;
+    if (reader < 0 || reader >= SBUFFER_MAX_READERS) return SBUFFER_FAILURE;
+    pthread_mutex_lock(&buffer->register_lock);
+    int state = atomic_exchange(&buffer->readers[reader].state, READER_FREE);
+    pthread_mutex_unlock(&buffer->register_lock);
+    // the reader no longer holds back its slots
+    atomic_thread_fence(memory_order_seq_cst);
+    sbuffer_wake_producer(buffer, 0);
+    return (state == READER_FREE) ? SBUFFER_FAILURE : SBUFFER_SUCCESS;
+}
+
+int sbuffer_evict_reader(sbuffer_t *buffer, int reader)
+{
+    if (buffer == NULL) return SBUFFER_FAILURE;
+    if (reader < 0 || reader >= SBUFFER_MAX_READERS) return SBUFFER_FAILURE;
+    sbuffer_reader_t *r = &buffer->readers[reader];
+    int expected = READER_ACTIVE;
+    size_t lag = atomic_load_explicit(&buffer->head.seq, memory_order_acquire) - atomic_load_explicit(&r->seq, memory_order_acquire);
+    if (!atomic_compare_exchange_strong(&r->state, &expected, READER_EVICTED)) return SBUFFER_FAILURE;
+    // the producer only counts, the reader reports its eviction when it next reads
+    atomic_store_explicit(&r->evicted_lag, lag, memory_order_relaxed);
+    atomic_fetch_add_explicit(&buffer->evicted, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    sbuffer_wake_producer(buffer, 0);
+    return SBUFFER_SUCCESS;
+}
+
+int sbuffer_evict_lagging(sbuffer_t *buffer, size_t max_lag)
+{
+    int evicted = 0;
+    if (buffer == NULL) return 0;
+    size_t head = atomic_load_explicit(&buffer->head.seq, memory_order_acquire);
+    for (int i = 0; i < SBUFFER_MAX_READERS; i++)
+    {
+        if (atomic_load_explicit(&buffer->readers[i].state, memory_order_relaxed) != READER_ACTIVE) continue;
+        size_t lag = head - atomic_load_explicit(&buffer->readers[i].seq, memory_order_acquire);
+        if (lag < max_lag) continue;
+        if (sbuffer_evict_reader(buffer, i) == SBUFFER_SUCCESS) evicted++;
+    }
+    return evicted;
+}
+
+size_t sbuffer_evicted_lag(sbuffer_t *buffer, int reader)
+{
+    if (buffer == NULL) return 0;
+    if (reader < 0 || reader >= SBUFFER_MAX_READERS) return 0;
+    return atomic_load_explicit(&buffer->readers[reader].evicted_lag, memory_order_relaxed);
+}
+
+void sbuffer_set_max_lag(sbuffer_t *buffer, size_t max_lag)
+{
+    if (buffer != NULL) buffer->max_lag = max_lag;
+}
+
+/**
+ * Returns the cursor of the active reader that is furthest behind, every slot before it can be reclaimed
+ * Without active readers nothing is held back and head is returned
+ */
+static size_t sbuffer_slowest_reader(sbuffer_t *buffer)
+{
+    size_t head = atomic_load_explicit(&buffer->head.seq, memory_order_acquire);
+    size_t slowest = head;
+    for (int i = 0; i < SBUFFER_MAX_READERS; i++)
     {
-        sensor_data_t *remove=malloc(sizeof(sensor_data_t));
-        sbuffer_remove(buffer,remove);
-        free(remove);
+        if (atomic_load(&buffer->readers[i].state) != READER_ACTIVE) continue;
+        size_t seq = atomic_load_explicit(&buffer->readers[i].seq, memory_order_acquire);
+        if (head - seq > head - slowest) slowest = seq;
     }
-    sbuffer_node_t *dummy = buffer->head;
-    while (dummy->sensor_db_read ==1&&dummy->next!=NULL)
+    return slowest;
+}
+
+/**
+ * Makes readings up to sequence 'head' visible and wakes the parked readers whose threshold is reached
+ */
+static void sbuffer_publish(sbuffer_t *buffer, size_t head)
+{
+    atomic_store_explicit(&buffer->head.seq, head, memory_order_release);
+    // pairs with the parking reader: it stores wake_at and then reads head, we store head and then read wake_at
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&buffer->parked, memory_order_relaxed) == 0) return;
+    for (int i = 0; i < SBUFFER_MAX_READERS; i++)
     {
-        dummy = dummy->next;
+        size_t wake_at = atomic_load_explicit(&buffer->readers[i].wake_at, memory_order_relaxed);
+        if (wake_at == 0 || (ptrdiff_t) (head - wake_at) < 0) continue;
+        // only the first publish past the threshold pays for the syscall
+        if (atomic_compare_exchange_strong(&buffer->readers[i].wake_at, &wake_at, 0)) sbuffer_wake(&buffer->readers[i]);
     }
-    dummy->sensor_db_read = 1;
-    pthread_rwlock_unlock(buffer->rwlock);
-    data->id = dummy->data.id;
-    data->ts = dummy->data.ts;
-    data->value = dummy->data.value;
-    return 1;
 }
 
-int datamgr_unread_amount(sbuffer_t *buffer)
+/**
+ * Wakes 'reader' if it is parked
+ */
+static void sbuffer_wake(sbuffer_reader_t *reader)
 {
-    int amount = 0;
-    if (buffer == NULL) return 0;
-    pthread_rwlock_rdlock(buffer->rwlock);
-    if (buffer->head != NULL)
+    atomic_fetch_add(&reader->futex, 1);
+    syscall(SYS_futex, (unsigned int *) &reader->futex, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/**
+ * Parks the producer, blocked with 'head' at the high-water mark, until the slowest reader moves its cursor
+ * With a max lag it wakes up every SBUFFER_BLOCK_PARK_MS as well, so the caller can evict the lagging readers
+ */
+static void sbuffer_park_producer(sbuffer_t *buffer, size_t head)
+{
+    const struct timespec timeout = { 0, SBUFFER_BLOCK_PARK_MS * 1000000L };
+    unsigned int futex = atomic_load(&buffer->producer_futex);
+    // announce the cursor we wait on first, then check the cursors again so a read in between is never missed
+    atomic_store(&buffer->producer_wake_at, sbuffer_slowest_reader(buffer) + 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (head - sbuffer_slowest_reader(buffer) >= buffer->high_water)
+    {
+        syscall(SYS_futex, (unsigned int *) &buffer->producer_futex, FUTEX_WAIT_PRIVATE, futex,
+                (buffer->max_lag > 0) ? &timeout : NULL, NULL, 0);
+    }
+    atomic_store(&buffer->producer_wake_at, 0);
+}
+
+/**
+ * Wakes the parked producer if a reader moved its cursor away from 'seq', the sequence the producer waits on or before it
+ * A 'seq' of 0 always wakes it, for readers that leave without reading
+ */
+static void sbuffer_wake_producer(sbuffer_t *buffer, size_t seq)
+{
+    size_t wake_at = atomic_load_explicit(&buffer->producer_wake_at, memory_order_relaxed);
+    if (wake_at == 0 || (seq != 0 && (ptrdiff_t) (seq - wake_at) >= 0)) return;
+    // only the first reader past the threshold pays for the syscall
+    if (!atomic_compare_exchange_strong(&buffer->producer_wake_at, &wake_at, 0)) return;
+    atomic_fetch_add(&buffer->producer_futex, 1);
+    syscall(SYS_futex, (unsigned int *) &buffer->producer_futex, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/**
+ * Moves every active reader that is still before 'new_tail' up to 'new_tail' (drop-oldest policy)
+ * \return the new tail, the readings between 'tail' and it are lost for the lagging readers
+ */
+static size_t sbuffer_drop_oldest(sbuffer_t *buffer, size_t tail, size_t new_tail)
+{
+    for (int i = 0; i < SBUFFER_MAX_READERS; i++)
     {
-        sbuffer_node_t *dummy = buffer->head;
-        while (dummy != NULL)
+        if (atomic_load(&buffer->readers[i].state) != READER_ACTIVE) continue;
+        size_t seq = atomic_load_explicit(&buffer->readers[i].seq, memory_order_acquire);
+        // the reader may move its own cursor at the same time, only ever move it forward
+        while (new_tail - seq <= buffer->mask + 1 && seq != new_tail &&
+               !atomic_compare_exchange_weak_explicit(&buffer->readers[i].seq, &seq, new_tail,
+                                                      memory_order_acq_rel, memory_order_acquire));
+    }
+    atomic_fetch_add_explicit(&buffer->dropped_oldest, new_tail - tail, memory_order_relaxed);
+    return new_tail;
+}
+
+/**
+ * Appends 'count' readings with sequence 'head' onwards to the spill segments and publishes them (spill policy)
+ */
+static int sbuffer_spill(sbuffer_t *buffer, size_t head, sensor_data_t *data, size_t count)
+{
+    size_t spilled = count;
+    pthread_mutex_lock(&buffer->spill_lock);
+    while (count > 0)
+    {
+        sbuffer_segment_t *segment = buffer->last_segment;
+        // a segment only holds consecutive sequences, start a new one when full or when the ring was used in between
+        if (segment == NULL || segment->first + segment->count != head || segment->count == SBUFFER_SEGMENT_RECORDS)
         {
-            if(dummy->datamgr_read==0) amount++;
-            dummy = dummy->next;
+            segment = sbuffer_segment_create(buffer, head);
+            if (segment == NULL)
+            {
+                pthread_mutex_unlock(&buffer->spill_lock);
+                sbuffer_publish(buffer, head);
+                atomic_fetch_add_explicit(&buffer->spilled, spilled - count, memory_order_relaxed);
+                return SBUFFER_FAILURE;
+            }
         }
+        size_t run = SBUFFER_SEGMENT_RECORDS - segment->count;
+        if (run > count) run = count;
+        memcpy(&segment->records[segment->count], data, run * sizeof(sensor_data_t));
+        segment->count += run;
+        head += run;
+        data += run;
+        count -= run;
     }
-    pthread_rwlock_unlock(buffer->rwlock);
-    return amount;
+    pthread_mutex_unlock(&buffer->spill_lock);
+    // readers that see the new head find the readings in the segments
+    sbuffer_publish(buffer, head);
+    atomic_fetch_add_explicit(&buffer->spilled, spilled, memory_order_relaxed);
+    return SBUFFER_SUCCESS;
 }
 
-int sensor_db_unread_amount(sbuffer_t *buffer)
+/**
+ * Copies up to 'count' readings starting at sequence 'seq' into 'out', either from the ring or from one spill segment
+ * \return the amount of readings copied, less than 'count' when the run crosses a ring/segment border
+ */
+static size_t sbuffer_fetch(sbuffer_t *buffer, size_t seq, sensor_data_t *out, size_t count)
 {
-    int amount = 0;
-    if (buffer == NULL) return 0;
-    pthread_rwlock_rdlock(buffer->rwlock);
-    if (buffer->head != NULL)
+    if (atomic_load_explicit(&buffer->segment_count, memory_order_acquire) > 0)
     {
-        sbuffer_node_t *dummy = buffer->head;
-        while (dummy != NULL)
+        pthread_mutex_lock(&buffer->spill_lock);
+        for (sbuffer_segment_t *segment = buffer->segments; segment != NULL; segment = segment->next)
         {
-            if(dummy->sensor_db_read==0) amount++;
-            dummy = dummy->next;
+            if (seq - segment->first < segment->count)
+            {
+                size_t run = segment->first + segment->count - seq;
+                if (run > count) run = count;
+                memcpy(out, &segment->records[seq - segment->first], run * sizeof(sensor_data_t));
+                pthread_mutex_unlock(&buffer->spill_lock);
+                return run;
+            }
+            // the ring holds everything up to the next segment
+            if (segment->first - seq < count)
+            {
+                count = segment->first - seq;
+                break;
+            }
         }
+        pthread_mutex_unlock(&buffer->spill_lock);
+    }
+    sbuffer_copy_out(buffer, seq, out, count);
+    return count;
+}
+
+/**
+ * Creates and maps a new segment file that starts at sequence 'first' and appends it to the segment list
+ * The caller holds spill_lock
+ */
+static sbuffer_segment_t *sbuffer_segment_create(sbuffer_t *buffer, size_t first)
+{
+    size_t size = SBUFFER_SEGMENT_RECORDS * sizeof(sensor_data_t);
+    sbuffer_segment_t *segment = malloc(sizeof(sbuffer_segment_t));
+    if (segment == NULL) return NULL;
+    if (asprintf(&segment->path, SBUFFER_SPILL_DIR"/sbuffer-%u.seg", buffer->segment_id++) == -1)
+    {
+        free(segment);
+        return NULL;
+    }
+    segment->fd = open(segment->path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (segment->fd == -1 || ftruncate(segment->fd, size) == -1)
+    {
+        perror("sbuffer: spill segment");
+        segment->records = MAP_FAILED;
+        sbuffer_segment_destroy(segment);
+        return NULL;
+    }
+    segment->records = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if (segment->records == MAP_FAILED)
+    {
+        perror("sbuffer: spill segment");
+        sbuffer_segment_destroy(segment);
+        return NULL;
     }
-    pthread_rwlock_unlock(buffer->rwlock);
-    return amount;
-}
\ No newline at end of file
+    segment->first = first;
+    segment->count = 0;
+    segment->next = NULL;
+    if (buffer->last_segment != NULL) buffer->last_segment->next = segment;
+    else buffer->segments = segment;
+    buffer->last_segment = segment;
+    atomic_fetch_add_explicit(&buffer->segment_count, 1, memory_order_release);
+    return segment;
+}
+
+/**
+ * Unmaps, closes and deletes the file of 'segment', the segment must already be unlinked from the list
+ */
+static void sbuffer_segment_destroy(sbuffer_segment_t *segment)
+{
+    if (segment->records != MAP_FAILED) munmap(segment->records, SBUFFER_SEGMENT_RECORDS * sizeof(sensor_data_t));
+    if (segment->fd != -1) close(segment->fd);
+    unlink(segment->path);
+    free(segment->path);
+    free(segment);
+}
+
+/**
+ * Deletes every spill segment that all active readers have read past
+ */
+static void sbuffer_reclaim_segments(sbuffer_t *buffer)
+{
+    size_t slowest = sbuffer_slowest_reader(buffer);
+    pthread_mutex_lock(&buffer->spill_lock);
+    while (buffer->segments != NULL)
+    {
+        sbuffer_segment_t *segment = buffer->segments;
+        size_t end = segment->first + segment->count;
+        if ((ptrdiff_t) (slowest - end) < 0) break;
+        buffer->segments = segment->next;
+        if (buffer->last_segment == segment) buffer->last_segment = NULL;
+        atomic_fetch_sub_explicit(&buffer->segment_count, 1, memory_order_relaxed);
+        sbuffer_segment_destroy(segment);
+    }
+    pthread_mutex_unlock(&buffer->spill_lock);
+}
+
+/**
+ * Copies 'count' readings into the ring starting at sequence 'seq', in at most two pieces when the run wraps
+ */
+static void sbuffer_copy_in(sbuffer_t *buffer, size_t seq, sensor_data_t *data, size_t count)
+{
+    size_t first = seq & buffer->mask;
+    size_t part = buffer->mask + 1 - first;
+    if (part > count) part = count;
+    memcpy(&buffer->slots[first], data, part * sizeof(sensor_data_t));
+    memcpy(buffer->slots, data + part, (count - part) * sizeof(sensor_data_t));
+}
+
+/**
+ * Copies 'count' readings out of the ring starting at sequence 'seq', in at most two pieces when the run wraps
+ */
+static void sbuffer_copy_out(sbuffer_t *buffer, size_t seq, sensor_data_t *out, size_t count)
+{
+    size_t first = seq & buffer->mask;
+    size_t part = buffer->mask + 1 - first;
+    if (part > count) part = count;
+    memcpy(out, &buffer->slots[first], part * sizeof(sensor_data_t));
+    memcpy(out + part, buffer->slots, (count - part) * sizeof(sensor_data_t));
+}
@@ -7,12 +7,91 @@
 
 #include "config.h"
 
+/*
+ * Errors are negative, so sbuffer_read_batch() can return them next to an amount of readings
+ */
 #define SBUFFER_FAILURE -1
+#define SBUFFER_EVICTED -2
 #define SBUFFER_SUCCESS 0
 #define SBUFFER_NO_DATA 1
+#define SBUFFER_DROPPED 2
+#define SBUFFER_CLOSED 3
+
+/*
+ * Number of readings the ring can hold before the producer has to wait for the slowest consumer
+ * Must be a power of two, can be overruled at compile time with -DSBUFFER_CAPACITY=...
+ */
+#ifndef SBUFFER_CAPACITY
+#define SBUFFER_CAPACITY 65536
+#endif
+
+#if (SBUFFER_CAPACITY & (SBUFFER_CAPACITY - 1)) != 0
+#error SBUFFER_CAPACITY must be a power of two
+#endif
+
+/*
+ * Amount of readings the consumers move per sbuffer_read_batch() call
+ */
+#ifndef SBUFFER_BATCH_SIZE
+#define SBUFFER_BATCH_SIZE 256
+#endif
+
+/*
+ * What the producer does when the buffer reaches its high-water mark, see sbuffer_set_policy()
+ */
+#define SBUFFER_POLICY_BLOCK        0   // wait until the slowest reader frees room
+#define SBUFFER_POLICY_DROP_OLDEST  1   // move lagging readers forward, the oldest readings are lost for them
+#define SBUFFER_POLICY_DROP_NEWEST  2   // refuse the readings that don't fit
+#define SBUFFER_POLICY_SPILL        3   // write the readings that don't fit to disk segments, readers replay them in order
+
+/*
+ * Spill segments are memory-mapped files of SBUFFER_SEGMENT_RECORDS packed sensor_data_t in SBUFFER_SPILL_DIR,
+ * a segment is deleted as soon as every registered reader has read past it
+ */
+#ifndef SBUFFER_SPILL_DIR
+#define SBUFFER_SPILL_DIR "."
+#endif
+
+#ifndef SBUFFER_SEGMENT_RECORDS
+#define SBUFFER_SEGMENT_RECORDS 65536
+#endif
+
+/*
+ * Amount of times sbuffer_wait() and a producer blocked by the block policy poll the cursors before they park the thread
+ */
+#ifndef SBUFFER_SPIN
+#define SBUFFER_SPIN 200
+#endif
+
+/*
+ * Milliseconds after which a producer parked by the block policy wakes up on its own to evict lagging readers,
+ * only with a max lag (see sbuffer_set_max_lag()). Otherwise it sleeps until a reader frees room
+ */
+#ifndef SBUFFER_BLOCK_PARK_MS
+#define SBUFFER_BLOCK_PARK_MS 10
+#endif
+
+/*
+ * Maximum amount of readers that can be registered on one buffer at the same time
+ */
+#ifndef SBUFFER_MAX_READERS
+#define SBUFFER_MAX_READERS 8
+#endif
 
 typedef struct sbuffer sbuffer_t;
 
+/**
+ * Counters of how often the backpressure policy kicked in, see sbuffer_get_stats()
+ */
+typedef struct {
+    size_t blocked;             /**< times the producer had to wait at the high-water mark */
+    size_t dropped_oldest;      /**< readings that were skipped for lagging readers */
+    size_t dropped_newest;      /**< readings that were refused */
+    size_t spilled;             /**< readings that were written to disk */
+    size_t segments;            /**< spill segments that are currently on disk */
+    size_t evicted;             /**< readers that were evicted */
+} sbuffer_stats_t;
+
 /**
  * Allocates and initializes a new shared buffer
  * \param buffer a double pointer to the buffer that needs to be initialized
@@ -20,6 +99,14 @@ typedef struct sbuffer sbuffer_t;
  */
 int sbuffer_init(sbuffer_t **buffer);
 
+/**
+ * Allocates and initializes a new shared buffer whose ring holds 'capacity' readings instead of SBUFFER_CAPACITY
+ * \param buffer a double pointer to the buffer that needs to be initialized
+ * \param capacity the amount of slots in the ring, a power of two
+ * \return SBUFFER_SUCCESS on success and SBUFFER_FAILURE if 'capacity' is not a power of two or an error occurred
+ */
+int sbuffer_init_capacity(sbuffer_t **buffer, size_t capacity);
+
 /**
  * All allocated resources are freed and cleaned up
  * \param buffer a double pointer to the buffer that needs to be freed
@@ -28,8 +115,9 @@ int sbuffer_init(sbuffer_t **buffer);
 int sbuffer_free(sbuffer_t **buffer);
 
 /**
- * Removes the first sensor data in 'buffer' (at the 'head') and returns this sensor data as '*data'
+ * Removes the oldest sensor data in 'buffer' for every registered reader and returns this sensor data as '*data'
  * If 'buffer' is empty, the function doesn't block until new sensor data becomes available but returns SBUFFER_NO_DATA
+ * Must not run concurrently with the producer or any reader
  * \param buffer a pointer to the buffer that is used
  * \param data a pointer to pre-allocated sensor_data_t space, the data will be copied into this structure. No new memory is allocated for 'data' in this function.
  * \return SBUFFER_SUCCESS on success and SBUFFER_FAILURE if an error occurred
@@ -38,18 +126,137 @@ int sbuffer_remove(sbuffer_t *buffer, sensor_data_t *data);
 
 /**
  * Inserts the sensor data in 'data' at the end of 'buffer' (at the 'tail')
+ * Only one thread may insert at a time. At the high-water mark the backpressure policy of 'buffer' is applied,
+ * readings that are spilled by the policy still count as a successful insert
  * \param buffer a pointer to the buffer that is used
  * \param data a pointer to sensor_data_t data, that will be copied into the buffer
- * \return SBUFFER_SUCCESS on success and SBUFFER_FAILURE if an error occured
+ * \return SBUFFER_SUCCESS on success, SBUFFER_DROPPED if the drop-newest policy refused the reading
+ * and SBUFFER_FAILURE if an error occured
 */
 int sbuffer_insert(sbuffer_t *buffer, sensor_data_t *data);
 
+/**
+ * Inserts 'count' sensor data from the array 'data' at the end of 'buffer'
+ * The readings are published with one atomic store for every run that fits in the free part of the ring
+ * Only one thread may insert at a time. At the high-water mark the backpressure policy of 'buffer' is applied
+ * \param buffer a pointer to the buffer that is used
+ * \param data an array of 'count' sensor_data_t, that will be copied into the buffer
+ * \param count the amount of readings in 'data'
+ * \return SBUFFER_SUCCESS on success, SBUFFER_DROPPED if the drop-newest policy refused some of the readings
+ * (the ones before them are inserted, the refused ones are counted in sbuffer_stats_t) and SBUFFER_FAILURE if an error occured
+ */
+int sbuffer_insert_batch(sbuffer_t *buffer, sensor_data_t *data, size_t count);
+
+/**
+ * Sets the memory budget of 'buffer' and the policy that is applied when it is used up
+ * Must be called before the producer starts. The default is SBUFFER_POLICY_BLOCK with the whole ring as budget
+ * \param buffer a pointer to the buffer that is used
+ * \param policy one of the SBUFFER_POLICY_* values
+ * \param budget the amount of bytes of readings the buffer may hold, 0 or more than the ring means the whole ring
+ * \return SBUFFER_SUCCESS on success and SBUFFER_FAILURE if 'policy' is unknown
+ */
+int sbuffer_set_policy(sbuffer_t *buffer, int policy, size_t budget);
+
+/**
+ * Copies the backpressure counters of 'buffer' into '*stats'
+ */
+void sbuffer_get_stats(sbuffer_t *buffer, sbuffer_stats_t *stats);
+
+/**
+ * Returns the amount of readings that are still held by the buffer (not yet read by every registered reader)
+ */
 int sbuffer_size(sbuffer_t *buffer);
 
-int datamgr_first_to_read(sbuffer_t *buffer, sensor_data_t *data);
-int sensor_db_first_to_read(sbuffer_t *buffer, sensor_data_t *data);
-int datamgr_unread_amount(sbuffer_t *buffer);
-int sensor_db_unread_amount(sbuffer_t *buffer);
+/**
+ * Registers a new reader with its own cursor, the reader only sees readings that are inserted after registration
+ * Every reader must be served by a single thread
+ * \param buffer a pointer to the buffer that is used
+ * \return the id of the new reader, or SBUFFER_FAILURE if SBUFFER_MAX_READERS readers are registered already
+ */
+int sbuffer_register_reader(sbuffer_t *buffer);
+
+/**
+ * Unregisters 'reader', its cursor no longer holds back reclamation and the id can be handed out again
+ * \param buffer a pointer to the buffer that is used
+ * \param reader an id returned by sbuffer_register_reader()
+ * \return SBUFFER_SUCCESS on success and SBUFFER_FAILURE if 'reader' is not registered
+ */
+int sbuffer_unregister_reader(sbuffer_t *buffer, int reader);
+
+/**
+ * Evicts 'reader': its cursor no longer holds back reclamation and every further read returns SBUFFER_EVICTED
+ * The id stays taken until the reader calls sbuffer_unregister_reader()
+ * \param buffer a pointer to the buffer that is used
+ * \param reader an id returned by sbuffer_register_reader()
+ * \return SBUFFER_SUCCESS on success and SBUFFER_FAILURE if 'reader' is not an active reader
+ */
+int sbuffer_evict_reader(sbuffer_t *buffer, int reader);
+
+/**
+ * Evicts every active reader that has 'max_lag' or more unread readings
+ * \param buffer a pointer to the buffer that is used
+ * \param max_lag the lag from which a reader is considered too slow
+ * \return the amount of evicted readers
+ */
+int sbuffer_evict_lagging(sbuffer_t *buffer, size_t max_lag);
+
+/**
+ * Returns the amount of readings 'reader' was behind when it was evicted, 0 if it was never evicted
+ * The producer doesn't print anything when it evicts a reader, the reader can report it with this
+ */
+size_t sbuffer_evicted_lag(sbuffer_t *buffer, int reader);
+
+/**
+ * When 'max_lag' is not 0, a blocked producer evicts readers that are 'max_lag' or more readings behind,
+ * instead of waiting for them forever. By default no reader is ever evicted
+ */
+void sbuffer_set_max_lag(sbuffer_t *buffer, size_t max_lag);
+
+/**
+ * Copies the next unread sensor data of 'reader' into '*data' and advances the cursor of 'reader'
+ * Every reader must be served by a single thread
+ * \param buffer a pointer to the buffer that is used
+ * \param reader an id returned by sbuffer_register_reader()
+ * \param data a pointer to pre-allocated sensor_data_t space
+ * \return SBUFFER_SUCCESS on success, SBUFFER_NO_DATA if 'reader' has read everything, SBUFFER_EVICTED if 'reader' was evicted
+ * and SBUFFER_FAILURE if an error occurred
+ */
+int sbuffer_read(sbuffer_t *buffer, int reader, sensor_data_t *data);
+
+/**
+ * Copies up to 'max' unread sensor data of 'reader' into the array 'out' and advances the cursor of 'reader' past them
+ * Every reader must be served by a single thread
+ * \param buffer a pointer to the buffer that is used
+ * \param reader an id returned by sbuffer_register_reader()
+ * \param out a pre-allocated array that can hold 'max' sensor_data_t
+ * \param max the maximum amount of readings to copy
+ * \return the amount of readings copied (0 if there is nothing to read), SBUFFER_FAILURE if an error occurred
+ * and SBUFFER_EVICTED if 'reader' was evicted
+ */
+int sbuffer_read_batch(sbuffer_t *buffer, int reader, sensor_data_t *out, size_t max);
+
+/**
+ * Returns the amount of readings 'reader' has not read yet, or 0 if 'reader' is not an active reader
+ */
+int sbuffer_unread(sbuffer_t *buffer, int reader);
+
+/**
+ * Waits until 'reader' has at least 'min_batch' unread readings, 'timeout_ms' milliseconds passed or 'buffer' is closed
+ * The cursors are polled SBUFFER_SPIN times before the thread is parked on a futex. The producer only makes
+ * a wake-up syscall for a parked reader, and only once its threshold is reached
+ * \param buffer a pointer to the buffer that is used
+ * \param reader an id returned by sbuffer_register_reader()
+ * \param min_batch the amount of unread readings to wait for, 1 wakes on every empty to non-empty transition
+ * \param timeout_ms the deadline in milliseconds, a negative value waits without deadline
+ * \return SBUFFER_SUCCESS if there is something to read, SBUFFER_NO_DATA on timeout with nothing to read,
+ * SBUFFER_CLOSED if 'buffer' is closed and 'reader' has read everything, SBUFFER_EVICTED or SBUFFER_FAILURE
+ */
+int sbuffer_wait(sbuffer_t *buffer, int reader, size_t min_batch, int timeout_ms);
+
+/**
+ * Tells the readers that the producer is done: they drain what is left and then sbuffer_wait() returns SBUFFER_CLOSED
+ */
+void sbuffer_close(sbuffer_t *buffer);
 
 
 
@@ -70,6 +70,52 @@ int insert_sensor(DBCONN *conn, sensor_id_t id, sensor_value_t value, sensor_ts_
     return 0;
 }
 
+int insert_sensor_batch(DBCONN *conn, sensor_data_t *data, int count)
+{
+    sqlite3_stmt *stmt;
+    char *err_msg = 0;
+    if (count <= 0) return 0;
+    // one transaction per batch: sqlite syncs the journal once instead of once per reading
+    int rc = sqlite3_exec(conn, "BEGIN TRANSACTION;", 0, 0, &err_msg);
+    if (rc != SQLITE_OK)
+    {
+        fprintf(stderr, "SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    rc = sqlite3_prepare_v2(conn, "INSERT INTO "TO_STRING(TABLE_NAME)"(sensor_id, sensor_value, timestamp) VALUES(?, ?, ?);", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+    {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(conn));
+        sqlite3_exec(conn, "ROLLBACK;", 0, 0, NULL);
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        sqlite3_bind_int(stmt, 1, data[i].id);
+        sqlite3_bind_double(stmt, 2, data[i].value);
+        sqlite3_bind_int64(stmt, 3, data[i].ts);
+        rc = sqlite3_step(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(conn));
+            sqlite3_finalize(stmt);
+            sqlite3_exec(conn, "ROLLBACK;", 0, 0, NULL);
+            return -1;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    rc = sqlite3_exec(conn, "COMMIT;", 0, 0, &err_msg);
+    if (rc != SQLITE_OK)
+    {
+        fprintf(stderr, "SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    return 0;
+}
+
 int insert_sensor_from_file(DBCONN *conn, FILE *sensor_data)
 {
     
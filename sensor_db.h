@@ -51,6 +51,15 @@ void disconnect(DBCONN *conn);
  */
 int insert_sensor(DBCONN *conn, sensor_id_t id, sensor_value_t value, sensor_ts_t ts);
 
+/**
+ * Insert 'count' sensor measurements with one prepared INSERT statement inside a single transaction
+ * \param conn pointer to the current connection
+ * \param data an array of 'count' sensor measurements
+ * \param count the amount of measurements in 'data'
+ * \return zero for success, and non-zero if an error occurs
+ */
+int insert_sensor_batch(DBCONN *conn, sensor_data_t *data, int count);
+
 /**
  * Write an INSERT query to insert all sensor measurements available in the file 'sensor_data'
  * \param conn pointer to the current connection
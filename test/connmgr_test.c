@@ -0,0 +1,464 @@
+/**
+ * \author Zeping Zhang
+ */
+
+// the decoder and the UDP listener are private to the connection manager, so the test is built together with it
+#include "connmgr.c"
+#include "test.h"
+
+sbuffer_t *sbuffer;
+int connection_end;
+pthread_rwlock_t *flag_lock;
+
+void fifo_log(char *log)
+{
+    free(log);
+}
+
+/**
+ * Writes 'count' records with the ids 'first' on into 'record', the way a sensor node sends them
+ * \return the size of the records
+ */
+static size_t put_records(unsigned char *record, int count, int first)
+{
+    for (int i = 0; i < count; i++, record += CONNMGR_RECORD_SIZE)
+    {
+        sensor_id_t id = first + i;
+        sensor_value_t value = first + i;
+        sensor_ts_t ts = first + i;
+        memcpy(record, &id, sizeof(sensor_id_t));
+        memcpy(record + sizeof(sensor_id_t), &value, sizeof(sensor_value_t));
+        memcpy(record + sizeof(sensor_id_t) + sizeof(sensor_value_t), &ts, sizeof(sensor_ts_t));
+    }
+    return count * CONNMGR_RECORD_SIZE;
+}
+
+/**
+ * Appends 'value' to 'p' as a LEB128 varint, returns the position behind it
+ */
+static unsigned char *put_varint(unsigned char *p, uint64_t value)
+{
+    do {
+        *p = value & 0x7f;
+        value >>= 7;
+        if (value != 0) *p |= 0x80;
+        p++;
+    } while (value != 0);
+    return p;
+}
+
+/**
+ * Writes a v2 frame of 'count' readings into 'frame', with 'declared' readings in its header
+ * \return the size of the frame
+ */
+static size_t put_frame(unsigned char *frame, const sensor_data_t *data, unsigned int count, unsigned int declared)
+{
+    unsigned char *p = frame + CONNMGR_V2_HEADER;
+    int64_t ts = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        uint64_t bits;
+        memcpy(&bits, &data[i].value, sizeof(uint64_t));
+        bits = htole64(bits);
+        p = put_varint(p, data[i].id);
+        memcpy(p, &bits, sizeof(uint64_t));
+        p += sizeof(uint64_t);
+        int64_t delta = (int64_t) data[i].ts - ts;
+        p = put_varint(p, ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63));
+        ts = data[i].ts;
+    }
+    size_t payload = p - frame - CONNMGR_V2_HEADER;
+    frame[0] = CONNMGR_V2_MAGIC0;
+    frame[1] = CONNMGR_V2_MAGIC1;
+    frame[2] = CONNMGR_V2_VERSION;
+    frame[3] = declared & 0xff;
+    frame[4] = declared >> 8;
+    frame[5] = payload & 0xff;
+    frame[6] = payload >> 8;
+    return CONNMGR_V2_HEADER + payload;
+}
+
+static void test_varint(void)
+{
+    const unsigned char valid[] = { 0xAC, 0x02 };
+    const unsigned char truncated[] = { 0xFF, 0xFF };
+    unsigned char overlong[11];
+    const unsigned char *p = valid;
+    uint64_t value;
+    CHECK(connmgr_varint(&p, valid + sizeof(valid), &value) == 0);
+    CHECK(value == 300 && p == valid + 2);
+    p = truncated;
+    CHECK(connmgr_varint(&p, truncated + sizeof(truncated), &value) == -1);
+    // ten bytes hold 64 bits, an eleventh one is an error
+    memset(overlong, 0x80, sizeof(overlong));
+    overlong[10] = 0x01;
+    p = overlong;
+    CHECK(connmgr_varint(&p, overlong + sizeof(overlong), &value) == -1);
+    unsigned char buffer[10];
+    CHECK(put_varint(buffer, UINT64_MAX) == buffer + 10);
+    p = buffer;
+    CHECK(connmgr_varint(&p, buffer + 10, &value) == 0 && value == UINT64_MAX);
+}
+
+static void test_decode_frame(void)
+{
+    // the timestamps go back and forth, their deltas are negative half the time
+    const sensor_data_t data[] = { { 1, 21.5, 1000 }, { 300, -3.25, 990 }, { 65535, 0, 2000 }, { 7, 18, 5 } };
+    const unsigned int count = sizeof(data) / sizeof(data[0]);
+    unsigned char frame[256];
+    sensor_data_t last;
+    connmgr_reactor_t *reactor = calloc(1, sizeof(connmgr_reactor_t));
+    CHECK(reactor != NULL);
+
+    size_t size = put_frame(frame, data, count, count);
+    CHECK(connmgr_decode_frame(reactor, frame, size, &last) == (ssize_t) size);
+    CHECK(reactor->staged == (int) count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        CHECK(reactor->staging[i].id == data[i].id);
+        CHECK(reactor->staging[i].value == data[i].value);
+        CHECK(reactor->staging[i].ts == data[i].ts);
+    }
+    // a frame that is not complete yet waits for more data
+    reactor->staged = 0;
+    CHECK(connmgr_decode_frame(reactor, frame, CONNMGR_V2_HEADER - 1, &last) == 0);
+    CHECK(connmgr_decode_frame(reactor, frame, size - 1, &last) == 0);
+    CHECK(reactor->staged == 0);
+    // more readings declared than sent: nothing of the frame is staged
+    size = put_frame(frame, data, count, count + 1);
+    CHECK(connmgr_decode_frame(reactor, frame, size, &last) == -1);
+    size = put_frame(frame, data, count, count - 1);
+    CHECK(connmgr_decode_frame(reactor, frame, size, &last) == -1);
+    CHECK(reactor->staged == 0);
+    // a wrong magic, and a sensor id beyond 16 bits
+    size = put_frame(frame, data, count, count);
+    frame[1] = 0;
+    CHECK(connmgr_decode_frame(reactor, frame, size, &last) == -1);
+    CHECK(reactor->staged == 0);
+    for (uint64_t id = UINT16_MAX; id <= UINT16_MAX + 1; id++)
+    {
+        size = put_frame(frame, data, 1, 1);
+        unsigned char *p = put_varint(frame + CONNMGR_V2_HEADER, id);
+        memset(p, 0, sizeof(uint64_t) + 1);
+        size = p + sizeof(uint64_t) + 1 - frame;
+        frame[5] = size - CONNMGR_V2_HEADER;
+        CHECK(connmgr_decode_frame(reactor, frame, size, &last) == (id <= UINT16_MAX ? (ssize_t) size : -1));
+    }
+    CHECK(reactor->staged == 1 && reactor->staging[0].id == UINT16_MAX);
+    free(reactor);
+}
+
+/**
+ * Opens a UDP socket that sends from 'source' to the listener of 'reactor'
+ */
+static int open_sender(connmgr_reactor_t *reactor, const char *source)
+{
+    struct sockaddr_in addr;
+    socklen_t length = sizeof(addr);
+    int sd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, source, &addr.sin_addr);
+    CHECK(bind(sd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    CHECK(getsockname(reactor->udp_sd, (struct sockaddr *) &addr, &length) == 0);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    CHECK(connect(sd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    return sd;
+}
+
+/**
+ * Reads what 'reactor' published and checks it carries the ids 'first' to 'first' + 'count' - 1
+ */
+static void check_published(int reader, int count, int first)
+{
+    sensor_data_t data;
+    for (int i = 0; i < count; i++)
+    {
+        CHECK(sbuffer_read(sbuffer, reader, &data) == SBUFFER_SUCCESS);
+        CHECK(data.id == (sensor_id_t) (first + i) && data.ts == first + i);
+    }
+    CHECK(sbuffer_read(sbuffer, reader, &data) == SBUFFER_NO_DATA);
+}
+
+static connmgr_reactor_t reactor;
+
+static void test_check_frames(void)
+{
+    const sensor_data_t data[] = { { 1, 20, 100 }, { 2, 21, 101 } };
+    unsigned char datagram[256];
+    size_t first = put_frame(datagram, data, 2, 2);
+    size_t second = put_frame(datagram + first, data, 1, 1);
+    CHECK(connmgr_check_frames(datagram, first + second) == 0);
+    // a good frame followed by a cut one is refused as a whole
+    CHECK(connmgr_check_frames(datagram, first + second - 1) == -1);
+    CHECK(connmgr_check_frames(datagram, first + 3) == -1);
+}
+
+static void test_udp_datagrams(int reader)
+{
+    unsigned char datagram[CONNMGR_UDP_DATAGRAM + CONNMGR_RECORD_SIZE];
+    const int whole = CONNMGR_UDP_DATAGRAM / CONNMGR_RECORD_SIZE;
+    int sd = open_sender(&reactor, "127.0.0.1");
+
+    // a partial record, an empty datagram and one the kernel has to cut: each is dropped whole,
+    // and they don't count as activity
+    atomic_store(&idle_since_ts, 0);
+    CHECK(send(sd, datagram, put_records(datagram, 1, 100) + 5, 0) > 0);
+    CHECK(send(sd, datagram, 0, 0) == 0);
+    CHECK(send(sd, datagram, put_records(datagram, whole + 1, 200), 0) > 0);
+    connmgr_udp_receive(&reactor);
+    CHECK(atomic_load(&idle_since_ts) == 0);
+
+    CHECK(send(sd, datagram, put_records(datagram, 3, 0), 0) == 3 * CONNMGR_RECORD_SIZE);
+    // the largest datagram that is taken whole
+    CHECK(send(sd, datagram, put_records(datagram, whole, 3), 0) > 0);
+    connmgr_udp_receive(&reactor);
+    CHECK(reactor.staged == 0);
+    check_published(reader, 3 + whole, 0);
+    CHECK(atomic_load(&idle_since_ts) != 0);
+
+    struct sockaddr_in addr;
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    connmgr_udp_source_t *source = connmgr_udp_source(&reactor, addr.sin_addr.s_addr);
+    CHECK(source->datagrams == 5);
+    CHECK(source->readings == 3 + whole);
+    CHECK(source->malformed == 2);
+    CHECK(source->dropped == 1);
+    close(sd);
+}
+
+static void test_udp_batches(int reader)
+{
+    unsigned char datagram[CONNMGR_RECORD_SIZE];
+    const int datagrams = 2 * CONNMGR_UDP_BATCH + 22;
+    int sd = open_sender(&reactor, "127.0.0.1");
+    for (int i = 0; i < datagrams; i++) CHECK(send(sd, datagram, put_records(datagram, 1, i), 0) == CONNMGR_RECORD_SIZE);
+    // full batches ask for more, the short one ends the wake-up
+    reactor.syscalls = 0;
+    connmgr_udp_receive(&reactor);
+    CHECK(reactor.syscalls == 3);
+    check_published(reader, datagrams, 0);
+    close(sd);
+}
+
+static void test_udp_sources(int reader)
+{
+    unsigned char datagram[CONNMGR_RECORD_SIZE];
+    char address[INET_ADDRSTRLEN];
+    const int sources = CONNMGR_UDP_SOURCES + 6;
+    int sd[CONNMGR_UDP_SOURCES + 6];
+    // every loopback address is a source of its own
+    for (int i = 0; i < sources; i++)
+    {
+        snprintf(address, sizeof(address), "127.0.1.%d", i + 1);
+        sd[i] = open_sender(&reactor, address);
+        CHECK(send(sd[i], datagram, put_records(datagram, 1, i), 0) == CONNMGR_RECORD_SIZE);
+        CHECK(send(sd[i], datagram, put_records(datagram, 1, i), 0) == CONNMGR_RECORD_SIZE);
+    }
+    connmgr_udp_receive(&reactor);
+    sensor_data_t data;
+    for (int i = 0; i < 2 * sources; i++) CHECK(sbuffer_read(sbuffer, reader, &data) == SBUFFER_SUCCESS);
+
+    int counted = 0;
+    for (int i = 0; i < CONNMGR_UDP_SOURCES; i++)
+    {
+        connmgr_udp_source_t *source = &reactor.udp_sources[i];
+        if (!source->used || (ntohl(source->addr) >> 8) != 0x7f0001) continue;
+        CHECK(source->datagrams == 2 && source->readings == 2);
+        counted++;
+    }
+    // the table is shared with the sender of the tests before, the sources that found it full share one bucket
+    CHECK(counted == CONNMGR_UDP_SOURCES - 1);
+    CHECK(reactor.udp_other.datagrams == 2 * (sources - counted));
+    for (int i = 0; i < sources; i++) close(sd[i]);
+}
+
+static void test_bucket_take(void)
+{
+    const connmgr_limit_t limit = { 100, 10 };
+    const connmgr_limit_t unlimited = { 0, 0 };
+    connmgr_bucket_t bucket = { 10, 1000 };
+    CHECK(connmgr_bucket_take(&bucket, &limit, 1000, 10) == 0);
+    // one reading into debt takes 10 ms to pay off at 100 per second
+    CHECK(connmgr_bucket_take(&bucket, &limit, 1000, 1) == 11);
+    CHECK(connmgr_bucket_take(&bucket, &limit, 1011, 0) == 0);
+    // an idle bucket fills up to its burst and no further
+    connmgr_bucket_refill(&bucket, &limit, 100000);
+    CHECK(bucket.tokens == 10);
+    CHECK(connmgr_bucket_take(&bucket, &unlimited, 100000, 1000) == 0);
+}
+
+static void test_sensor_take(void)
+{
+    const connmgr_limit_t limit = { 1000, 5 };
+    _Atomic uint64_t bucket = 0;
+    for (int i = 0; i < 5; i++) CHECK(connmgr_sensor_take(&bucket, &limit, 1000, 1) == 0);
+    // a datagram finds the bucket empty, a connection runs into debt
+    CHECK(connmgr_sensor_take(&bucket, &limit, 1000, 1) == UINT64_MAX);
+    CHECK(connmgr_sensor_take(&bucket, &limit, 1000, 0) == 2);
+    CHECK(connmgr_sensor_take(&bucket, &limit, 1000, 1) == UINT64_MAX);
+    // 1 ms pays for one reading, the debt has to go first
+    CHECK(connmgr_sensor_take(&bucket, &limit, 1001, 1) == UINT64_MAX);
+    CHECK(connmgr_sensor_take(&bucket, &limit, 1002, 1) == 0);
+    // an idle sensor starts from a full bucket, not from more
+    for (int i = 0; i < 5; i++) CHECK(connmgr_sensor_take(&bucket, &limit, 60000, 1) == 0);
+    CHECK(connmgr_sensor_take(&bucket, &limit, 60000, 1) == UINT64_MAX);
+}
+
+#define TEST_TAKERS 4
+#define TEST_BURST 1000
+
+static _Atomic uint64_t shared_bucket;
+static atomic_int shared_taken;
+
+static void *taker_main(void *arg)
+{
+    const connmgr_limit_t limit = { 1, TEST_BURST };
+    for (int i = 0; i < TEST_BURST; i++)
+        if (connmgr_sensor_take(&shared_bucket, &limit, 1000, 1) == 0) atomic_fetch_add(&shared_taken, 1);
+    return NULL;
+}
+
+static void test_sensor_take_shared(void)
+{
+    // reactors charge the bucket of a sensor at the same time: together they get its burst and not a reading more
+    pthread_t threads[TEST_TAKERS];
+    for (int i = 0; i < TEST_TAKERS; i++) pthread_create(&threads[i], NULL, taker_main, NULL);
+    for (int i = 0; i < TEST_TAKERS; i++) pthread_join(threads[i], NULL);
+    CHECK(atomic_load(&shared_taken) == TEST_BURST);
+}
+
+/**
+ * Sets up 'limited' as an epoll reactor with one connection, the other end of its socket is returned in '*peer'
+ */
+static tcp_connection_t *open_limited(connmgr_reactor_t *limited, int *peer)
+{
+    int sv[2];
+    tcpsock_t *socket;
+    limited->epoll_fd = epoll_create1(0);
+    limited->ring.fd = -1;
+    limited->connection_pool = mempool_create(sizeof(tcp_connection_t), 4);
+    limited->timeout_wheel = timer_wheel_create(connmgr_now_ms(), CONNMGR_TIMER_TICK_MS);
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    CHECK(tcp_attach_connection(&socket, sv[0]) == TCP_NO_ERROR);
+    tcp_connection_t *connection = connmgr_add(limited, limited->server, socket);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = connection };
+    CHECK(epoll_ctl(limited->epoll_fd, EPOLL_CTL_ADD, sv[0], &event) == 0);
+    *peer = sv[1];
+    return connection;
+}
+
+static void close_limited(connmgr_reactor_t *limited, int peer)
+{
+    while (limited->connection_list != NULL) connmgr_remove(limited->connection_list);
+    close(peer);
+    close(limited->epoll_fd);
+    timer_wheel_destroy(&limited->timeout_wheel);
+    mempool_destroy(&limited->connection_pool);
+    limited->staged = 0;
+}
+
+static void test_pause_connection(void)
+{
+    connmgr_reactor_t *limited = calloc(1, sizeof(connmgr_reactor_t));
+    unsigned char records[20 * CONNMGR_RECORD_SIZE];
+    struct epoll_event event;
+    int peer;
+    connmgr_limited = 1;
+    connection_limit = (connmgr_limit_t) { 100, 10 };
+    tcp_connection_t *connection = open_limited(limited, &peer);
+    CHECK(write(peer, "x", 1) == 1);
+    CHECK(epoll_wait(limited->epoll_fd, &event, 1, 0) == 1);
+
+    // within the burst nothing happens, beyond it the connection is not read until its debt is paid off
+    size_t length = put_records(records, 10, 1);
+    CHECK(connmgr_parse(connection, records, length) == (ssize_t) length);
+    CHECK(!connection->paused);
+    length = put_records(records, 20, 1);
+    CHECK(connmgr_parse(connection, records, length) == (ssize_t) length);
+    CHECK(connection->paused);
+    CHECK(limited->connection_pauses == 1);
+    CHECK(epoll_wait(limited->epoll_fd, &event, 1, 0) == 0);
+    // 20 readings over at 100 per second, the throttle timer is the next one and the timeout is off;
+    // the wheel rounds the deadline up to a tick and its clock may run a tick behind
+    int64_t wait = timer_wheel_next_timeout(limited->timeout_wheel, connmgr_now_ms());
+    CHECK(wait > 150 && wait <= 200 + 2 * CONNMGR_TIMER_TICK_MS);
+
+    connmgr_resume(connection);
+    CHECK(!connection->paused);
+    CHECK(epoll_wait(limited->epoll_fd, &event, 1, 0) == 1 && event.data.ptr == connection);
+    close_limited(limited, peer);
+    free(limited);
+    connmgr_limited = 0;
+    connection_limit = (connmgr_limit_t) { 0, 0 };
+}
+
+static void test_pause_sensor(void)
+{
+    connmgr_reactor_t *limited = calloc(1, sizeof(connmgr_reactor_t));
+    unsigned char records[20 * CONNMGR_RECORD_SIZE];
+    sensor_data_t data = { 6, 20, 0 };
+    int peer;
+    connmgr_limited = 1;
+    sensor_limits = calloc(UINT16_MAX + 1, sizeof(connmgr_limit_t));
+    sensor_buckets = calloc(UINT16_MAX + 1, sizeof(_Atomic uint64_t));
+    limited->sensors = calloc(UINT16_MAX + 1, sizeof(connmgr_sensor_t));
+    sensor_limits[5] = (connmgr_limit_t) { 100, 10 };
+    sensor_limits[6] = (connmgr_limit_t) { 100, 3 };
+    tcp_connection_t *connection = open_limited(limited, &peer);
+
+    // a connection of a sensor over its limit delivers what it sent, then it is paused;
+    // the pause is charged to that sensor, not to the one the connection sent last
+    for (int i = 0; i < 19; i++) put_records(records + i * CONNMGR_RECORD_SIZE, 1, 5);
+    put_records(records + 19 * CONNMGR_RECORD_SIZE, 1, 8);
+    CHECK(connmgr_parse(connection, records, sizeof(records)) == sizeof(records));
+    CHECK(connection->paused);
+    CHECK(limited->sensors[5].readings == 19);
+    CHECK(limited->sensors[5].over_limit == 1);
+    CHECK(limited->sensors[5].dropped == 0);
+    CHECK(limited->sensors[8].readings == 1 && limited->sensors[8].over_limit == 0);
+    CHECK(limited->connection_pauses == 0);
+    // readings from a datagram can't be paused, they are dropped
+    limited->datagram = 1;
+    limited->now_ms = connmgr_now_ms();
+    for (int i = 0; i < 5; i++) CHECK(connmgr_admit(limited, &data) == (i < 3));
+    CHECK(limited->sensors[6].readings == 3 && limited->sensors[6].dropped == 2);
+    // ids without a limit are only counted
+    data.id = 7;
+    CHECK(connmgr_admit(limited, &data) == 1 && limited->sensors[7].readings == 1);
+
+    close_limited(limited, peer);
+    free(limited->sensors);
+    free(limited);
+    free(sensor_limits);
+    free(sensor_buckets);
+    sensor_limits = NULL;
+    sensor_buckets = NULL;
+    connmgr_limited = 0;
+}
+
+int main(void)
+{
+    CHECK(sbuffer_init(&sbuffer) == SBUFFER_SUCCESS);
+    int reader = sbuffer_register_reader(sbuffer);
+    reactor_count = 1;
+    reactor.udp_port = 0;   // any free port
+    connmgr_udp_open(&reactor);
+
+    test_varint();
+    test_decode_frame();
+    test_check_frames();
+    test_udp_datagrams(reader);
+    test_udp_batches(reader);
+    test_udp_sources(reader);
+    test_bucket_take();
+    test_sensor_take();
+    test_sensor_take_shared();
+    test_pause_connection();
+    test_pause_sensor();
+
+    close(reactor.udp_sd);
+    sbuffer_unregister_reader(sbuffer, reader);
+    sbuffer_free(&sbuffer);
+    return TEST_RESULT();
+}
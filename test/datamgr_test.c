@@ -0,0 +1,91 @@
+/**
+ * \author Zeping Zhang
+ */
+
+// the room aggregates are updated by private functions of the data manager, so the test is built together with it
+#include "datamgr.c"
+#include "test.h"
+
+int datamgr_read_amount;
+sbuffer_t *sbuffer;
+int datamgr_reader;
+char *log_message;
+
+void fifo_log(char *log)
+{
+    free(log);
+}
+
+#define TEST_READINGS 200000
+
+static const char test_map[] = "1 10\n1 11\n2 12\n";
+
+static void test_room_stats(void)
+{
+    sensor_data_t readings[] = { { 10, 20, 100 }, { 11, 10, 105 }, { 12, 15, 90 }, { 10, 30, 101 }, { 99, 50, 200 } };
+    for (unsigned int i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) datamgr_parse_reading(&readings[i]);
+    datamgr_room_stats_t stats = datamgr_get_room_stats(1);
+    CHECK(stats.room_id == 1 && stats.sensors == 2 && stats.count == 3);
+    CHECK_NEAR(stats.mean, 20, 1e-12);
+    CHECK(stats.min == 10 && stats.max == 30 && stats.last_modified == 105);
+    stats = datamgr_get_room_stats(2);
+    CHECK(stats.sensors == 1 && stats.count == 1 && stats.mean == 15);
+    // a room that is not in the map, and an unknown sensor that touched no room
+    stats = datamgr_get_room_stats(3);
+    CHECK(stats.room_id == 3 && stats.sensors == 0 && stats.count == 0);
+}
+
+static atomic_int writers_done;
+
+static void *writer_main(void *arg)
+{
+    // a worker owns its sensor, two workers share the room: value and timestamp go up together
+    sensor_data_t data = { .id = *(sensor_id_t *) arg };
+    for (int i = 0; i < TEST_READINGS; i++)
+    {
+        data.value = 1000 + 2 * i + (data.id & 1);
+        data.ts = 1000 + 2 * i + (data.id & 1);
+        datamgr_parse_reading(&data);
+    }
+    atomic_fetch_add(&writers_done, 1);
+    return NULL;
+}
+
+static void test_room_stats_concurrent(void)
+{
+    // a torn copy would mix the fields of two updates, a consistent one keeps max and last_modified equal
+    sensor_id_t ids[] = { 10, 11 };
+    pthread_t threads[2];
+    datamgr_room_stats_t before = datamgr_get_room_stats(1);
+    for (int i = 0; i < 2; i++) pthread_create(&threads[i], NULL, writer_main, &ids[i]);
+    uint64_t count = before.count;
+    long checked = 0;
+    while (atomic_load(&writers_done) < 2)
+    {
+        datamgr_room_stats_t stats = datamgr_get_room_stats(1);
+        CHECK(stats.count >= count);
+        count = stats.count;
+        if (stats.count > before.count)
+        {
+            CHECK(stats.max == (sensor_value_t) stats.last_modified);
+            CHECK(stats.min == before.min && stats.min <= stats.mean && stats.mean <= stats.max);
+        }
+        checked++;
+    }
+    for (int i = 0; i < 2; i++) pthread_join(threads[i], NULL);
+    datamgr_room_stats_t stats = datamgr_get_room_stats(1);
+    CHECK(stats.count == before.count + 2 * TEST_READINGS);
+    CHECK(stats.max == 1000 + 2 * (TEST_READINGS - 1) + 1);
+    CHECK(checked > 0);
+}
+
+int main(void)
+{
+    FILE *map = fmemopen((void *) test_map, sizeof(test_map) - 1, "r");
+    parse_sensor_map(map);
+    fclose(map);
+    test_room_stats();
+    test_room_stats_concurrent();
+    datamgr_free();
+    return TEST_RESULT();
+}
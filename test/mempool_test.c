@@ -0,0 +1,109 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include "lib/mempool.h"
+#include "test.h"
+
+#define TEST_SLAB 16
+#define TEST_REMOTE 1000
+
+static void test_alloc_free(void)
+{
+    mempool_t *pool = mempool_create(3, TEST_SLAB);
+    mempool_stats_t stats;
+    void *objects[TEST_SLAB + 1];
+    CHECK(pool != NULL);
+    for (int i = 0; i < TEST_SLAB + 1; i++)
+    {
+        objects[i] = mempool_alloc(pool);
+        CHECK(objects[i] != NULL);
+        CHECK(((uintptr_t) objects[i] & 15) == 0);
+        // small objects are still rounded up to hold the free list link
+        *(long *) objects[i] = i;
+    }
+    for (int i = 0; i < TEST_SLAB + 1; i++) CHECK(*(long *) objects[i] == i);
+    mempool_get_stats(pool, &stats);
+    CHECK(stats.live == TEST_SLAB + 1 && stats.high_water == TEST_SLAB + 1 && stats.slabs == 2);
+
+    // freed objects are reused before the heap is asked for more
+    for (int i = 0; i < TEST_SLAB; i++) mempool_free(pool, objects[i]);
+    for (int i = 0; i < TEST_SLAB; i++) CHECK(mempool_alloc(pool) != NULL);
+    mempool_free(pool, NULL);
+    mempool_get_stats(pool, &stats);
+    CHECK(stats.live == TEST_SLAB + 1 && stats.high_water == TEST_SLAB + 1 && stats.slabs == 2);
+    CHECK(stats.remote_frees == 0);
+
+    mempool_destroy(&pool);
+    CHECK(pool == NULL);
+    mempool_destroy(&pool);
+    CHECK(mempool_create(8, 0) == NULL);
+}
+
+static void test_high_water(void)
+{
+    mempool_t *pool = mempool_create(64, TEST_SLAB);
+    mempool_stats_t stats;
+    void *objects[40];
+    for (int i = 0; i < 40; i++) objects[i] = mempool_alloc(pool);
+    for (int i = 0; i < 30; i++) mempool_free(pool, objects[i]);
+    for (int i = 0; i < 10; i++) objects[i] = mempool_alloc(pool);
+    mempool_get_stats(pool, &stats);
+    CHECK(stats.live == 20);
+    CHECK(stats.high_water == 40);
+    CHECK(stats.slabs == 3);
+    mempool_destroy(&pool);
+}
+
+struct remote_arg {
+    mempool_t *pool;
+    void **objects;
+    int count;
+};
+
+static void *remote_free_main(void *arg)
+{
+    struct remote_arg *remote = arg;
+    for (int i = 0; i < remote->count; i++) mempool_free(remote->pool, remote->objects[i]);
+    return NULL;
+}
+
+static void test_remote_free(void)
+{
+    // objects freed by other threads come back to the owner without growing the pool
+    mempool_t *pool = mempool_create(sizeof(long), TEST_REMOTE);
+    mempool_stats_t stats;
+    static void *objects[TEST_REMOTE];
+    pthread_t threads[4];
+    struct remote_arg args[4];
+    for (int i = 0; i < TEST_REMOTE; i++) objects[i] = mempool_alloc(pool);
+    for (int i = 0; i < 4; i++)
+    {
+        args[i] = (struct remote_arg) {pool, objects + i * TEST_REMOTE / 4, TEST_REMOTE / 4};
+        pthread_create(&threads[i], NULL, remote_free_main, &args[i]);
+    }
+    for (int i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+    mempool_get_stats(pool, &stats);
+    CHECK(stats.live == 0);
+    CHECK(stats.remote_frees == TEST_REMOTE);
+    CHECK(stats.slabs == 1);
+
+    // the owner takes over the return list once its own free list is empty
+    for (int i = 0; i < TEST_REMOTE; i++) CHECK((objects[i] = mempool_alloc(pool)) != NULL);
+    mempool_get_stats(pool, &stats);
+    CHECK(stats.live == TEST_REMOTE && stats.slabs == 1);
+    for (int i = 0; i < TEST_REMOTE; i++) mempool_free(pool, objects[i]);
+    mempool_get_stats(pool, &stats);
+    CHECK(stats.live == 0 && stats.remote_frees == TEST_REMOTE);
+    mempool_destroy(&pool);
+}
+
+int main(void)
+{
+    test_alloc_free();
+    test_high_water();
+    test_remote_free();
+    return TEST_RESULT();
+}
@@ -0,0 +1,88 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#include <stdlib.h>
+#include "lib/qsketch.h"
+#include "test.h"
+
+#define TEST_READINGS 20000
+
+/*
+ * A quantile is the middle of a bin, at most half a bin from the reading it stands for
+ */
+#define TEST_ERROR ((QSKETCH_MAX - QSKETCH_MIN) / QSKETCH_BINS / 2 + 1e-9)
+
+static int compare(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static qsketch_t sketch, half[2];
+static double sorted[TEST_READINGS];
+
+static void test_against_sorted(void)
+{
+    const double quantiles[] = { 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99, 0.999 };
+    qsketch_init(&sketch);
+    qsketch_init(&half[0]);
+    qsketch_init(&half[1]);
+    srand(42);
+    for (int i = 0; i < TEST_READINGS; i++)
+    {
+        // skewed towards the low end, like room temperatures
+        double u = (double) rand() / RAND_MAX;
+        sorted[i] = QSKETCH_MIN + (QSKETCH_MAX - QSKETCH_MIN) * u * u;
+        qsketch_add(&sketch, sorted[i]);
+        qsketch_add(&half[i % 2], sorted[i]);
+    }
+    qsort(sorted, TEST_READINGS, sizeof(double), compare);
+    CHECK(sketch.count == TEST_READINGS);
+    CHECK(sketch.min == sorted[0] && sketch.max == sorted[TEST_READINGS - 1]);
+    CHECK(qsketch_quantile(&sketch, 0) == sorted[0]);
+    CHECK(qsketch_quantile(&sketch, 1) == sorted[TEST_READINGS - 1]);
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++)
+    {
+        // the reference is the reading of rank q * n + 1, counted from 1
+        double expected = sorted[(int) (quantiles[i] * TEST_READINGS)];
+        CHECK_NEAR(qsketch_quantile(&sketch, quantiles[i]), expected, TEST_ERROR);
+    }
+    // the merge of two halves is the sketch of the whole
+    qsketch_merge(&half[0], &half[1]);
+    CHECK(half[0].count == sketch.count && half[0].min == sketch.min && half[0].max == sketch.max);
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++)
+        CHECK(qsketch_quantile(&half[0], quantiles[i]) == qsketch_quantile(&sketch, quantiles[i]));
+}
+
+static void test_edges(void)
+{
+    qsketch_init(&sketch);
+    CHECK(qsketch_quantile(&sketch, 0.5) == 0);
+    qsketch_add(&sketch, NAN);
+    CHECK(sketch.count == 0);
+    // readings outside the range are only counted, their quantiles are the extremes
+    qsketch_add(&sketch, -100);
+    qsketch_add(&sketch, 20);
+    qsketch_add(&sketch, 20);
+    qsketch_add(&sketch, 200);
+    CHECK(sketch.below == 1 && sketch.above == 1);
+    CHECK(qsketch_quantile(&sketch, 0.1) == -100);
+    CHECK_NEAR(qsketch_quantile(&sketch, 0.5), 20, TEST_ERROR);
+    CHECK(qsketch_quantile(&sketch, 0.9) == 200);
+    // the very top of the range still lands in the last bin
+    qsketch_init(&sketch);
+    qsketch_add(&sketch, QSKETCH_MAX - 1e-12);
+    CHECK(sketch.bins[QSKETCH_BINS - 1] == 1 && sketch.above == 0);
+    // merging an empty sketch changes nothing
+    qsketch_init(&half[0]);
+    qsketch_merge(&sketch, &half[0]);
+    CHECK(sketch.count == 1);
+}
+
+int main(void)
+{
+    test_against_sorted();
+    test_edges();
+    return TEST_RESULT();
+}
@@ -0,0 +1,101 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#include "lib/runavg.h"
+#include "test.h"
+
+RUNAVG_DEFINE(avg3, 3)
+
+static void test_fixed(void)
+{
+    avg3_t avg;
+    avg3_init(&avg);
+    CHECK(avg3_push(&avg, 1) == 0);
+    CHECK(avg3_push(&avg, 2) == 0);
+    CHECK(!avg3_full(&avg));
+    // the window is full with its third sample, the fourth pushes out the first
+    CHECK_NEAR(avg3_push(&avg, 3), 2, 1e-12);
+    CHECK(avg3_full(&avg));
+    CHECK_NEAR(avg3_push(&avg, 4), 3, 1e-12);
+    for (int i = 5; i < 1000; i++) avg3_push(&avg, i);
+    CHECK_NEAR(avg3_push(&avg, 1000), 999, 1e-9);
+}
+
+static void test_count(void)
+{
+    runavg_t avg;
+    CHECK(runavg_init(&avg, 0) == -1);
+    CHECK(runavg_init(&avg, 4) == 0);
+    for (int i = 1; i <= 3; i++) CHECK(runavg_push(&avg, i) == 0);
+    CHECK(!runavg_full(&avg));
+    CHECK_NEAR(runavg_push(&avg, 4), 2.5, 1e-12);
+    CHECK(runavg_full(&avg));
+    // across several wraps, where the sum is recomputed
+    double last = 0;
+    for (int i = 5; i <= 103; i++) last = runavg_push(&avg, i);
+    CHECK_NEAR(last, (100 + 101 + 102 + 103) / 4.0, 1e-9);
+    runavg_free(&avg);
+    CHECK(avg.samples == NULL);
+}
+
+static void test_time(void)
+{
+    runavg_time_t avg;
+    CHECK(runavg_time_init(&avg, 0) == -1);
+    CHECK(runavg_time_init(&avg, 10) == 0);
+    CHECK(runavg_time_push(&avg, 100, 1) == 0);
+    CHECK(runavg_time_push(&avg, 105, 2) == 0);
+    CHECK(!runavg_time_full(&avg));
+    // exactly 'span' seconds after the first sample: the window is full and the first sample just left it
+    CHECK_NEAR(runavg_time_push(&avg, 110, 3), 2.5, 1e-12);
+    CHECK(runavg_time_full(&avg));
+    CHECK(runavg_time_min(&avg) == 2 && runavg_time_max(&avg) == 3);
+    CHECK_NEAR(runavg_time_push(&avg, 111, 0), 5 / 3.0, 1e-12);
+    CHECK(runavg_time_min(&avg) == 0 && runavg_time_max(&avg) == 3);
+    // 105 leaves the window, 0 is still the minimum
+    CHECK_NEAR(runavg_time_push(&avg, 116, 10), 13 / 3.0, 1e-12);
+    CHECK(runavg_time_min(&avg) == 0 && runavg_time_max(&avg) == 10);
+    // a late sample counts as taken at the newest time
+    CHECK_NEAR(runavg_time_push(&avg, 50, 7), 20 / 4.0, 1e-12);
+    // a jump past the span leaves only the new sample
+    CHECK_NEAR(runavg_time_push(&avg, 200, 4), 4, 1e-12);
+    CHECK(runavg_time_min(&avg) == 4 && runavg_time_max(&avg) == 4);
+    runavg_time_free(&avg);
+
+    // many samples per second grow the queues well past their first capacity
+    CHECK(runavg_time_init(&avg, 2) == 0);
+    double last = 0;
+    for (int i = 0; i < 3000; i++) last = runavg_time_push(&avg, i / 100, i % 100);
+    CHECK_NEAR(last, 49.5, 1e-9);
+    CHECK(runavg_time_min(&avg) == 0 && runavg_time_max(&avg) == 99);
+    runavg_time_free(&avg);
+}
+
+static void test_ewma(void)
+{
+    runavg_ewma_t avg;
+    CHECK(runavg_ewma_init(&avg, 0, 0) == -1);
+    CHECK(runavg_ewma_init(&avg, 1.5, 0) == -1);
+    CHECK(runavg_ewma_init(&avg, 0.5, 0) == 0);
+    CHECK(runavg_ewma_push(&avg, 0, 10) == 10);
+    CHECK_NEAR(runavg_ewma_push(&avg, 0, 20), 15, 1e-12);
+    CHECK_NEAR(runavg_ewma_push(&avg, 100, 25), 20, 1e-12);
+
+    CHECK(runavg_ewma_init(&avg, 0, 10) == 0);
+    CHECK(runavg_ewma_push(&avg, 0, 10) == 10);
+    double weight = 1 - exp(-1.0);
+    CHECK_NEAR(runavg_ewma_push(&avg, 10, 20), 10 + weight * 10, 1e-12);
+    // a second sample of the same second is averaged with the first, not weighed on top of it
+    CHECK_NEAR(runavg_ewma_push(&avg, 10, 30), 10 + weight * 15, 1e-12);
+    CHECK_NEAR(runavg_ewma_push(&avg, 5, 40), 10 + weight * 20, 1e-12);
+}
+
+int main(void)
+{
+    test_fixed();
+    test_count();
+    test_time();
+    test_ewma();
+    return TEST_RESULT();
+}
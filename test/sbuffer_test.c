@@ -0,0 +1,487 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "sbuffer.h"
+#include "test.h"
+
+/*
+ * Readings every test pushes through the ring, enough to wrap it several times
+ */
+#define TEST_READINGS (4 * SBUFFER_CAPACITY + 123)
+
+/*
+ * Memory budget of the backpressure tests, in readings
+ */
+#define TEST_BUDGET 64
+
+static void fill(sensor_data_t *data, size_t count, long first)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        data[i].id = (sensor_id_t) (first + i);
+        data[i].value = first + i;
+        data[i].ts = first + i;
+    }
+}
+
+/**
+ * Reads up to 'max' readings of 'reader', checks they carry the sequence numbers from '*next' on without a gap
+ */
+static int read_some(sbuffer_t *buffer, int reader, long *next, int max)
+{
+    sensor_data_t reading;
+    int amount = 0;
+    while (amount < max && sbuffer_read(buffer, reader, &reading) == SBUFFER_SUCCESS)
+    {
+        CHECK(reading.ts == *next && reading.id == (sensor_id_t) *next);
+        (*next)++;
+        amount++;
+    }
+    return amount;
+}
+
+static void test_readers_wrap(void)
+{
+    sbuffer_t *buffer;
+    sensor_data_t data;
+    CHECK(sbuffer_init(&buffer) == SBUFFER_SUCCESS);
+    int fast = sbuffer_register_reader(buffer);
+    int slow = sbuffer_register_reader(buffer);
+    CHECK(fast >= 0 && slow >= 0 && fast != slow);
+    long inserted = 0, fast_next = 0, slow_next = 0;
+
+    // the slow reader only takes part of every round, it lags but never more than the ring holds
+    while (inserted < TEST_READINGS)
+    {
+        int count = SBUFFER_CAPACITY - sbuffer_unread(buffer, slow);
+        if (count > 5000) count = 5000;
+        for (int i = 0; i < count; i++, inserted++)
+        {
+            fill(&data, 1, inserted);
+            CHECK(sbuffer_insert(buffer, &data) == SBUFFER_SUCCESS);
+        }
+        CHECK(read_some(buffer, fast, &fast_next, TEST_READINGS) == count);
+        CHECK(read_some(buffer, slow, &slow_next, 1000) == 1000);
+    }
+    CHECK(sbuffer_unread(buffer, fast) == 0);
+    CHECK(sbuffer_unread(buffer, slow) == inserted - slow_next);
+    CHECK(sbuffer_size(buffer) == inserted - slow_next);
+    read_some(buffer, slow, &slow_next, TEST_READINGS);
+    CHECK(slow_next == inserted);
+    CHECK(sbuffer_size(buffer) == 0);
+    CHECK(sbuffer_read(buffer, fast, &data) == SBUFFER_NO_DATA);
+    CHECK(sbuffer_read(buffer, SBUFFER_MAX_READERS, &data) == SBUFFER_FAILURE);
+    sbuffer_unregister_reader(buffer, fast);
+    sbuffer_unregister_reader(buffer, slow);
+    sbuffer_free(&buffer);
+    CHECK(buffer == NULL);
+}
+
+static void test_register(void)
+{
+    sbuffer_t *buffer;
+    sensor_data_t data[10];
+    int readers[SBUFFER_MAX_READERS];
+    CHECK(sbuffer_init(&buffer) == SBUFFER_SUCCESS);
+    for (int i = 0; i < SBUFFER_MAX_READERS; i++) CHECK((readers[i] = sbuffer_register_reader(buffer)) >= 0);
+    CHECK(sbuffer_register_reader(buffer) == SBUFFER_FAILURE);
+    fill(data, 10, 0);
+    CHECK(sbuffer_insert_batch(buffer, data, 10) == SBUFFER_SUCCESS);
+    // a freed id is handed out again, the new reader only sees what comes after it
+    CHECK(sbuffer_unregister_reader(buffer, readers[3]) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_unregister_reader(buffer, readers[3]) == SBUFFER_FAILURE);
+    CHECK(sbuffer_register_reader(buffer) == readers[3]);
+    CHECK(sbuffer_unread(buffer, readers[3]) == 0);
+    fill(data, 5, 10);
+    CHECK(sbuffer_insert_batch(buffer, data, 5) == SBUFFER_SUCCESS);
+    long next = 10;
+    CHECK(read_some(buffer, readers[3], &next, 100) == 5);
+    next = 0;
+    CHECK(read_some(buffer, readers[0], &next, 100) == 15);
+    // the readings stay until the last reader that has not read them is gone
+    CHECK(sbuffer_size(buffer) == 15);
+    for (int i = 1; i < SBUFFER_MAX_READERS; i++) CHECK(sbuffer_unregister_reader(buffer, readers[i]) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_size(buffer) == 0);
+    CHECK(sbuffer_unregister_reader(buffer, readers[0]) == SBUFFER_SUCCESS);
+    sbuffer_free(&buffer);
+}
+
+static void test_evict_lagging(void)
+{
+    sbuffer_t *buffer;
+    static sensor_data_t data[SBUFFER_CAPACITY];
+    CHECK(sbuffer_init(&buffer) == SBUFFER_SUCCESS);
+    sbuffer_set_max_lag(buffer, SBUFFER_CAPACITY / 2);
+    int fast = sbuffer_register_reader(buffer);
+    int slow = sbuffer_register_reader(buffer);
+    long fast_next = 0;
+    fill(data, SBUFFER_CAPACITY, 0);
+    CHECK(sbuffer_insert_batch(buffer, data, SBUFFER_CAPACITY) == SBUFFER_SUCCESS);
+    read_some(buffer, fast, &fast_next, SBUFFER_CAPACITY);
+    // the ring is full for the slow reader: the producer evicts it instead of waiting forever
+    fill(data, 1, SBUFFER_CAPACITY);
+    CHECK(sbuffer_insert(buffer, data) == SBUFFER_SUCCESS);
+    sensor_data_t reading;
+    CHECK(sbuffer_read(buffer, slow, &reading) == SBUFFER_EVICTED);
+    CHECK(sbuffer_read_batch(buffer, slow, &reading, 1) == SBUFFER_EVICTED);
+    CHECK(sbuffer_wait(buffer, slow, 1, 0) == SBUFFER_EVICTED);
+    CHECK(sbuffer_evicted_lag(buffer, slow) == SBUFFER_CAPACITY);
+    CHECK(sbuffer_evicted_lag(buffer, fast) == 0);
+    sbuffer_stats_t stats;
+    sbuffer_get_stats(buffer, &stats);
+    CHECK(stats.evicted == 1);
+    CHECK(sbuffer_unread(buffer, slow) == 0);
+    CHECK(read_some(buffer, fast, &fast_next, 10) == 1);
+    CHECK(sbuffer_evict_reader(buffer, slow) == SBUFFER_FAILURE);
+    CHECK(sbuffer_evict_reader(buffer, fast) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_read(buffer, fast, &reading) == SBUFFER_EVICTED);
+    sbuffer_unregister_reader(buffer, fast);
+    sbuffer_unregister_reader(buffer, slow);
+    sbuffer_free(&buffer);
+}
+
+static void test_capacity(void)
+{
+    sbuffer_t *buffer;
+    sensor_data_t data[100];
+    sbuffer_stats_t stats;
+    CHECK(sbuffer_init_capacity(&buffer, 48) == SBUFFER_FAILURE);
+    CHECK(buffer == NULL);
+    CHECK(sbuffer_init_capacity(&buffer, 0) == SBUFFER_FAILURE);
+    // a 16 slot ring keeps only the newest 16 readings under drop-oldest
+    CHECK(sbuffer_init_capacity(&buffer, 16) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_set_policy(buffer, SBUFFER_POLICY_DROP_OLDEST, 0) == SBUFFER_SUCCESS);
+    int reader = sbuffer_register_reader(buffer);
+    fill(data, 100, 0);
+    CHECK(sbuffer_insert_batch(buffer, data, 100) == SBUFFER_SUCCESS);
+    long next = 100 - 16;
+    CHECK(read_some(buffer, reader, &next, 100) == 16);
+    sbuffer_get_stats(buffer, &stats);
+    CHECK(stats.dropped_oldest == 100 - 16);
+    sbuffer_unregister_reader(buffer, reader);
+    sbuffer_free(&buffer);
+}
+
+static void test_drop_oldest(void)
+{
+    sbuffer_t *buffer;
+    sensor_data_t data[100];
+    sbuffer_stats_t stats;
+    CHECK(sbuffer_init(&buffer) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_set_policy(buffer, SBUFFER_POLICY_DROP_OLDEST, TEST_BUDGET * sizeof(sensor_data_t)) == SBUFFER_SUCCESS);
+    int reader = sbuffer_register_reader(buffer);
+    fill(data, 100, 0);
+    CHECK(sbuffer_insert_batch(buffer, data, 100) == SBUFFER_SUCCESS);
+    // the reader skips the oldest readings and sees the newest budget full
+    long next = 100 - TEST_BUDGET;
+    CHECK(read_some(buffer, reader, &next, 100) == TEST_BUDGET);
+    sbuffer_get_stats(buffer, &stats);
+    CHECK(stats.dropped_oldest == 100 - TEST_BUDGET);
+    CHECK(stats.dropped_newest == 0 && stats.blocked == 0);
+    sbuffer_unregister_reader(buffer, reader);
+    sbuffer_free(&buffer);
+}
+
+static void test_drop_newest(void)
+{
+    sbuffer_t *buffer;
+    sensor_data_t data[100];
+    sbuffer_stats_t stats;
+    CHECK(sbuffer_init(&buffer) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_set_policy(buffer, SBUFFER_POLICY_DROP_NEWEST, TEST_BUDGET * sizeof(sensor_data_t)) == SBUFFER_SUCCESS);
+    int reader = sbuffer_register_reader(buffer);
+    fill(data, 100, 0);
+    CHECK(sbuffer_insert_batch(buffer, data, 100) == SBUFFER_DROPPED);
+    CHECK(sbuffer_insert(buffer, &data[0]) == SBUFFER_DROPPED);
+    long next = 0;
+    CHECK(read_some(buffer, reader, &next, 100) == TEST_BUDGET);
+    sbuffer_get_stats(buffer, &stats);
+    CHECK(stats.dropped_newest == 100 - TEST_BUDGET + 1);
+    // there is room again
+    CHECK(sbuffer_insert(buffer, &data[0]) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_unread(buffer, reader) == 1);
+    CHECK(sbuffer_set_policy(buffer, SBUFFER_POLICY_SPILL + 1, 0) == SBUFFER_FAILURE);
+    sbuffer_unregister_reader(buffer, reader);
+    sbuffer_free(&buffer);
+}
+
+static void test_spill_replay(void)
+{
+    sbuffer_t *buffer;
+    sensor_data_t data[10];
+    sbuffer_stats_t stats;
+    CHECK(sbuffer_init(&buffer) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_set_policy(buffer, SBUFFER_POLICY_SPILL, TEST_BUDGET * sizeof(sensor_data_t)) == SBUFFER_SUCCESS);
+    int fast = sbuffer_register_reader(buffer);
+    int slow = sbuffer_register_reader(buffer);
+    long fast_next = 0, slow_next = 0;
+    // the fast reader keeps up for a while, the slow one never: the budget fills and the rest goes to disk
+    for (int i = 0; i < 100; i++)
+    {
+        fill(data, 10, 10 * i);
+        CHECK(sbuffer_insert_batch(buffer, data, 10) == SBUFFER_SUCCESS);
+        if (i < 30) read_some(buffer, fast, &fast_next, 1000);
+    }
+    sbuffer_get_stats(buffer, &stats);
+    CHECK(stats.spilled > 0);
+    CHECK(stats.segments > 0);
+    // both replay every reading in insert order, across the ring and the segments
+    CHECK(read_some(buffer, fast, &fast_next, 1000) == 1000 - 300);
+    CHECK(read_some(buffer, slow, &slow_next, 1000) == 1000);
+    CHECK(fast_next == 1000 && slow_next == 1000);
+    sbuffer_get_stats(buffer, &stats);
+    CHECK(stats.segments == 0);
+    // back below the budget, the ring is used again
+    fill(data, 10, 1000);
+    CHECK(sbuffer_insert_batch(buffer, data, 10) == SBUFFER_SUCCESS);
+    CHECK(read_some(buffer, slow, &slow_next, 1000) == 10);
+    sbuffer_get_stats(buffer, &stats);
+    CHECK(stats.segments == 0);
+    sbuffer_unregister_reader(buffer, fast);
+    sbuffer_unregister_reader(buffer, slow);
+    sbuffer_free(&buffer);
+}
+
+static void test_wait_timeout(void)
+{
+    sbuffer_t *buffer;
+    sensor_data_t data[5];
+    struct timespec start, end;
+    CHECK(sbuffer_init(&buffer) == SBUFFER_SUCCESS);
+    int reader = sbuffer_register_reader(buffer);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CHECK(sbuffer_wait(buffer, reader, 1, 20) == SBUFFER_NO_DATA);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    CHECK((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000 >= 19);
+    // the deadline hands out a partial batch
+    fill(data, 5, 0);
+    CHECK(sbuffer_insert_batch(buffer, data, 5) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_wait(buffer, reader, 10, 20) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_wait(buffer, reader, 5, -1) == SBUFFER_SUCCESS);
+    // a closed buffer is drained first
+    sbuffer_close(buffer);
+    CHECK(sbuffer_wait(buffer, reader, 10, -1) == SBUFFER_SUCCESS);
+    long next = 0;
+    CHECK(read_some(buffer, reader, &next, 10) == 5);
+    CHECK(sbuffer_wait(buffer, reader, 1, -1) == SBUFFER_CLOSED);
+    CHECK(sbuffer_wait(buffer, SBUFFER_MAX_READERS, 1, 0) == SBUFFER_FAILURE);
+    sbuffer_unregister_reader(buffer, reader);
+    sbuffer_free(&buffer);
+}
+
+static sbuffer_t *shared;
+
+static void *waiting_reader_main(void *arg)
+{
+    int reader = *(int *) arg;
+    sensor_data_t batch[SBUFFER_BATCH_SIZE];
+    long next = 0;
+    int result;
+    // parks until a batch is there, the last partial batch comes with the close
+    while ((result = sbuffer_wait(shared, reader, 64, -1)) == SBUFFER_SUCCESS)
+    {
+        int amount = sbuffer_read_batch(shared, reader, batch, SBUFFER_BATCH_SIZE);
+        CHECK(amount > 0);
+        for (int i = 0; i < amount; i++, next++) CHECK(batch[i].ts == next);
+    }
+    CHECK(result == SBUFFER_CLOSED);
+    CHECK(next == TEST_READINGS);
+    return NULL;
+}
+
+static void test_wait_close(void)
+{
+    int readers[2];
+    pthread_t threads[2];
+    sensor_data_t data[100];
+    CHECK(sbuffer_init(&shared) == SBUFFER_SUCCESS);
+    for (int i = 0; i < 2; i++)
+    {
+        readers[i] = sbuffer_register_reader(shared);
+        pthread_create(&threads[i], NULL, waiting_reader_main, &readers[i]);
+    }
+    for (long i = 0; i < TEST_READINGS; i += 100)
+    {
+        long count = (TEST_READINGS - i < 100) ? TEST_READINGS - i : 100;
+        fill(data, count, i);
+        CHECK(sbuffer_insert_batch(shared, data, count) == SBUFFER_SUCCESS);
+        // give the readers a chance to park now and then
+        if (i % 10000 == 0) usleep(1000);
+    }
+    sbuffer_close(shared);
+    for (int i = 0; i < 2; i++) pthread_join(threads[i], NULL);
+    for (int i = 0; i < 2; i++) sbuffer_unregister_reader(shared, readers[i]);
+    sbuffer_free(&shared);
+}
+
+static void *late_reader_main(void *arg)
+{
+    int reader = *(int *) arg;
+    long next = 0;
+    // start late so the producer surely reaches the budget first
+    usleep(10000);
+    while (next < 1000)
+    {
+        CHECK(sbuffer_unread(shared, reader) <= TEST_BUDGET);
+        if (read_some(shared, reader, &next, 1000) == 0) sched_yield();
+    }
+    return NULL;
+}
+
+static void test_block(void)
+{
+    sensor_data_t data[1000];
+    sbuffer_stats_t stats;
+    pthread_t thread;
+    CHECK(sbuffer_init(&shared) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_set_policy(shared, SBUFFER_POLICY_BLOCK, TEST_BUDGET * sizeof(sensor_data_t)) == SBUFFER_SUCCESS);
+    int reader = sbuffer_register_reader(shared);
+    pthread_create(&thread, NULL, late_reader_main, &reader);
+    fill(data, 1000, 0);
+    CHECK(sbuffer_insert_batch(shared, data, 1000) == SBUFFER_SUCCESS);
+    pthread_join(thread, NULL);
+    sbuffer_get_stats(shared, &stats);
+    CHECK(stats.blocked >= 1);
+    CHECK(stats.dropped_oldest == 0 && stats.dropped_newest == 0);
+    sbuffer_unregister_reader(shared, reader);
+    sbuffer_free(&shared);
+}
+
+static void *reader_main(void *arg)
+{
+    int reader = *(int *) arg;
+    long next = 0;
+    while (next < TEST_READINGS)
+        if (read_some(shared, reader, &next, TEST_READINGS) == 0) sched_yield();
+    return NULL;
+}
+
+/*
+ * CPU time the blocked producer of test_block_park() used, in microseconds
+ */
+static long producer_cpu_us;
+
+static void *blocked_producer_main(void *arg)
+{
+    sensor_data_t data[TEST_BUDGET + 1];
+    struct timespec start, end;
+    fill(data, TEST_BUDGET + 1, 0);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    CHECK(sbuffer_insert_batch(shared, data, TEST_BUDGET + 1) == SBUFFER_SUCCESS);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    producer_cpu_us = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+    return NULL;
+}
+
+static void test_block_park(void)
+{
+    pthread_t thread;
+    CHECK(sbuffer_init(&shared) == SBUFFER_SUCCESS);
+    CHECK(sbuffer_set_policy(shared, SBUFFER_POLICY_BLOCK, TEST_BUDGET * sizeof(sensor_data_t)) == SBUFFER_SUCCESS);
+    int reader = sbuffer_register_reader(shared);
+    // the producer sleeps while the ring is full instead of polling it
+    pthread_create(&thread, NULL, blocked_producer_main, NULL);
+    usleep(200000);
+    long next = 0;
+    CHECK(read_some(shared, reader, &next, TEST_BUDGET) == TEST_BUDGET);
+    pthread_join(thread, NULL);
+    CHECK(producer_cpu_us < 50000);
+    CHECK(sbuffer_unread(shared, reader) == 1);
+    sbuffer_unregister_reader(shared, reader);
+
+    // a reader that leaves without reading frees the room as well
+    reader = sbuffer_register_reader(shared);
+    pthread_create(&thread, NULL, blocked_producer_main, NULL);
+    usleep(20000);
+    CHECK(sbuffer_unread(shared, reader) == TEST_BUDGET);
+    sbuffer_unregister_reader(shared, reader);
+    pthread_join(thread, NULL);
+    sbuffer_free(&shared);
+}
+
+static void test_threads(void)
+{
+    // the producer outruns both readers and has to wait for them every time the ring is full
+    int readers[2];
+    pthread_t threads[2];
+    sensor_data_t data;
+    CHECK(sbuffer_init(&shared) == SBUFFER_SUCCESS);
+    for (int i = 0; i < 2; i++)
+    {
+        readers[i] = sbuffer_register_reader(shared);
+        pthread_create(&threads[i], NULL, reader_main, &readers[i]);
+    }
+    for (long i = 0; i < TEST_READINGS; i++)
+    {
+        fill(&data, 1, i);
+        CHECK(sbuffer_insert(shared, &data) == SBUFFER_SUCCESS);
+    }
+    for (int i = 0; i < 2; i++) pthread_join(threads[i], NULL);
+    CHECK(sbuffer_size(shared) == 0);
+    for (int i = 0; i < 2; i++) sbuffer_unregister_reader(shared, readers[i]);
+    sbuffer_free(&shared);
+}
+
+static void *batch_reader_main(void *arg)
+{
+    int reader = *(int *) arg;
+    sensor_data_t batch[SBUFFER_BATCH_SIZE];
+    long next = 0;
+    while (next < TEST_READINGS)
+    {
+        int amount = sbuffer_read_batch(shared, reader, batch, SBUFFER_BATCH_SIZE);
+        CHECK(amount >= 0);
+        if (amount <= 0) sched_yield();
+        for (int i = 0; i < amount; i++, next++) CHECK(batch[i].ts == next);
+    }
+    return NULL;
+}
+
+static void test_batches(void)
+{
+    // batches of an odd size straddle the end of the ring and are larger than the room that is left in it
+    int readers[2];
+    pthread_t threads[2];
+    static sensor_data_t data[3 * SBUFFER_BATCH_SIZE + 7];
+    const long batch = sizeof(data) / sizeof(data[0]);
+    CHECK(sbuffer_init(&shared) == SBUFFER_SUCCESS);
+    for (int i = 0; i < 2; i++)
+    {
+        readers[i] = sbuffer_register_reader(shared);
+        pthread_create(&threads[i], NULL, batch_reader_main, &readers[i]);
+    }
+    for (long i = 0; i < TEST_READINGS; i += batch)
+    {
+        long count = (TEST_READINGS - i < batch) ? TEST_READINGS - i : batch;
+        fill(data, count, i);
+        CHECK(sbuffer_insert_batch(shared, data, count) == SBUFFER_SUCCESS);
+    }
+    for (int i = 0; i < 2; i++) pthread_join(threads[i], NULL);
+    CHECK(sbuffer_size(shared) == 0);
+    CHECK(sbuffer_read_batch(shared, readers[0], data, batch) == 0);
+    for (int i = 0; i < 2; i++) sbuffer_unregister_reader(shared, readers[i]);
+    sbuffer_free(&shared);
+}
+
+int main(void)
+{
+    test_readers_wrap();
+    test_register();
+    test_evict_lagging();
+    test_capacity();
+    test_drop_oldest();
+    test_drop_newest();
+    test_spill_replay();
+    test_block();
+    test_block_park();
+    test_threads();
+    test_batches();
+    test_wait_timeout();
+    test_wait_close();
+    return TEST_RESULT();
+}
@@ -0,0 +1,191 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "lib/tcpsock.h"
+#include "test.h"
+
+#define TEST_PORT 5798
+#define TEST_PATH "tcpsock_test.sock"
+
+/**
+ * Connects a client to 'listener' and accepts it, the accepted side is made non-blocking
+ */
+static void connect_pair(tcpsock_t *listener, tcpsock_t **client, tcpsock_t **accepted)
+{
+    int sd;
+    CHECK(tcp_active_open(client, TEST_PORT, "127.0.0.1") == TCP_NO_ERROR);
+    CHECK(tcp_wait_for_connection(listener, accepted) == TCP_NO_ERROR);
+    CHECK(tcp_get_sd(*accepted, &sd) == TCP_NO_ERROR);
+    CHECK(fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK) == 0);
+}
+
+/**
+ * Sends "0123456789" in pieces of 3 bytes, 10 ms apart
+ */
+static void *slow_sender_main(void *arg)
+{
+    tcpsock_t *client = arg;
+    for (int sent = 0; sent < 10; sent += 3)
+    {
+        usleep(10000);
+        int size = (10 - sent < 3) ? 10 - sent : 3;
+        CHECK(tcp_send(client, "0123456789" + sent, &size) == TCP_NO_ERROR);
+    }
+    return NULL;
+}
+
+static void test_some_exact(tcpsock_t *listener)
+{
+    tcpsock_t *client, *accepted;
+    pthread_t sender;
+    char buffer[16];
+    connect_pair(listener, &client, &accepted);
+    // nothing there yet: tcp_receive_some() does not wait
+    int size = sizeof(buffer);
+    CHECK(tcp_receive_some(accepted, buffer, &size) == TCP_NO_ERROR && size == 0);
+    size = 4;
+    CHECK(tcp_send(client, "abcd", &size) == TCP_NO_ERROR);
+    usleep(10000);
+    size = sizeof(buffer);
+    CHECK(tcp_receive_some(accepted, buffer, &size) == TCP_NO_ERROR);
+    CHECK(size == 4 && memcmp(buffer, "abcd", 4) == 0);
+
+    // tcp_receive_exact() waits on the non-blocking socket until every piece arrived
+    pthread_create(&sender, NULL, slow_sender_main, client);
+    size = 10;
+    CHECK(tcp_receive_exact(accepted, buffer, &size, -1) == TCP_NO_ERROR);
+    CHECK(size == 10 && memcmp(buffer, "0123456789", 10) == 0);
+    pthread_join(sender, NULL);
+
+    // the rest of the record never comes
+    size = 2;
+    CHECK(tcp_send(client, "xy", &size) == TCP_NO_ERROR);
+    size = 8;
+    CHECK(tcp_receive_exact(accepted, buffer, &size, 50) == TCP_TIMEOUT);
+    CHECK(size == 2 && memcmp(buffer, "xy", 2) == 0);
+
+    // the connection closes halfway
+    size = 2;
+    CHECK(tcp_send(client, "xy", &size) == TCP_NO_ERROR);
+    tcp_close(&client);
+    size = 8;
+    CHECK(tcp_receive_exact(accepted, buffer, &size, -1) == TCP_CONNECTION_CLOSED);
+    CHECK(size == 2 && memcmp(buffer, "xy", 2) == 0);
+    tcp_close(&accepted);
+}
+
+static void test_vectored(tcpsock_t *listener)
+{
+    tcpsock_t *client, *accepted;
+    char header[3] = "hdr", body[7] = "payload", trailer[2] = "!!";
+    char first[5], second[16];
+    connect_pair(listener, &client, &accepted);
+    const struct iovec out[] = { { header, sizeof(header) }, { body, sizeof(body) }, { trailer, sizeof(trailer) } };
+    int size;
+    CHECK(tcp_sendv(client, out, 3, &size) == TCP_NO_ERROR && size == 12);
+    usleep(10000);
+    // the receiving side splits the stream differently, the buffers are filled in order
+    const struct iovec in[] = { { first, sizeof(first) }, { second, sizeof(second) } };
+    CHECK(tcp_receivev(accepted, in, 2, &size) == TCP_NO_ERROR && size == 12);
+    CHECK(memcmp(first, "hdrpa", 5) == 0 && memcmp(second, "yload!!", 7) == 0);
+
+    // the client closes first, so no connection of the listening port is left in TIME_WAIT
+    tcp_close(&client);
+    CHECK(tcp_receivev(accepted, in, 2, &size) == TCP_CONNECTION_CLOSED);
+    CHECK(tcp_sendv(NULL, out, 3, &size) == TCP_SOCKET_ERROR);
+    tcp_close(&accepted);
+}
+
+static void test_unix_stream(void)
+{
+    tcpsock_t *listener, *client, *accepted;
+    char buffer[16];
+    CHECK(tcp_passive_open_unix(&listener, TEST_PATH, SOCK_STREAM, NULL) == TCP_NO_ERROR);
+    CHECK(access(TEST_PATH, F_OK) == 0);
+    CHECK(tcp_active_open_unix(&client, TEST_PATH, SOCK_STREAM) == TCP_NO_ERROR);
+    CHECK(tcp_wait_for_connection(listener, &accepted) == TCP_NO_ERROR);
+    int size = 10;
+    CHECK(tcp_send(client, "0123456789", &size) == TCP_NO_ERROR && size == 10);
+    size = 10;
+    CHECK(tcp_receive_exact(accepted, buffer, &size, -1) == TCP_NO_ERROR);
+    CHECK(size == 10 && memcmp(buffer, "0123456789", 10) == 0);
+    tcp_close(&client);
+    size = 1;
+    CHECK(tcp_receive_exact(accepted, buffer, &size, -1) == TCP_CONNECTION_CLOSED);
+    tcp_close(&accepted);
+    // closing the listener removes its path
+    tcp_close(&listener);
+    CHECK(access(TEST_PATH, F_OK) != 0);
+}
+
+static void test_unix_seqpacket(void)
+{
+    tcpsock_t *listener, *client, *accepted;
+    char message[64], buffer[32];
+    memset(message, 'x', sizeof(message));
+    CHECK(tcp_passive_open_unix(&listener, TEST_PATH, SOCK_SEQPACKET, NULL) == TCP_NO_ERROR);
+    CHECK(tcp_active_open_unix(&client, TEST_PATH, SOCK_SEQPACKET) == TCP_NO_ERROR);
+    CHECK(tcp_wait_for_connection(listener, &accepted) == TCP_NO_ERROR);
+    int size = sizeof(buffer);
+    CHECK(tcp_receive_message(accepted, buffer, &size) == TCP_NO_ERROR && size == 0);
+    // two messages are never merged, and a message too large for the buffer is reported
+    size = 20;
+    CHECK(tcp_send(client, message, &size) == TCP_NO_ERROR);
+    size = sizeof(message);
+    CHECK(tcp_send(client, message, &size) == TCP_NO_ERROR);
+    size = sizeof(buffer);
+    CHECK(tcp_receive_message(accepted, buffer, &size) == TCP_NO_ERROR && size == 20);
+    size = sizeof(buffer);
+    CHECK(tcp_receive_message(accepted, buffer, &size) == TCP_MESSAGE_TRUNCATED && size == sizeof(buffer));
+    tcp_close(&client);
+    size = sizeof(buffer);
+    CHECK(tcp_receive_message(accepted, buffer, &size) == TCP_CONNECTION_CLOSED);
+    tcp_close(&accepted);
+    tcp_close(&listener);
+}
+
+static void test_unix_path(void)
+{
+    tcpsock_t *listener;
+    char path[200];
+    memset(path, 'p', sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+    CHECK(tcp_passive_open_unix(&listener, path, SOCK_STREAM, NULL) == TCP_ADDRESS_ERROR);
+    CHECK(tcp_passive_open_unix(&listener, TEST_PATH, SOCK_DGRAM, NULL) == TCP_ADDRESS_ERROR);
+    CHECK(tcp_active_open_unix(&listener, TEST_PATH, SOCK_STREAM) == TCP_SOCKOP_ERROR);
+    // a socket left behind is replaced, any other file is left alone
+    int sd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX, .sun_path = TEST_PATH };
+    CHECK(bind(sd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    close(sd);
+    CHECK(tcp_passive_open_unix(&listener, TEST_PATH, SOCK_STREAM, NULL) == TCP_NO_ERROR);
+    tcp_close(&listener);
+    int fd = open(TEST_PATH, O_CREAT | O_WRONLY, 0600);
+    CHECK(fd >= 0);
+    close(fd);
+    CHECK(tcp_passive_open_unix(&listener, TEST_PATH, SOCK_STREAM, NULL) == TCP_ADDRESS_ERROR);
+    CHECK(access(TEST_PATH, F_OK) == 0);
+    unlink(TEST_PATH);
+}
+
+int main(void)
+{
+    tcpsock_t *listener = NULL;
+    CHECK(tcp_passive_open(&listener, TEST_PORT) == TCP_NO_ERROR);
+    if (listener == NULL) return TEST_RESULT();
+    test_some_exact(listener);
+    test_vectored(listener);
+    tcp_close(&listener);
+    unlink(TEST_PATH);
+    test_unix_stream();
+    test_unix_seqpacket();
+    test_unix_path();
+    return TEST_RESULT();
+}
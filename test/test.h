@@ -0,0 +1,31 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/*
+ * Every test is a program of its own: a failed check is printed and counted, main() returns TEST_RESULT()
+ */
+static int test_failures = 0;
+
+#define CHECK(condition)                                                                        \
+    do {                                                                                        \
+        if (!(condition))                                                                       \
+        {                                                                                       \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, __func__, #condition); \
+            test_failures++;                                                                    \
+        }                                                                                       \
+    } while(0)
+
+#define CHECK_NEAR(value, expected, error) CHECK(fabs((double) (value) - (double) (expected)) <= (error))
+
+#define TEST_RESULT()                                                                           \
+    (printf("%s: %s\n", __FILE__, test_failures ? "FAILED" : "ok"), test_failures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+#endif  //_TEST_H_
@@ -0,0 +1,91 @@
+/**
+ * \author Zeping Zhang
+ */
+
+#include "lib/timerwheel.h"
+#include "test.h"
+
+#define TEST_TICK_MS 10
+#define TEST_START_MS 123456
+
+/**
+ * Runs 'wheel' from 'now' like a reactor does: sleep for timer_wheel_next_timeout(), then collect the expired timers
+ * Checks every timer fires on time, never early and at most one tick late, and returns the time the wheel ran to
+ */
+static uint64_t run_until_empty(timer_wheel_t *wheel, uint64_t now, int armed)
+{
+    int fired = 0;
+    int64_t delay;
+    while ((delay = timer_wheel_next_timeout(wheel, now)) >= 0)
+    {
+        now += delay;
+        timer_wheel_timer_t *timer;
+        while ((timer = timer_wheel_pop_expired(wheel, now)) != NULL)
+        {
+            uint64_t expires_ms = *(uint64_t *) timer->data;
+            CHECK(now >= expires_ms);
+            CHECK(now < expires_ms + TEST_TICK_MS);
+            CHECK(timer->list == NULL);
+            fired++;
+        }
+    }
+    CHECK(fired == armed);
+    return now;
+}
+
+static void test_levels(void)
+{
+    // one timer per level of 64 slots, one beyond the wheel, and one in the past
+    const uint64_t delays[] = { 35, 63 * TEST_TICK_MS, 64 * TEST_TICK_MS, 5000 * TEST_TICK_MS, 4096 * TEST_TICK_MS,
+                                300000ull * TEST_TICK_MS, 262144ull * TEST_TICK_MS, 20000000ull * TEST_TICK_MS };
+    const int count = sizeof(delays) / sizeof(delays[0]);
+    timer_wheel_timer_t timers[sizeof(delays) / sizeof(delays[0]) + 1];
+    uint64_t expires[sizeof(delays) / sizeof(delays[0]) + 1];
+    timer_wheel_t *wheel = timer_wheel_create(TEST_START_MS, TEST_TICK_MS);
+    CHECK(wheel != NULL);
+    CHECK(timer_wheel_next_timeout(wheel, TEST_START_MS) == -1);
+    for (int i = 0; i < count; i++)
+    {
+        expires[i] = TEST_START_MS + delays[i];
+        timer_wheel_timer_init(&timers[i], &expires[i]);
+        timer_wheel_arm(wheel, &timers[i], expires[i]);
+    }
+    expires[count] = TEST_START_MS - 1000;
+    timer_wheel_timer_init(&timers[count], &expires[count]);
+    timer_wheel_arm(wheel, &timers[count], expires[count]);
+    CHECK(timer_wheel_pop_expired(wheel, TEST_START_MS) == &timers[count]);
+    run_until_empty(wheel, TEST_START_MS, count);
+    timer_wheel_destroy(&wheel);
+    CHECK(wheel == NULL);
+}
+
+static void test_rearm_cancel(void)
+{
+    timer_wheel_timer_t timers[3];
+    uint64_t expires[3];
+    timer_wheel_t *wheel = timer_wheel_create(TEST_START_MS, TEST_TICK_MS);
+    for (int i = 0; i < 3; i++)
+    {
+        expires[i] = TEST_START_MS + 100000;
+        timer_wheel_timer_init(&timers[i], &expires[i]);
+        timer_wheel_arm(wheel, &timers[i], expires[i]);
+    }
+    // moved from a coarse level to the finest one, and cancelled twice
+    expires[0] = TEST_START_MS + 50;
+    timer_wheel_arm(wheel, &timers[0], expires[0]);
+    timer_wheel_cancel(wheel, &timers[1]);
+    timer_wheel_cancel(wheel, &timers[1]);
+    CHECK(timers[1].list == NULL);
+    uint64_t now = TEST_START_MS + 60;
+    CHECK(timer_wheel_pop_expired(wheel, now) == &timers[0]);
+    CHECK(timer_wheel_pop_expired(wheel, now) == NULL);
+    run_until_empty(wheel, now, 1);
+    timer_wheel_destroy(&wheel);
+}
+
+int main(void)
+{
+    test_levels();
+    test_rearm_cancel();
+    return TEST_RESULT();
+}